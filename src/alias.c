@@ -0,0 +1,75 @@
+#include "alias.h"
+#include <stdlib.h>
+
+static uint32_t to_threshold(double p) {
+    double t = p * 4294967296.0;
+    return (t >= 4294967295.0) ? UINT32_MAX : (uint32_t)t;
+}
+
+int alias_build(AliasTable *table, const double *weights, size_t n) {
+    table->n = 0;
+    table->prob = NULL;
+    table->alias = NULL;
+    if (n == 0 || n > UINT32_MAX) return 1;
+
+    double total = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        if (weights[i] < 0.0) return 1;
+        total += weights[i];
+    }
+    if (total <= 0.0) return 1;
+
+    double *scaled = malloc(n * sizeof(double));
+    size_t *small = malloc(n * sizeof(size_t));
+    size_t *large = malloc(n * sizeof(size_t));
+    table->prob = malloc(n * sizeof(uint32_t));
+    table->alias = malloc(n * sizeof(uint32_t));
+    if (!scaled || !small || !large || !table->prob || !table->alias) {
+        free(scaled); free(small); free(large);
+        alias_free(table);
+        return 1;
+    }
+
+    size_t n_small = 0, n_large = 0;
+    for (size_t i = 0; i < n; i++) {
+        scaled[i] = weights[i] * (double)n / total;
+        if (scaled[i] < 1.0) small[n_small++] = i;
+        else large[n_large++] = i;
+    }
+
+    // Vose: pair each under-full column with an over-full one.
+    while (n_small > 0 && n_large > 0) {
+        size_t s = small[--n_small];
+        size_t l = large[--n_large];
+        table->prob[s] = to_threshold(scaled[s]);
+        table->alias[s] = (uint32_t)l;
+        scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+        if (scaled[l] < 1.0) small[n_small++] = l;
+        else large[n_large++] = l;
+    }
+    // Whatever is left is full up to rounding error.
+    while (n_large > 0) {
+        size_t l = large[--n_large];
+        table->prob[l] = UINT32_MAX;
+        table->alias[l] = (uint32_t)l;
+    }
+    while (n_small > 0) {
+        size_t s = small[--n_small];
+        table->prob[s] = UINT32_MAX;
+        table->alias[s] = (uint32_t)s;
+    }
+
+    table->n = n;
+    free(scaled);
+    free(small);
+    free(large);
+    return 0;
+}
+
+void alias_free(AliasTable *table) {
+    free(table->prob);
+    free(table->alias);
+    table->prob = NULL;
+    table->alias = NULL;
+    table->n = 0;
+}
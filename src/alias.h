@@ -0,0 +1,33 @@
+#ifndef ALIAS_H
+#define ALIAS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "prng.h"
+
+// Walker/Vose alias table: samples an index from a fixed discrete
+// distribution in O(1) with a single 64-bit random draw.
+typedef struct {
+    size_t n;
+    uint32_t *prob;   // Acceptance threshold of each column, scaled to 2^32
+    uint32_t *alias;  // Index returned when the column is rejected
+} AliasTable;
+
+// Builds the table from non-negative weights (they need not sum to 1).
+// Returns 0 on success, non-zero on error (no positive weight, out of memory).
+int alias_build(AliasTable *table, const double *weights, size_t n);
+
+void alias_free(AliasTable *table);
+
+// Samples with caller-supplied random bits.
+static inline size_t alias_sample_bits(const AliasTable *table, uint64_t r) {
+    uint32_t column = (uint32_t)(((r & 0xFFFFFFFFu) * table->n) >> 32);
+    uint32_t coin = (uint32_t)(r >> 32);
+    return (coin < table->prob[column]) ? column : table->alias[column];
+}
+
+static inline size_t alias_sample(const AliasTable *table, Prng *rng) {
+    return alias_sample_bits(table, prng_next(rng));
+}
+
+#endif // ALIAS_H
@@ -0,0 +1,433 @@
+#include "batch.h"
+#include "config.h"
+#include "parser.h"
+#include "generator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define MAX_LINE_LENGTH 4096
+
+// Jobs expected to produce at least this much are split over the pool.
+#define SPLIT_MIN_BYTES ((uint64_t)64 * 1024 * 1024)
+// Parts per worker of a split job, so that stealing can even out the load.
+#define SPLIT_PARTS_PER_WORKER 4
+
+typedef struct {
+    const BatchJobSpec *spec;
+    Config config;
+    int parsed;
+    uint64_t estimate;       // Expected output bytes, for scheduling
+    FILE *file;
+    GenSplit *split;         // NULL for a single-task job
+    size_t parts_left;
+    int failed;
+    const char *error;       // Reason of the failure
+    uint64_t bytes;          // Size of the output file
+    uint64_t start_ns;
+    uint64_t end_ns;
+} BatchJob;
+
+typedef struct {
+    BatchJob *job;
+    size_t part;
+} Task;
+
+// Owner takes from the head (largest first), thieves from the tail.
+typedef struct {
+    Task *tasks;
+    size_t head;
+    size_t tail;
+    pthread_mutex_t lock;
+} TaskDeque;
+
+typedef struct {
+    TaskDeque *deques;
+    size_t workers;
+    pthread_mutex_t lock;    // Job state of split jobs
+} Pool;
+
+typedef struct {
+    Pool *pool;
+    size_t index;
+} Worker;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// --- Manifest ---
+
+int batch_read_manifest(const char *path, BatchJobSpec **jobs, size_t *count) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror("Error opening manifest file");
+        return 1;
+    }
+
+    BatchJobSpec *list = NULL;
+    size_t n = 0, capacity = 0;
+    char line[MAX_LINE_LENGTH];
+    int line_num = 0;
+    int rc = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        line_num++;
+        char *save = NULL;
+        char *def = strtok_r(line, " \t\r\n", &save);
+        if (!def || def[0] == '#') continue;
+        char *out = strtok_r(NULL, " \t\r\n", &save);
+        if (!out || strtok_r(NULL, " \t\r\n", &save)) {
+            fprintf(stderr, "Invalid manifest entry at line %d: expected <definition_file> <output_file>\n", line_num);
+            rc = 1;
+            break;
+        }
+        if (n == capacity) {
+            size_t grow = capacity ? capacity * 2 : 64;
+            BatchJobSpec *p = realloc(list, grow * sizeof(BatchJobSpec));
+            if (!p) {
+                perror("Error allocating manifest");
+                rc = 1;
+                break;
+            }
+            list = p;
+            capacity = grow;
+        }
+        list[n].def_file = strdup(def);
+        list[n].out_file = strdup(out);
+        n++;
+        if (!list[n - 1].def_file || !list[n - 1].out_file) {
+            perror("Error allocating manifest");
+            rc = 1;
+            break;
+        }
+    }
+    if (rc == 0 && ferror(file)) {
+        perror("Error reading manifest file");
+        rc = 1;
+    }
+    fclose(file);
+
+    if (rc == 0 && n == 0) {
+        fprintf(stderr, "Error: Manifest '%s' lists no jobs.\n", path);
+        rc = 1;
+    }
+    if (rc != 0) {
+        batch_free_manifest(list, n);
+        return 1;
+    }
+    *jobs = list;
+    *count = n;
+    return 0;
+}
+
+void batch_free_manifest(BatchJobSpec *jobs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free((char *)jobs[i].def_file);
+        free((char *)jobs[i].out_file);
+    }
+    free(jobs);
+}
+
+// --- Work-stealing pool ---
+
+static int take_task(TaskDeque *d, Task *task) {
+    pthread_mutex_lock(&d->lock);
+    int found = d->head < d->tail;
+    if (found) *task = d->tasks[d->head++];
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+static int steal_task(TaskDeque *d, Task *task) {
+    pthread_mutex_lock(&d->lock);
+    int found = d->head < d->tail;
+    if (found) *task = d->tasks[--d->tail];
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+static void fail_job(BatchJob *job, const char *error) {
+    if (!job->failed) job->error = error;
+    job->failed = 1;
+}
+
+// Closes the output and records its size.
+static void finish_output(BatchJob *job) {
+    struct stat st;
+    if (fstat(fileno(job->file), &st) == 0) job->bytes = (uint64_t)st.st_size;
+    if (fclose(job->file) != 0) fail_job(job, "error closing the output file");
+    job->file = NULL;
+}
+
+static void run_whole(BatchJob *job) {
+    job->start_ns = now_ns();
+    if (!job->file) job->file = fopen(job->spec->out_file, generate_output_mode(job->spec->out_file));
+    if (!job->file) {
+        perror("Error opening output file");
+        fail_job(job, "cannot open the output file");
+    } else {
+        if (generate_data(&job->config, job->file) != 0) fail_job(job, "generation failed");
+        finish_output(job);
+    }
+    job->end_ns = now_ns();
+}
+
+static void run_part(Pool *pool, BatchJob *job, size_t part) {
+    pthread_mutex_lock(&pool->lock);
+    if (job->start_ns == 0) job->start_ns = now_ns();
+    int skip = job->failed;
+    pthread_mutex_unlock(&pool->lock);
+
+    int rc = skip ? 0 : generate_split_run(job->split, part);
+
+    pthread_mutex_lock(&pool->lock);
+    if (rc != 0) fail_job(job, "generation failed");
+    int last = (--job->parts_left == 0);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (last) {
+        // Every other part is done; nobody else touches the job any more.
+        generate_split_close(job->split);
+        job->split = NULL;
+        finish_output(job);
+        job->end_ns = now_ns();
+    }
+}
+
+static void *pool_worker(void *arg) {
+    Worker *w = arg;
+    Pool *pool = w->pool;
+    Task task;
+
+    for (;;) {
+        int found = take_task(&pool->deques[w->index], &task);
+        // All tasks exist before the workers start, so once every deque is
+        // empty there is nothing left to wait for.
+        for (size_t k = 1; !found && k < pool->workers; k++) {
+            found = steal_task(&pool->deques[(w->index + k) % pool->workers], &task);
+        }
+        if (!found) break;
+
+        if (task.job->split) {
+            run_part(pool, task.job, task.part);
+        } else {
+            run_whole(task.job);
+        }
+    }
+    return NULL;
+}
+
+// --- Planning ---
+
+static uint64_t estimate_bytes(const Config *config) {
+    uint64_t per_record = config->record_length;
+    if (config->file_type == FILE_TYPE_VARIABLE) {
+        // Midpoint of the length range; a rough guess for skewed distributions.
+        uint64_t min = config->min_record_length ? config->min_record_length : 1;
+        per_record = (min + per_record) / 2 + 4;
+    } else if (config->data_mode == DATA_MODE_TEXT && config->newline != NEWLINE_NONE) {
+        per_record += (config->newline == NEWLINE_CRLF) ? 2 : 1;
+    }
+    return per_record * (uint64_t)config->record_count;
+}
+
+static int load_job(BatchJob *job, const BatchOptions *options, uint64_t fallback_seed) {
+    Config *config = &job->config;
+    memset(config, 0, sizeof(Config));
+    config->newline = NEWLINE_LF;
+    config->rdw_endian = RDW_ENDIAN_BIG;
+
+    if (parse_definition(job->spec->def_file, config) != 0) {
+        fail_job(job, "definition error");
+        return 1;
+    }
+    job->parsed = 1;
+
+    // The pool provides the parallelism; a whole job runs on one thread.
+    config->threads = 1;
+    if (options->compression >= 0) {
+        config->compression = (CompressionType)options->compression;
+    }
+    if (options->seed_given) {
+        config->seed = options->seed;
+    } else if (!config->seed_set) {
+        config->seed = fallback_seed;
+    }
+    job->estimate = estimate_bytes(config);
+    return 0;
+}
+
+// Opens the output of a large job and splits it into tasks for the pool.
+static void plan_split(BatchJob *job, size_t workers) {
+    if (workers < 2 || job->estimate < SPLIT_MIN_BYTES) return;
+
+    job->file = fopen(job->spec->out_file, generate_output_mode(job->spec->out_file));
+    if (!job->file) return;  // Reported when the job runs
+
+    job->split = generate_split_open(&job->config, job->file, workers * SPLIT_PARTS_PER_WORKER);
+    if (job->split) {
+        job->parts_left = generate_split_parts(job->split);
+    } else {
+        // Runs as one task, which opens the file again when it starts.
+        fclose(job->file);
+        job->file = NULL;
+    }
+}
+
+static int by_estimate_desc(const void *a, const void *b) {
+    const BatchJob *x = *(BatchJob *const *)a;
+    const BatchJob *y = *(BatchJob *const *)b;
+    if (x->estimate != y->estimate) return (x->estimate < y->estimate) ? 1 : -1;
+    return (x < y) ? -1 : (x > y);
+}
+
+static void report(const BatchJob *jobs, size_t count, size_t workers, uint64_t elapsed_ns) {
+    size_t ok = 0;
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        const BatchJob *job = &jobs[i];
+        double secs = (job->end_ns > job->start_ns) ? (job->end_ns - job->start_ns) / 1e9 : 0.0;
+        if (job->failed) {
+            fprintf(stderr, "Job %zu: FAILED %s -> %s (%s)\n", i + 1,
+                    job->spec->def_file, job->spec->out_file, job->error);
+        } else {
+            ok++;
+            total += job->bytes;
+            fprintf(stderr, "Job %zu: ok     %s -> %s  %.1f MiB  %.3f s\n", i + 1,
+                    job->spec->def_file, job->spec->out_file, job->bytes / 1048576.0, secs);
+        }
+    }
+    double secs = elapsed_ns / 1e9;
+    fprintf(stderr, "Batch: %zu of %zu jobs succeeded, %.1f MiB in %.3f s (%.1f MB/s) on %zu workers\n",
+            ok, count, total / 1048576.0, secs, secs > 0 ? total / secs / 1e6 : 0.0, workers);
+}
+
+int batch_run(const BatchJobSpec *specs, size_t count, const BatchOptions *options) {
+    size_t workers = options->workers;
+    if (workers == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = (n > 0) ? (size_t)n : 1;
+    }
+
+    if (generate_init() != 0) {
+        return 1;
+    }
+
+    BatchJob *jobs = calloc(count, sizeof(BatchJob));
+    BatchJob **order = calloc(count, sizeof(BatchJob *));
+    if (!jobs || !order) {
+        perror("Error allocating batch jobs");
+        free(jobs);
+        free(order);
+        return 1;
+    }
+
+    uint64_t started = now_ns();
+    uint64_t fallback_seed = (uint64_t)time(NULL);
+    int used_fallback = 0;
+    size_t runnable = 0;
+    size_t tasks = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        BatchJob *job = &jobs[i];
+        job->spec = &specs[i];
+        if (load_job(job, options, fallback_seed) != 0) {
+            fprintf(stderr, "Job %zu: error parsing definition file '%s'.\n", i + 1, specs[i].def_file);
+            continue;
+        }
+        if (!options->seed_given && !job->config.seed_set) used_fallback = 1;
+        order[runnable++] = job;
+    }
+    if (used_fallback) {
+        fprintf(stderr, "Using random seed %llu\n", (unsigned long long)fallback_seed);
+    }
+
+    // Largest first, so the long jobs start early and the small ones fill the gaps.
+    qsort(order, runnable, sizeof(BatchJob *), by_estimate_desc);
+    for (size_t i = 0; i < runnable; i++) {
+        plan_split(order[i], workers);
+        tasks += order[i]->split ? order[i]->parts_left : 1;
+    }
+
+    Pool pool;
+    pool.workers = workers;
+    pool.deques = calloc(workers, sizeof(TaskDeque));
+    Worker *ws = calloc(workers, sizeof(Worker));
+    pthread_t *tids = calloc(workers, sizeof(pthread_t));
+    int rc = 0;
+    if (!pool.deques || !ws || !tids) {
+        perror("Error allocating batch jobs");
+        rc = 1;
+    }
+    for (size_t d = 0; pool.deques && d < workers; d++) {
+        pthread_mutex_init(&pool.deques[d].lock, NULL);
+    }
+
+    // Deal the tasks round robin, so the parts of a split job start on
+    // different workers and every deque holds a mix of sizes.
+    for (size_t d = 0; rc == 0 && d < workers; d++) {
+        pool.deques[d].tasks = malloc((tasks / workers + 1) * sizeof(Task));
+        if (!pool.deques[d].tasks) {
+            perror("Error allocating batch jobs");
+            rc = 1;
+        }
+    }
+    if (rc == 0) {
+        size_t next = 0;
+        for (size_t i = 0; i < runnable; i++) {
+            BatchJob *job = order[i];
+            size_t parts = job->split ? job->parts_left : 1;
+            for (size_t p = 0; p < parts; p++) {
+                TaskDeque *d = &pool.deques[next++ % workers];
+                d->tasks[d->tail].job = job;
+                d->tasks[d->tail].part = p;
+                d->tail++;
+            }
+        }
+
+        pthread_mutex_init(&pool.lock, NULL);
+        size_t running = 0;
+        for (; running < workers; running++) {
+            ws[running].pool = &pool;
+            ws[running].index = running;
+            if (pthread_create(&tids[running], NULL, pool_worker, &ws[running]) != 0) break;
+        }
+        if (running == 0) {
+            // No threads at all: work through the deques here.
+            Worker self = { &pool, 0 };
+            pool_worker(&self);
+        }
+        for (size_t t = 0; t < running; t++) {
+            pthread_join(tids[t], NULL);
+        }
+        pthread_mutex_destroy(&pool.lock);
+
+        report(jobs, count, workers, now_ns() - started);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (jobs[i].failed) rc = 1;
+        // Only left open if the pool never ran.
+        generate_split_close(jobs[i].split);
+        if (jobs[i].file) fclose(jobs[i].file);
+        if (jobs[i].parsed) free_config(&jobs[i].config);
+    }
+    for (size_t d = 0; pool.deques && d < workers; d++) {
+        free(pool.deques[d].tasks);
+        pthread_mutex_destroy(&pool.deques[d].lock);
+    }
+    free(pool.deques);
+    free(ws);
+    free(tids);
+    free(order);
+    free(jobs);
+    return rc;
+}
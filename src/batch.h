@@ -0,0 +1,39 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Batch mode: many definition files generated by one process.
+//
+// All definitions are parsed up front, then the jobs run on a pool of worker
+// threads, largest first. Every worker owns a deque of tasks and steals from
+// the others when its own runs dry. A large job that can be split (FIXED
+// records to a regular file) becomes several tasks, one per run of batches,
+// so it is spread over the pool; every other job is one task generated on a
+// single thread. A failed job is reported and does not stop the others.
+
+typedef struct {
+    const char *def_file;
+    const char *out_file;
+} BatchJobSpec;
+
+typedef struct {
+    size_t workers;          // Pool threads (0 = one per CPU)
+    int seed_given;          // Non-zero if -s was given
+    uint64_t seed;
+    int compression;         // CompressionType override, -1 = as defined
+} BatchOptions;
+
+// Reads a manifest with one "<definition_file> <output_file>" pair per line.
+// Blank lines and lines starting with '#' are skipped.
+// Returns 0 on success, non-zero on error.
+int batch_read_manifest(const char *path, BatchJobSpec **jobs, size_t *count);
+
+void batch_free_manifest(BatchJobSpec *jobs, size_t count);
+
+// Runs the jobs and prints a per-job report to stderr.
+// Returns 0 if every job succeeded, non-zero otherwise.
+int batch_run(const BatchJobSpec *jobs, size_t count, const BatchOptions *options);
+
+#endif // BATCH_H
@@ -0,0 +1,337 @@
+// Benchmark driver for mnfgendat (`make bench`).
+//
+// Runs the generator over a matrix of record formats, data modes, text types,
+// fill patterns, record lengths and output sizes. Every case is written once
+// to /dev/null, which measures the generation (CPU) cost, and once to a file
+// on tmpfs, which adds the cost of writing; the difference is reported as the
+// write share. Results are printed as a table and saved as JSON so runs of
+// different versions can be compared.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define MAX_SIZES 8
+#define BENCH_SEED "1"
+#define DEFAULT_TMPFS "/dev/shm"
+
+typedef struct {
+    const char *file_type;   // FIXED, VARIABLE
+    const char *data_mode;   // TEXT, BINARY
+    const char *text_type;   // ASCII, SJIS, ISO_2022 (TEXT + RANDOM only)
+    const char *fill;        // RANDOM, 0xHH, string
+} Mode;
+
+static const Mode MODES[] = {
+    { "FIXED", "TEXT", "ASCII", "RANDOM" },
+    { "FIXED", "TEXT", "SJIS", "RANDOM" },
+    { "FIXED", "TEXT", "ISO_2022", "RANDOM" },
+    { "FIXED", "BINARY", NULL, "RANDOM" },
+    { "FIXED", "BINARY", NULL, "0xFF" },
+    { "FIXED", "TEXT", NULL, "ABCDEFGHIJ" },
+    { "VARIABLE", "TEXT", "ASCII", "RANDOM" },
+    { "VARIABLE", "TEXT", "SJIS", "RANDOM" },
+    { "VARIABLE", "TEXT", "ISO_2022", "RANDOM" },
+    { "VARIABLE", "BINARY", NULL, "RANDOM" },
+    { "VARIABLE", "BINARY", NULL, "0xFF" },
+    { "VARIABLE", "TEXT", NULL, "ABCDEFGHIJ" },
+};
+
+static const size_t RECORD_LENGTHS[] = { 80, 1000, 32000 };
+
+typedef struct {
+    const char *binary;
+    const char *tmpfs;
+    const char *json_path;
+    int threads;
+    size_t sizes[MAX_SIZES];
+    size_t size_count;
+    int repeats;
+} Options;
+
+typedef struct {
+    int ok;
+    double seconds;     // Best of the repeats
+} Timing;
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-b <mnfgendat>] [-t <tmpfs dir>] [-o <results.json>] [-S <sizes>] [-r <repeats>] [-j <threads>]\n", prog);
+    fprintf(stderr, "  -b  Generator binary (default ./mnfgendat)\n");
+    fprintf(stderr, "  -t  Directory on tmpfs for the write variant (default %s, \"none\" to skip)\n", DEFAULT_TMPFS);
+    fprintf(stderr, "  -o  JSON results file (default bench_results.json, \"-\" for stdout)\n");
+    fprintf(stderr, "  -S  Comma-separated output sizes with K/M/G suffix (default 16M,128M)\n");
+    fprintf(stderr, "  -r  Runs per case; the fastest is reported (default 3)\n");
+    fprintf(stderr, "  -j  Generator threads (default 1)\n");
+}
+
+static int parse_size(const char *s, size_t *out) {
+    char *endp;
+    errno = 0;
+    unsigned long long n = strtoull(s, &endp, 10);
+    if (errno == ERANGE || endp == s) return -1;
+    if (*endp == 'K' || *endp == 'k') { n *= 1024ULL; endp++; }
+    else if (*endp == 'M' || *endp == 'm') { n *= 1024ULL * 1024; endp++; }
+    else if (*endp == 'G' || *endp == 'g') { n *= 1024ULL * 1024 * 1024; endp++; }
+    if ((*endp != '\0' && *endp != ',') || n == 0) return -1;
+    *out = (size_t)n;
+    return 0;
+}
+
+static int parse_sizes(const char *list, Options *opt) {
+    opt->size_count = 0;
+    for (const char *p = list; *p; ) {
+        if (opt->size_count == MAX_SIZES || parse_size(p, &opt->sizes[opt->size_count]) != 0) return -1;
+        opt->size_count++;
+        p = strchr(p, ',');
+        if (!p) break;
+        p++;
+    }
+    return opt->size_count > 0 ? 0 : -1;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Average bytes per record on disk.
+static double record_bytes(const Mode *mode, size_t length) {
+    if (strcmp(mode->file_type, "VARIABLE") == 0) {
+        return (double)(length + 1) / 2.0 + 4.0;   // Uniform 1..length plus the RDW
+    }
+    return strcmp(mode->data_mode, "TEXT") == 0 ? (double)length + 1.0 : (double)length;
+}
+
+static int write_definition(const char *path, const Mode *mode, size_t length, size_t records) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror("Error creating benchmark definition");
+        return 1;
+    }
+    fprintf(f, "FILE_TYPE=%s\n", mode->file_type);
+    fprintf(f, "DATA_MODE=%s\n", mode->data_mode);
+    fprintf(f, "RECORD_LENGTH=%zu\n", length);
+    fprintf(f, "RECORD_COUNT=%zu\n", records);
+    fprintf(f, "NEWLINE=%s\n", strcmp(mode->data_mode, "TEXT") == 0 ? "LF" : "NONE");
+    fprintf(f, "FILL_PATTERN=%s\n", mode->fill);
+    if (mode->text_type) fprintf(f, "TEXT_TYPE=%s\n", mode->text_type);
+    if (fclose(f) != 0) {
+        perror("Error writing benchmark definition");
+        return 1;
+    }
+    return 0;
+}
+
+// Writes `s` as a JSON string literal.
+static void write_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char ch = (unsigned char)*s;
+        if (ch == '"' || ch == '\\') fprintf(f, "\\%c", ch);
+        else if (ch < 0x20) fprintf(f, "\\u%04x", ch);
+        else fputc(ch, f);
+    }
+    fputc('"', f);
+}
+
+static int run_generator(const Options *opt, const char *def, const char *out, double *seconds) {
+    // Unwritten stdio buffers would otherwise be flushed twice by the child.
+    fflush(NULL);
+    double start = now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        // The generator's progress messages are not part of the measurement.
+        freopen("/dev/null", "w", stdout);
+        freopen("/dev/null", "w", stderr);
+        char threads[16];
+        snprintf(threads, sizeof(threads), "%d", opt->threads);
+        execl(opt->binary, opt->binary, "-d", def, "-o", out, "-s", BENCH_SEED, "-j", threads, (char *)NULL);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return 1;
+    }
+    *seconds = now() - start;
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : 1;
+}
+
+static Timing measure(const Options *opt, const char *def, const char *out) {
+    Timing t = { 0, 0.0 };
+    for (int r = 0; r < opt->repeats; r++) {
+        double s;
+        if (run_generator(opt, def, out, &s) != 0) {
+            t.ok = 0;
+            return t;
+        }
+        if (!t.ok || s < t.seconds) t.seconds = s;
+        t.ok = 1;
+    }
+    return t;
+}
+
+static void json_timing(FILE *json, const char *name, Timing t, double bytes, size_t records) {
+    if (!t.ok) {
+        fprintf(json, "\"%s\": null", name);
+        return;
+    }
+    fprintf(json, "\"%s\": {\"seconds\": %.6f, \"mb_per_s\": %.2f, \"records_per_s\": %.0f, \"ns_per_byte\": %.4f}",
+            name, t.seconds, bytes / t.seconds / 1e6, (double)records / t.seconds, t.seconds * 1e9 / bytes);
+}
+
+int main(int argc, char *argv[]) {
+    Options opt = { "./mnfgendat", DEFAULT_TMPFS, "bench_results.json", 1, { 0 }, 0, 3 };
+    parse_sizes("16M,128M", &opt);
+
+    int c;
+    while ((c = getopt(argc, argv, "b:t:o:S:r:j:h")) != -1) {
+        switch (c) {
+            case 'b': opt.binary = optarg; break;
+            case 't': opt.tmpfs = optarg; break;
+            case 'o': opt.json_path = optarg; break;
+            case 'j': {
+                char *endp;
+                long n = strtol(optarg, &endp, 10);
+                if (*optarg == '\0' || *endp != '\0' || n <= 0 || n > 4096) {
+                    fprintf(stderr, "Error: Invalid thread count '%s'.\n", optarg);
+                    return 1;
+                }
+                opt.threads = (int)n;
+                break;
+            }
+            case 'S':
+                if (parse_sizes(optarg, &opt) != 0) {
+                    fprintf(stderr, "Error: Invalid size list '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'r':
+                opt.repeats = atoi(optarg);
+                if (opt.repeats <= 0) {
+                    fprintf(stderr, "Error: Invalid repeat count '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if (access(opt.binary, X_OK) != 0) {
+        fprintf(stderr, "Error: generator '%s' is not executable.\n", opt.binary);
+        return 1;
+    }
+
+    // Definitions always go to a private temporary directory; the tmpfs output
+    // is optional.
+    char workdir[] = "/tmp/mnfgendat_bench.XXXXXX";
+    if (!mkdtemp(workdir)) {
+        perror("Error creating temporary directory");
+        return 1;
+    }
+    char def_path[sizeof(workdir) + 16];
+    snprintf(def_path, sizeof(def_path), "%s/bench.def", workdir);
+
+    char tmpfs_path[4096] = "";
+    struct stat st;
+    if (strcmp(opt.tmpfs, "none") != 0) {
+        if (stat(opt.tmpfs, &st) == 0 && S_ISDIR(st.st_mode)) {
+            snprintf(tmpfs_path, sizeof(tmpfs_path), "%s/mnfgendat_bench.%ld.out", opt.tmpfs, (long)getpid());
+        } else {
+            fprintf(stderr, "Warning: %s is not a directory, skipping the tmpfs variant.\n", opt.tmpfs);
+        }
+    }
+
+    FILE *json = (strcmp(opt.json_path, "-") == 0) ? stdout : fopen(opt.json_path, "w");
+    if (!json) {
+        perror("Error opening results file");
+        rmdir(workdir);
+        return 1;
+    }
+
+    fprintf(json, "{\n  \"binary\": ");
+    write_json_string(json, opt.binary);
+    fprintf(json, ",\n  \"threads\": %d,\n  \"repeats\": %d,\n  \"results\": [", opt.threads, opt.repeats);
+    fprintf(stderr, "%-8s %-6s %-8s %-10s %6s %9s %10s %10s %9s %10s\n",
+            "FORMAT", "MODE", "TEXT", "FILL", "LRECL", "SIZE", "MB/s", "rec/s", "fill ns/B", "write ns/B");
+
+    int failures = 0;
+    int first = 1;
+    for (size_t s = 0; s < opt.size_count; s++) {
+        for (size_t l = 0; l < sizeof(RECORD_LENGTHS) / sizeof(RECORD_LENGTHS[0]); l++) {
+            for (size_t m = 0; m < sizeof(MODES) / sizeof(MODES[0]); m++) {
+                const Mode *mode = &MODES[m];
+                size_t length = RECORD_LENGTHS[l];
+                size_t records = (size_t)((double)opt.sizes[s] / record_bytes(mode, length));
+                if (records == 0) records = 1;
+                if (write_definition(def_path, mode, length, records) != 0) {
+                    failures++;
+                    goto done;
+                }
+
+                Timing devnull = measure(&opt, def_path, "/dev/null");
+                Timing tmpfs = { 0, 0.0 };
+                double bytes = (double)records * record_bytes(mode, length);
+                if (tmpfs_path[0]) {
+                    tmpfs = measure(&opt, def_path, tmpfs_path);
+                    // The written file gives the exact size for VARIABLE records.
+                    if (tmpfs.ok && stat(tmpfs_path, &st) == 0) bytes = (double)st.st_size;
+                    unlink(tmpfs_path);
+                }
+                if (!devnull.ok || (tmpfs_path[0] && !tmpfs.ok)) failures++;
+
+                double fill_ns = devnull.ok ? devnull.seconds * 1e9 / bytes : 0.0;
+                double write_ns = (devnull.ok && tmpfs.ok) ? (tmpfs.seconds - devnull.seconds) * 1e9 / bytes : 0.0;
+                if (write_ns < 0) write_ns = 0;
+
+                fprintf(json, "%s\n    {\"file_type\": \"%s\", \"data_mode\": \"%s\", \"text_type\": %s%s%s, "
+                        "\"fill\": \"%s\", \"record_length\": %zu, \"records\": %zu, \"bytes\": %.0f,\n      ",
+                        first ? "" : ",", mode->file_type, mode->data_mode,
+                        mode->text_type ? "\"" : "", mode->text_type ? mode->text_type : "null", mode->text_type ? "\"" : "",
+                        mode->fill, length, records, bytes);
+                json_timing(json, "devnull", devnull, bytes, records);
+                fprintf(json, ",\n      ");
+                json_timing(json, "tmpfs", tmpfs, bytes, records);
+                fprintf(json, ",\n      \"fill_ns_per_byte\": ");
+                if (devnull.ok) fprintf(json, "%.4f", fill_ns); else fprintf(json, "null");
+                fprintf(json, ", \"write_ns_per_byte\": ");
+                if (devnull.ok && tmpfs.ok) fprintf(json, "%.4f}", write_ns); else fprintf(json, "null}");
+                first = 0;
+
+                char write_col[32] = "-";
+                if (devnull.ok && tmpfs.ok) snprintf(write_col, sizeof(write_col), "%.3f", write_ns);
+                fprintf(stderr, "%-8s %-6s %-8s %-10s %6zu %8.0fM %10.1f %10.0f %9.3f %10s\n",
+                        mode->file_type, mode->data_mode, mode->text_type ? mode->text_type : "-", mode->fill,
+                        length, bytes / (1024.0 * 1024.0),
+                        devnull.ok ? bytes / devnull.seconds / 1e6 : 0.0,
+                        devnull.ok ? (double)records / devnull.seconds : 0.0,
+                        fill_ns, write_col);
+            }
+        }
+    }
+
+done:
+    fprintf(json, "\n  ],\n  \"failures\": %d\n}\n", failures);
+    if (json != stdout) fclose(json);
+    unlink(def_path);
+    rmdir(workdir);
+
+    if (failures) {
+        fprintf(stderr, "%d benchmark case(s) failed.\n", failures);
+        return 1;
+    }
+    if (json != stdout) fprintf(stderr, "Results written to %s\n", opt.json_path);
+    return 0;
+}
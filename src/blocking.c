@@ -0,0 +1,98 @@
+#include "blocking.h"
+#include <string.h>
+
+#define DESCRIPTOR_LEN 4
+
+static void put16(unsigned char *p, size_t value, RdwEndian endian) {
+    if (endian == RDW_ENDIAN_BIG) {
+        p[0] = (unsigned char)(value >> 8);
+        p[1] = (unsigned char)value;
+    } else {
+        p[0] = (unsigned char)value;
+        p[1] = (unsigned char)(value >> 8);
+    }
+}
+
+static void put_bdw(unsigned char *p, size_t block_len, int extended, RdwEndian endian) {
+    if (extended) {
+        // Large block interface: bit 0 set, bits 1-31 hold the length.
+        uint32_t v = 0x80000000u | (uint32_t)block_len;
+        for (int i = 0; i < 4; i++) {
+            int shift = (endian == RDW_ENDIAN_BIG) ? 24 - 8 * i : 8 * i;
+            p[i] = (unsigned char)(v >> shift);
+        }
+    } else {
+        put16(p, block_len, endian);
+        p[2] = 0;
+        p[3] = 0;
+    }
+}
+
+static unsigned char *open_block(Blocker *b) {
+    b->block = output_reserve(b->out, b->block_size);
+    b->used = DESCRIPTOR_LEN;
+    return b->block;
+}
+
+static int close_block(Blocker *b) {
+    if (!b->block) return 0;
+    put_bdw(b->block, b->used, b->block_size > BDW_MAX_STANDARD, b->endian);
+    b->block = NULL;
+    b->blocks++;
+    return output_commit(b->out, b->used);
+}
+
+void blocker_init(Blocker *blocker, OutputWriter *out, const Config *config) {
+    memset(blocker, 0, sizeof(*blocker));
+    blocker->out = out;
+    blocker->block_size = config->block_size;
+    blocker->spanned = config->spanned;
+    blocker->endian = config->rdw_endian;
+}
+
+int blocker_add(Blocker *b, const unsigned char *data, size_t len) {
+    if (!b->spanned) {
+        // The parser guarantees that a record always fits an empty block.
+        size_t need = DESCRIPTOR_LEN + len;
+        if (b->block && b->used + need > b->block_size) {
+            if (close_block(b) != 0) return 1;
+        }
+        if (!b->block) open_block(b);
+        unsigned char *rdw = b->block + b->used;
+        put16(rdw, need, b->endian);
+        rdw[2] = 0;
+        rdw[3] = 0;
+        memcpy(rdw + DESCRIPTOR_LEN, data, len);
+        b->used += need;
+        return 0;
+    }
+
+    int first = 1;
+    while (len > 0) {
+        // A segment needs its SDW plus at least one data byte.
+        if (b->block && b->block_size - b->used < DESCRIPTOR_LEN + 1) {
+            if (close_block(b) != 0) return 1;
+        }
+        if (!b->block) open_block(b);
+
+        size_t room = b->block_size - b->used - DESCRIPTOR_LEN;
+        size_t seg = (len < room) ? len : room;
+        int last = (seg == len);
+
+        unsigned char *sdw = b->block + b->used;
+        put16(sdw, DESCRIPTOR_LEN + seg, b->endian);
+        sdw[2] = first ? (last ? SEGMENT_COMPLETE : SEGMENT_FIRST) : (last ? SEGMENT_LAST : SEGMENT_MIDDLE);
+        sdw[3] = 0;
+        memcpy(sdw + DESCRIPTOR_LEN, data, seg);
+        b->used += DESCRIPTOR_LEN + seg;
+
+        data += seg;
+        len -= seg;
+        first = 0;
+    }
+    return 0;
+}
+
+int blocker_finish(Blocker *blocker) {
+    return close_block(blocker);
+}
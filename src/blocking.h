@@ -0,0 +1,52 @@
+#ifndef BLOCKING_H
+#define BLOCKING_H
+
+#include <stddef.h>
+#include "config.h"
+#include "output.h"
+
+// Blocked variable-length records (RECFM=VB and VBS).
+//
+// Records are packed into blocks of at most BLOCK_SIZE bytes, each starting
+// with a 4-byte Block Descriptor Word (BDW: LL LL 00 00, the block length
+// including the BDW). Blocks over 32760 bytes use the extended BDW of the
+// large block interface: a 31-bit length with the top bit set.
+//
+// VB records keep their RDW and never cross a block. VBS records (blocks of
+// at most 32760 bytes) are split into segments that fill every block; each
+// segment starts with a Segment Descriptor Word (LL LL CC 00) whose control
+// byte CC marks it as complete (0), first (1), last (2) or middle (3).
+//
+// Every block is assembled in place in the output writer and committed in
+// one piece.
+
+#define BDW_MAX_STANDARD 32760
+#define RDW_MAX_LENGTH 65535    // RDW length field, descriptor included
+
+// Segment control codes of a VBS Segment Descriptor Word.
+#define SEGMENT_COMPLETE 0x00
+#define SEGMENT_FIRST 0x01
+#define SEGMENT_LAST 0x02
+#define SEGMENT_MIDDLE 0x03
+
+typedef struct {
+    OutputWriter *out;
+    size_t block_size;
+    int spanned;
+    RdwEndian endian;
+    unsigned char *block;       // Reserved space of the open block (NULL if none)
+    size_t used;                // Bytes in the open block, BDW included
+    size_t blocks;              // Blocks written so far
+} Blocker;
+
+// The writer must allow reserving config->block_size bytes.
+void blocker_init(Blocker *blocker, OutputWriter *out, const Config *config);
+
+// Appends one logical record of `len` data bytes.
+// Returns 0 on success, non-zero if the output failed.
+int blocker_add(Blocker *blocker, const unsigned char *data, size_t len);
+
+// Writes the last, partially filled block.
+int blocker_finish(Blocker *blocker);
+
+#endif // BLOCKING_H
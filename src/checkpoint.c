@@ -0,0 +1,121 @@
+#include "checkpoint.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define CHECKPOINT_HEADER "# mnfgendat checkpoint"
+#define CHECKPOINT_FIELDS 6
+
+int checkpoint_hash_file(const char *path, uint64_t *hash) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror("Error opening definition file");
+        return 1;
+    }
+    uint64_t h = 0xCBF29CE484222325ULL;
+    unsigned char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            h = (h ^ buf[i]) * 0x100000001B3ULL;
+        }
+    }
+    int rc = ferror(file) ? 1 : 0;
+    if (rc) perror("Error reading definition file");
+    fclose(file);
+    *hash = h;
+    return rc;
+}
+
+int checkpoint_write(const char *path, const Checkpoint *cp) {
+    char *tmp = malloc(strlen(path) + 8);
+    if (!tmp) {
+        perror("Error writing checkpoint");
+        return 1;
+    }
+    strcpy(tmp, path);
+    strcat(tmp, ".XXXXXX");
+    int fd = mkstemp(tmp);
+    FILE *file = (fd >= 0) ? fdopen(fd, "w") : NULL;
+    if (!file) {
+        perror("Error writing checkpoint");
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        free(tmp);
+        return 1;
+    }
+
+    fprintf(file, "%s\n", CHECKPOINT_HEADER);
+    fprintf(file, "SEED=%llu\n", (unsigned long long)cp->seed);
+    fprintf(file, "DEFINITION=0x%016llX\n", (unsigned long long)cp->definition);
+    fprintf(file, "FIRST_RECORD=%zu\n", cp->first_record);
+    fprintf(file, "RECORD_COUNT=%zu\n", cp->record_count);
+    fprintf(file, "RECORDS_DONE=%zu\n", cp->records_done);
+    fprintf(file, "OUTPUT_BYTES=%llu\n", (unsigned long long)cp->output_bytes);
+
+    int err = (fflush(file) != 0 || fsync(fd) != 0);
+    if (fclose(file) != 0) err = 1;
+    if (!err && rename(tmp, path) != 0) err = 1;
+    if (err) {
+        perror("Error writing checkpoint");
+        unlink(tmp);
+    }
+    free(tmp);
+    return err;
+}
+
+int checkpoint_read(const char *path, Checkpoint *cp) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror("Error opening checkpoint");
+        return 1;
+    }
+    memset(cp, 0, sizeof(*cp));
+
+    char line[256];
+    int line_num = 0;
+    unsigned seen = 0;
+    int rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), file)) {
+        line_num++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+
+        char *value = strchr(line, '=');
+        char *endp;
+        if (!value) {
+            rc = 1;
+            break;
+        }
+        *value++ = '\0';
+        errno = 0;
+        unsigned long long n = strtoull(value, &endp, 0);
+        if (*value == '\0' || *value == '-' || *endp != '\0' || errno == ERANGE) {
+            rc = 1;
+            break;
+        }
+
+        if (strcmp(line, "SEED") == 0) { cp->seed = n; seen |= 1; }
+        else if (strcmp(line, "DEFINITION") == 0) { cp->definition = n; seen |= 2; }
+        else if (strcmp(line, "FIRST_RECORD") == 0) { cp->first_record = (size_t)n; seen |= 4; }
+        else if (strcmp(line, "RECORD_COUNT") == 0) { cp->record_count = (size_t)n; seen |= 8; }
+        else if (strcmp(line, "RECORDS_DONE") == 0) { cp->records_done = (size_t)n; seen |= 16; }
+        else if (strcmp(line, "OUTPUT_BYTES") == 0) { cp->output_bytes = n; seen |= 32; }
+        else rc = 1;
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Invalid checkpoint %s at line %d\n", path, line_num);
+    } else if (ferror(file)) {
+        perror("Error reading checkpoint");
+        rc = 1;
+    } else if (seen != (1u << CHECKPOINT_FIELDS) - 1 || cp->records_done > cp->record_count) {
+        fprintf(stderr, "Checkpoint %s is incomplete\n", path);
+        rc = 1;
+    }
+    fclose(file);
+    return rc;
+}
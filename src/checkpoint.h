@@ -0,0 +1,39 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Checkpoints of long runs (--checkpoint, --resume).
+//
+// Every record is a pure function of the seed and its index in the file, so
+// a run is fully described by the seed, the slice of the file it generates
+// and how far it got: no generator state has to be saved. The checkpoint is
+// a small text file next to the output (OUTPUT.ckpt). It is written to a
+// temporary file and renamed over the old one only after the data it counts
+// has been synced, so after a crash it never claims more than the file
+// holds. The definition is identified by a hash of its text, so a resume
+// with a changed definition is refused instead of producing a mixed file.
+
+#define CHECKPOINT_SUFFIX ".ckpt"
+#define CHECKPOINT_DEFAULT_BYTES ((size_t)4 << 30)
+
+typedef struct {
+    uint64_t seed;
+    uint64_t definition;        // checkpoint_hash_file() of the definition
+    size_t first_record;        // Slice being generated (--range, --shard)
+    size_t record_count;
+    size_t records_done;        // Records of the slice in the output
+    uint64_t output_bytes;      // Size of the output they fill
+} Checkpoint;
+
+// FNV-1a hash of the contents of a file. Returns 0 on success, non-zero on error.
+int checkpoint_hash_file(const char *path, uint64_t *hash);
+
+// Replaces the checkpoint at `path`. Returns 0 on success, non-zero on error.
+int checkpoint_write(const char *path, const Checkpoint *checkpoint);
+
+// Reads the checkpoint at `path`. Returns 0 on success, non-zero on error.
+int checkpoint_read(const char *path, Checkpoint *checkpoint);
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,217 @@
+#include "codepage.h"
+#include "randfill.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CODEPAGE_X86 1
+#include <immintrin.h>
+#endif
+
+#define EBCDIC_SUB 0x3F
+// Random text is generated and translated in chunks that stay in L1.
+#define TEXT_CHUNK 4096
+
+// US-ASCII to CP037 (EBCDIC US/Canada).
+static const unsigned char ASCII_TO_CP037[128] = {
+    0x00, 0x01, 0x02, 0x03, 0x37, 0x2D, 0x2E, 0x2F, 0x16, 0x05, 0x25, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+    0x10, 0x11, 0x12, 0x13, 0x3C, 0x3D, 0x32, 0x26, 0x18, 0x19, 0x3F, 0x27, 0x1C, 0x1D, 0x1E, 0x1F,
+    0x40, 0x5A, 0x7F, 0x7B, 0x5B, 0x6C, 0x50, 0x7D, 0x4D, 0x5D, 0x5C, 0x4E, 0x6B, 0x60, 0x4B, 0x61,
+    0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0x7A, 0x5E, 0x4C, 0x7E, 0x6E, 0x6F,
+    0x7C, 0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xD1, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6,
+    0xD7, 0xD8, 0xD9, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xBA, 0xE0, 0xBB, 0xB0, 0x6D,
+    0x79, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96,
+    0x97, 0x98, 0x99, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xC0, 0x4F, 0xD0, 0xA1, 0x07,
+};
+
+// Characters that sit at the same code point in every EBCDIC codepage
+// (IBM syntactic character set), apart from letters and digits.
+static const char INVARIANT_PUNCT[] = " +<=>%&*\"'(),_-./:;?";
+
+// Indexed by OutputCodepage.
+static Codepage codepages[] = {
+    { .name = "ASCII" },
+    { .name = "CP037", .ebcdic = 1 },
+    { .name = "CP1047", .ebcdic = 1 },
+    { .name = "CP930", .ebcdic = 1, .dbcs = 1 },
+    { .name = "CP939", .ebcdic = 1, .dbcs = 1 },
+};
+
+typedef void (*LookupFn)(const Codepage *cp, unsigned char *buf, size_t len);
+
+// Replaces every index by the printable character it stands for.
+static void lookup_scalar(const Codepage *cp, unsigned char *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = cp->text[buf[i]];
+    }
+}
+
+#ifdef CODEPAGE_X86
+
+// The alphabet is split into rows of 16 entries, each one a byte shuffle
+// keyed by the low nibble. Indices are below 128, so after subtracting 16 per
+// row the rows past an index shuffle to zero (sign bit set) and the rows up to
+// it yield their entry; the rows are stored XORed with their predecessor so
+// the XOR of all shuffles telescopes to the wanted entry.
+
+__attribute__((target("ssse3")))
+static void lookup_ssse3(const Codepage *cp, unsigned char *buf, size_t len) {
+    const __m128i step = _mm_set1_epi8(16);
+    __m128i table[TEXT_ROWS];
+    for (unsigned r = 0; r < cp->text_rows; r++) {
+        table[r] = _mm_loadu_si128((const __m128i *)(cp->text_delta + 16 * r));
+    }
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i idx = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i out = _mm_shuffle_epi8(table[0], idx);
+        for (unsigned r = 1; r < cp->text_rows; r++) {
+            idx = _mm_sub_epi8(idx, step);
+            out = _mm_xor_si128(out, _mm_shuffle_epi8(table[r], idx));
+        }
+        _mm_storeu_si128((__m128i *)(buf + i), out);
+    }
+    lookup_scalar(cp, buf + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void lookup_avx2(const Codepage *cp, unsigned char *buf, size_t len) {
+    const __m256i step = _mm256_set1_epi8(16);
+    __m256i table[TEXT_ROWS];
+    for (unsigned r = 0; r < cp->text_rows; r++) {
+        table[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(cp->text_delta + 16 * r)));
+    }
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i idx = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i out = _mm256_shuffle_epi8(table[0], idx);
+        for (unsigned r = 1; r < cp->text_rows; r++) {
+            idx = _mm256_sub_epi8(idx, step);
+            out = _mm256_xor_si256(out, _mm256_shuffle_epi8(table[r], idx));
+        }
+        _mm256_storeu_si256((__m256i *)(buf + i), out);
+    }
+    lookup_scalar(cp, buf + i, len - i);
+}
+
+#endif // CODEPAGE_X86
+
+static LookupFn lookup = lookup_scalar;
+static pthread_once_t codepages_once = PTHREAD_ONCE_INIT;
+
+static void build_ebcdic(Codepage *cp, const char *latin) {
+    memset(cp->map, EBCDIC_SUB, sizeof(cp->map));
+    // Controls are the same everywhere; printable characters only where the
+    // codepage is known to have them.
+    for (int c = 0; c < 0x20; c++) cp->map[c] = ASCII_TO_CP037[c];
+    cp->map[0x7F] = ASCII_TO_CP037[0x7F];
+    for (int c = '0'; c <= '9'; c++) cp->map[c] = ASCII_TO_CP037[c];
+    for (int c = 'A'; c <= 'Z'; c++) cp->map[c] = ASCII_TO_CP037[c];
+    for (const char *p = INVARIANT_PUNCT; *p; p++) cp->map[(unsigned char)*p] = ASCII_TO_CP037[(unsigned char)*p];
+    for (const char *p = latin; *p; p++) cp->map[(unsigned char)*p] = ASCII_TO_CP037[(unsigned char)*p];
+    cp->space = 0x40;
+    cp->digit_zero = 0xF0;
+    for (int d = 0; d < 10; d++) {
+        cp->overpunch_positive[d] = (unsigned char)(0xC0 + d);
+        cp->overpunch_negative[d] = (unsigned char)(0xD0 + d);
+    }
+}
+
+static void build_codepages(void) {
+    static const char LOWER[] = "abcdefghijklmnopqrstuvwxyz";
+    static const char VARIANT[] = "!#$@[\\]^`{|}~";
+    static const char OVERPUNCH_POSITIVE[] = "{ABCDEFGHI";
+    static const char OVERPUNCH_NEGATIVE[] = "}JKLMNOPQR";
+
+    Codepage *ascii = &codepages[CODEPAGE_ASCII];
+    for (int c = 0; c < 256; c++) ascii->map[c] = (unsigned char)c;
+    ascii->space = ' ';
+    ascii->digit_zero = '0';
+    memcpy(ascii->overpunch_positive, OVERPUNCH_POSITIVE, 10);
+    memcpy(ascii->overpunch_negative, OVERPUNCH_NEGATIVE, 10);
+
+    // CP037 and CP1047 cover all of ASCII; they differ in [ ] ^ and LF.
+    char all_latin[sizeof(LOWER) + sizeof(VARIANT)];
+    strcpy(all_latin, LOWER);
+    strcat(all_latin, VARIANT);
+    build_ebcdic(&codepages[CODEPAGE_CP037], all_latin);
+    build_ebcdic(&codepages[CODEPAGE_CP1047], all_latin);
+    codepages[CODEPAGE_CP1047].map['['] = 0xAD;
+    codepages[CODEPAGE_CP1047].map[']'] = 0xBD;
+    codepages[CODEPAGE_CP1047].map['^'] = 0x5F;
+    codepages[CODEPAGE_CP1047].map['\n'] = 0x15;
+
+    // The single-byte halves (CCSID 290 / 1027) move the variant characters,
+    // and CCSID 290 has Katakana where CP037 has lowercase letters. Only the
+    // characters common to all of them are mapped.
+    build_ebcdic(&codepages[CODEPAGE_CP930], "");
+    build_ebcdic(&codepages[CODEPAGE_CP939], LOWER);
+
+    for (size_t i = 0; i < sizeof(codepages) / sizeof(codepages[0]); i++) {
+        Codepage *cp = &codepages[i];
+        cp->text_count = 0;
+        for (int c = 0x20; c <= 0x7E; c++) {
+            if (cp->ebcdic && cp->map[c] == EBCDIC_SUB) continue;
+            cp->text[cp->text_count++] = cp->map[c];
+        }
+        cp->text_rows = (cp->text_count + 15) / 16;
+        for (unsigned k = 0; k < cp->text_rows * 16; k++) {
+            cp->text_delta[k] = (k < 16) ? cp->text[k] : (unsigned char)(cp->text[k] ^ cp->text[k - 16]);
+        }
+    }
+
+#ifdef CODEPAGE_X86
+    const char *force = getenv("MNFGENDAT_SIMD");
+    __builtin_cpu_init();
+    if (force && strcmp(force, "portable") == 0) return;
+    if (__builtin_cpu_supports("avx2") && !(force && strcmp(force, "sse2") == 0)) {
+        lookup = lookup_avx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        lookup = lookup_ssse3;
+    }
+#endif
+}
+
+void codepage_init(void) {
+    pthread_once(&codepages_once, build_codepages);
+}
+
+const Codepage *codepage_get(OutputCodepage id) {
+    return &codepages[id];
+}
+
+int codepage_parse(const char *name, OutputCodepage *id) {
+    for (size_t i = 0; i < sizeof(codepages) / sizeof(codepages[0]); i++) {
+        if (strcmp(name, codepages[i].name) == 0) {
+            *id = (OutputCodepage)i;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void codepage_translate(const Codepage *cp, unsigned char *buf, size_t len) {
+    if (!cp->ebcdic) return;
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = cp->map[buf[i]];
+    }
+}
+
+void codepage_text_from_index(const Codepage *cp, unsigned char *buf, size_t len) {
+    lookup(cp, buf, len);
+}
+
+void codepage_fill_text(const Codepage *cp, Prng *rng, unsigned char *dst, size_t len) {
+    if (!cp->ebcdic) {
+        randfill_ascii(rng, dst, len);
+        return;
+    }
+    while (len > 0) {
+        size_t n = len < TEXT_CHUNK ? len : TEXT_CHUNK;
+        randfill_range(rng, dst, n, 0, cp->text_count);
+        codepage_text_from_index(cp, dst, n);
+        dst += n;
+        len -= n;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef CODEPAGE_H
+#define CODEPAGE_H
+
+#include <stddef.h>
+#include "config.h"
+#include "prng.h"
+
+// Output codepages.
+//
+// Text is produced directly in the output codepage: random characters are
+// drawn as indices into the codepage's printable alphabet and looked up
+// right after they are generated, while the bytes are still in cache, so
+// EBCDIC output needs no separate conversion pass. The lookup runs 16 or 32
+// bytes at a time with byte shuffles (SSSE3/AVX2). Other text (string
+// patterns, newlines) goes through the 256-entry map once up front.
+//
+// ASCII characters without a mapping in the target codepage become SUB
+// (0x3F in EBCDIC). CP930 and CP939 add IBM host double-byte characters,
+// framed by SO/SI.
+
+// Printable characters of a codepage fit in the first 128 entries.
+#define TEXT_ROWS 8
+
+typedef struct {
+    const char *name;
+    int ebcdic;
+    int dbcs;                        // Has a double-byte part (CP930, CP939)
+    unsigned char map[256];          // ASCII byte -> codepage byte
+    unsigned char text[256];         // Printable characters, in ASCII order
+    unsigned text_count;
+    unsigned text_rows;              // 16-entry rows of text used by the lookup
+    unsigned char text_delta[TEXT_ROWS * 16];  // Row r of text XOR row r - 1
+    unsigned char space;
+    unsigned char digit_zero;
+    unsigned char overpunch_positive[10];  // Signed zoned decimal last digit, + sign
+    unsigned char overpunch_negative[10];  // Signed zoned decimal last digit, - sign
+} Codepage;
+
+// Builds the tables and picks the lookup kernel. Must be called before the
+// first use; later calls are no-ops. Thread-safe.
+void codepage_init(void);
+
+const Codepage *codepage_get(OutputCodepage id);
+
+// Parses a codepage name ("ASCII", "CP037", ...). Returns 0 on success.
+int codepage_parse(const char *name, OutputCodepage *id);
+
+// Translates ASCII bytes to the codepage in place.
+void codepage_translate(const Codepage *cp, unsigned char *buf, size_t len);
+
+// Replaces alphabet indices (< cp->text_count) with the printable characters.
+void codepage_text_from_index(const Codepage *cp, unsigned char *buf, size_t len);
+
+// Fills dst with random printable characters of the codepage.
+void codepage_fill_text(const Codepage *cp, Prng *rng, unsigned char *dst, size_t len);
+
+#endif // CODEPAGE_H
@@ -0,0 +1,121 @@
+#include "compress.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+struct Compressor {
+    CompressionType type;
+    int level;
+#ifdef HAVE_ZLIB
+    z_stream zs;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx *zctx;
+#endif
+};
+
+int compress_available(CompressionType type) {
+    switch (type) {
+        case COMPRESS_NONE: return 1;
+#ifdef HAVE_ZLIB
+        case COMPRESS_GZIP: return 1;
+#endif
+#ifdef HAVE_ZSTD
+        case COMPRESS_ZSTD: return 1;
+#endif
+        default: return 0;
+    }
+}
+
+const char *compress_name(CompressionType type) {
+    switch (type) {
+        case COMPRESS_GZIP: return "gzip";
+        case COMPRESS_ZSTD: return "zstd";
+        default: return "none";
+    }
+}
+
+Compressor *compressor_create(CompressionType type, int level) {
+    if (type == COMPRESS_NONE || !compress_available(type)) return NULL;
+
+    Compressor *c = calloc(1, sizeof(Compressor));
+    if (!c) return NULL;
+    c->type = type;
+    c->level = level;
+
+#ifdef HAVE_ZLIB
+    if (type == COMPRESS_GZIP) {
+        // windowBits 15 + 16 selects the gzip wrapper.
+        if (deflateInit2(&c->zs, level > 0 ? level : Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            free(c);
+            return NULL;
+        }
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (type == COMPRESS_ZSTD) {
+        c->zctx = ZSTD_createCCtx();
+        if (!c->zctx) {
+            free(c);
+            return NULL;
+        }
+    }
+#endif
+    return c;
+}
+
+size_t compressor_bound(const Compressor *c, size_t len) {
+#ifdef HAVE_ZLIB
+    if (c->type == COMPRESS_GZIP) {
+        // deflateBound() covers the zlib wrapper; the gzip header and trailer are larger.
+        return deflateBound((z_streamp)&c->zs, (uLong)len) + 32;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (c->type == COMPRESS_ZSTD) {
+        return ZSTD_compressBound(len);
+    }
+#endif
+    (void)c;
+    return len;
+}
+
+size_t compressor_run(Compressor *c, const unsigned char *src, size_t len, unsigned char *dst, size_t cap) {
+#ifdef HAVE_ZLIB
+    if (c->type == COMPRESS_GZIP) {
+        if (deflateReset(&c->zs) != Z_OK) return 0;
+        c->zs.next_in = (Bytef *)src;
+        c->zs.avail_in = (uInt)len;
+        c->zs.next_out = dst;
+        c->zs.avail_out = (uInt)cap;
+        if (deflate(&c->zs, Z_FINISH) != Z_STREAM_END) return 0;
+        return cap - c->zs.avail_out;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (c->type == COMPRESS_ZSTD) {
+        size_t n = ZSTD_compressCCtx(c->zctx, dst, cap, src, len, c->level > 0 ? c->level : ZSTD_CLEVEL_DEFAULT);
+        return ZSTD_isError(n) ? 0 : n;
+    }
+#endif
+    (void)c; (void)src; (void)len; (void)dst; (void)cap;
+    return 0;
+}
+
+void compressor_free(Compressor *c) {
+    if (!c) return;
+#ifdef HAVE_ZLIB
+    if (c->type == COMPRESS_GZIP) deflateEnd(&c->zs);
+#endif
+#ifdef HAVE_ZSTD
+    if (c->type == COMPRESS_ZSTD) ZSTD_freeCCtx(c->zctx);
+#endif
+    free(c);
+}
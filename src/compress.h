@@ -0,0 +1,33 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include "config.h"
+
+// Independent block compression. Every block becomes one complete gzip
+// member or zstd frame, so blocks can be compressed on different threads and
+// simply concatenated: the result is a standard multi-member gzip file or
+// multi-frame zstd file.
+
+typedef struct Compressor Compressor;
+
+// Returns non-zero if support for `type` was compiled in.
+int compress_available(CompressionType type);
+
+// Lower-case codec name ("none", "gzip", "zstd").
+const char *compress_name(CompressionType type);
+
+// Creates a per-thread compressor. `level` 0 selects the codec default.
+// Returns NULL on error.
+Compressor *compressor_create(CompressionType type, int level);
+
+// Largest possible compressed size of a `len` byte block.
+size_t compressor_bound(const Compressor *c, size_t len);
+
+// Compresses src into dst (of at least compressor_bound() bytes).
+// Returns the compressed size, or 0 on error.
+size_t compressor_run(Compressor *c, const unsigned char *src, size_t len, unsigned char *dst, size_t cap);
+
+void compressor_free(Compressor *c);
+
+#endif // COMPRESS_H
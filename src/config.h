@@ -2,6 +2,7 @@
 #define CONFIG_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum {
     FILE_TYPE_FIXED,
@@ -37,24 +38,176 @@ typedef enum {
     TEXT_TYPE_ISO_2022
 } TextType;
 
+// How random records are produced.
+typedef enum {
+    RANDOM_QUALITY_FULL,     // Every byte drawn from the generator
+    RANDOM_QUALITY_FAST      // Stitched from a pool of random blocks (entropy.h)
+} RandomQuality;
+
+typedef enum {
+    CODEPAGE_ASCII,
+    CODEPAGE_CP037,      // EBCDIC US/Canada
+    CODEPAGE_CP1047,     // EBCDIC Latin-1 (z/OS UNIX)
+    CODEPAGE_CP930,      // EBCDIC Japanese Katakana + DBCS
+    CODEPAGE_CP939       // EBCDIC Japanese Latin + DBCS
+} OutputCodepage;
+
+// Record length distributions of VARIABLE files.
+typedef enum {
+    LENGTH_UNIFORM,
+    LENGTH_NORMAL,       // NORMAL:<mean>:<stddev>
+    LENGTH_LOGNORMAL,    // LOGNORMAL:<median>:<sigma of ln(length)>
+    LENGTH_ZIPF,         // ZIPF:<exponent>: the shortest lengths are the most frequent
+    LENGTH_EMPIRICAL     // EMPIRICAL:<file>: lengths found in the RDWs of a sample file
+} LengthDistribution;
+
+typedef enum {
+    COMPRESS_NONE,
+    COMPRESS_GZIP,
+    COMPRESS_ZSTD
+} CompressionType;
+
+// Field types of a FIELD= record layout (COBOL picture clauses).
+typedef enum {
+    FIELD_TEXT,          // X      PIC X: printable single-byte text
+    FIELD_ZONED,         // 9      PIC 9: unsigned zoned decimal
+    FIELD_ZONED_SIGNED,  // S9     PIC S9: zoned decimal, sign overpunched on the last digit
+    FIELD_PACKED,        // P      COMP-3: packed decimal with C/D sign nibble
+    FIELD_BINARY,        // B      COMP: big-endian binary integer
+    FIELD_DBCS,          // N      PIC N: double-byte characters (Shift-JIS or host DBCS)
+    FIELD_MIXED,         // M      Mixed SBCS/DBCS text framed by START_CODE/END_CODE
+    FIELD_FILLER,        // F      FILLER: filled according to FILL_PATTERN
+    FIELD_DICTIONARY     // DICT:<name>  Random entries of a DICTIONARY, padded with spaces
+} FieldType;
+
+// What a field holds (the optional fourth part of a FIELD= line).
+typedef enum {
+    FIELD_CONTENT_RANDOM,  //                Generated according to the type
+    FIELD_CONTENT_VALUE,   // VALUE:<text>   X: the text, padded with spaces
+    FIELD_CONTENT_COUNT,   // COUNT[:<type>] Trailer: detail records, or records of one RECORD_TYPE
+    FIELD_CONTENT_SUM      // SUM:<field>    Trailer: hash total of a numeric field
+} FieldContent;
+
+#define FIELD_NAME_MAX 32
+
+typedef struct {
+    char name[FIELD_NAME_MAX];
+    FieldType type;
+    size_t length;       // Bytes in the record
+    size_t dictionary;   // FIELD_DICTIONARY: index into Config.dictionaries
+    FieldContent content;
+    char source[FIELD_NAME_MAX];  // VALUE text, COUNT record type ("" = detail records), SUM field
+} FieldDef;
+
+// Encoding of a dictionary source file.
+typedef enum {
+    DICTIONARY_UTF8,
+    DICTIONARY_SJIS
+} DictionaryEncoding;
+
+// DICTIONARY=NAME,PATH[,UTF-8|SJIS]: a word list with one entry per line.
+typedef struct {
+    char name[FIELD_NAME_MAX];
+    char *path;
+    DictionaryEncoding encoding;
+} DictionaryDef;
+
+// Place of a RECORD_TYPE in the file.
+typedef enum {
+    RECORD_ROLE_HEADER,      // The first record
+    RECORD_ROLE_DETAIL,      // RECORD_COUNT records in between, drawn by weight
+    RECORD_ROLE_TRAILER      // The last record
+} RecordRole;
+
+typedef struct RecordType RecordType;
+
 typedef struct {
     FileType file_type;
     size_t record_length;
     DataMode data_mode;
     NewlineMode newline;
-    size_t record_count;
+    size_t record_count;            // Records to generate (detail records with RECORD_TYPE)
+    size_t target_size;             // TARGET_SIZE: bytes RECORD_COUNT was derived from (0 = not given)
+    size_t first_record;            // Index of the first one in the whole file (--range, --shard)
+    size_t min_record_length;       // VARIABLE: shortest record (0 = 1)
+    LengthDistribution length_distribution;
+    double length_param[2];         // NORMAL mean/stddev, LOGNORMAL median/sigma, ZIPF exponent
+    char *length_sample;            // EMPIRICAL: sample RECFM=V file
     RdwEndian rdw_endian;
+    size_t block_size;              // VARIABLE: block size incl. BDW (0 = unblocked RECFM=V)
+    int spanned;                    // VBS: records span blocks in segments
     
     FillPatternType fill_type;
     unsigned char single_byte_fill; // Used if fill_type == FILL_PATTERN_HEX
     char *string_pattern;           // Used if fill_type == FILL_PATTERN_STRING
     TextType text_type;             // Used if data_mode == DATA_MODE_TEXT && fill_type == FILL_PATTERN_RANDOM
+    RandomQuality random_quality;   // Used if fill_type == FILL_PATTERN_RANDOM without a FIELD layout
+    OutputCodepage output_codepage; // Character encoding of generated text
     
     // For Mixed JIS mode
     unsigned char start_code[8];    // Shift-Out / Escape Sequence
     size_t start_code_len;
     unsigned char end_code[8];      // Shift-In / Escape Sequence
     size_t end_code_len;
+
+    // Record layout (FIELD= lines, in record order). Without fields the whole
+    // record is filled as one blob.
+    FieldDef *fields;
+    size_t field_count;
+    DictionaryDef *dictionaries;    // DICTIONARY= lines, referenced by DICT: fields
+    size_t dictionary_count;
+
+    // Record types (RECORD_TYPE= sections). Without them every record
+    // follows the settings above.
+    RecordType *record_types;
+    size_t record_type_count;
+
+    // Unique record key (KEY=), written over the generated bytes
+    size_t key_offset;
+    size_t key_length;              // 0 = no key
+    FieldType key_format;           // FIELD_ZONED, FIELD_PACKED or FIELD_BINARY
+    int key_random;                 // RANDOM: permuted, otherwise ASCENDING record numbers
+
+    // Generation engine
+    size_t threads;                 // Worker threads (0 = one per online CPU)
+    uint64_t seed;                  // Seed of the random streams
+    int seed_set;                   // Non-zero if SEED was given (otherwise time-based)
+
+    // Output
+    size_t output_block_size;       // Size of the blocks handed to the writer thread
+    int direct_io;                  // Bypass the page cache with O_DIRECT
+    CompressionType compression;    // Block-wise compression of the output
+    int compression_level;          // 0 = codec default
+    int mmap_output;                // FIXED: fill records straight into a mapping of the file (--mmap)
+
+    // Reporting (command line only)
+    int stats;                      // Print a statistics summary at the end (--stats)
+    const char *stats_json;         // JSON summary file (NULL = stderr)
+    int progress;                   // Report progress on SIGUSR1 (--progress)
+    unsigned progress_interval;     // Seconds between progress lines (0 = on SIGUSR1 only)
+
+    // Streaming (command line only)
+    double rate;                    // Target per second, paced by a token bucket (--rate, 0 = unpaced)
+    int rate_records;               // `rate` counts records, not bytes
+    int timed;                      // Run for `duration`, ignoring RECORD_COUNT (--duration)
+    unsigned duration;              // Seconds (0 = until the reader goes away or SIGINT/SIGTERM)
+
+    // Checkpoints (command line only)
+    const char *checkpoint_path;    // Sidecar file of --checkpoint / --resume (NULL = none)
+    size_t checkpoint_bytes;        // Output between checkpoints
+    uint64_t definition_hash;       // Identifies the definition in the checkpoint
+    size_t resume_records;          // --resume: records of the slice already in the file
 } Config;
 
+// RECORD_TYPE=NAME,HEADER|DETAIL|TRAILER[,WEIGHT]. `config` is the file's
+// Config with the record settings of the section (RECORD_LENGTH,
+// FILL_PATTERN, TEXT_TYPE, FIELD) in place; it owns only its fields and
+// string pattern.
+struct RecordType {
+    char name[FIELD_NAME_MAX];
+    RecordRole role;
+    double weight;                  // DETAIL: relative share of the records
+    Config config;
+};
+
 #endif // CONFIG_H
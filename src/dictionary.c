@@ -0,0 +1,497 @@
+#include "dictionary.h"
+#include "codepage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <iconv.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define INDEX_MAGIC "MFDIDX1\n"
+#define INDEX_SUFFIX ".idx"
+#define INDEX_INITIAL_ENTRIES 4096
+
+#define END_OF_ENTRY 0xFFFFFFFFu
+#define SJIS_GETA 0x81ACu          // 〓, stands in for unmappable characters
+#define HOST_GETA_DEFAULT 0xFEFEu
+
+// Shift-JIS double-byte codes: 60 lead bytes, trail bytes 0x40-0xFC.
+#define SJIS_LEADS 60
+#define SJIS_TRAILS (0xFC - 0x40 + 1)
+
+enum {
+    OUT_SJIS,      // Shift-JIS as it is (ASCII output)
+    OUT_ISO2022,   // 7-bit JIS between START_CODE / END_CODE (TEXT_TYPE=ISO_2022)
+    OUT_HOST,      // Host DBCS between SO / SI (CP930, CP939)
+    OUT_SBCS       // Single-byte EBCDIC: double-byte characters become '?'
+};
+
+// Header of PATH.idx, followed by `count` entry offsets of `width` bytes in
+// native byte order.
+typedef struct {
+    char magic[8];
+    uint64_t source_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t count;
+    uint64_t width;
+} IndexHeader;
+
+struct Dictionary {
+    char *path;
+    DictionaryEncoding encoding;
+    const unsigned char *data;
+    size_t size;
+    const void *offsets;     // uint32_t or uint64_t line starts
+    int wide;
+    size_t count;
+    void *index_map;         // Mapping of PATH.idx (NULL if built in memory)
+    size_t index_map_len;
+    uint64_t *built;         // Index that could not be saved
+};
+
+// Conversion tables, built once from the iconv CP932 mappings.
+static uint16_t unicode_sjis[65536];              // BMP code point -> Shift-JIS (0 = none)
+static uint16_t sjis_host[SJIS_LEADS * SJIS_TRAILS];  // Shift-JIS -> host DBCS (0 = none)
+static uint16_t host_geta = HOST_GETA_DEFAULT;
+static int unicode_ready;
+static int host_ready;
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static inline int sjis_lead(unsigned c) {
+    return (c >= 0x81 && c <= 0x9F) || (c >= 0xE0 && c <= 0xFC);
+}
+
+static inline int sjis_trail(unsigned c) {
+    return c >= 0x40 && c <= 0xFC && c != 0x7F;
+}
+
+static inline size_t sjis_slot(unsigned code) {
+    unsigned lead = code >> 8;
+    return (size_t)(lead <= 0x9F ? lead - 0x81 : lead - 0xE0 + 0x1F) * SJIS_TRAILS + ((code & 0xFF) - 0x40);
+}
+
+// Converts one character; returns the output length (0 if it has no mapping).
+static size_t convert_one(iconv_t cd, const unsigned char *in, size_t in_len, unsigned char *out, size_t cap) {
+    char *ip = (char *)in, *op = (char *)out;
+    size_t il = in_len, ol = cap;
+    iconv(cd, NULL, NULL, NULL, NULL);
+    if (iconv(cd, &ip, &il, &op, &ol) != 0 || il != 0) return 0;
+    if (iconv(cd, NULL, NULL, &op, &ol) == (size_t)-1) return 0;
+    return cap - ol;
+}
+
+static void build_tables(void) {
+    iconv_t to_unicode = iconv_open("UCS-4LE", "CP932");
+    iconv_t to_host = iconv_open("IBM939", "CP932");
+
+    for (unsigned lead = 0x81; lead <= 0xFC; lead++) {
+        if (!sjis_lead(lead)) continue;
+        for (unsigned trail = 0x40; trail <= 0xFC; trail++) {
+            if (!sjis_trail(trail)) continue;
+            unsigned char in[2] = { (unsigned char)lead, (unsigned char)trail };
+            unsigned char out[8];
+            if (to_unicode != (iconv_t)-1 && convert_one(to_unicode, in, 2, out, sizeof(out)) == 4) {
+                uint32_t u = out[0] | (uint32_t)out[1] << 8 | (uint32_t)out[2] << 16 | (uint32_t)out[3] << 24;
+                // CP932 has duplicates (NEC and IBM extensions); the first code is the standard one.
+                if (u < 65536 && unicode_sjis[u] == 0) unicode_sjis[u] = (uint16_t)(lead << 8 | trail);
+            }
+            // SO, two DBCS bytes, SI.
+            if (to_host != (iconv_t)-1 && convert_one(to_host, in, 2, out, sizeof(out)) == 4 &&
+                out[0] == 0x0E && out[3] == 0x0F) {
+                sjis_host[sjis_slot(lead << 8 | trail)] = (uint16_t)(out[1] << 8 | out[2]);
+            }
+        }
+    }
+    for (unsigned c = 0x20; c <= 0x7E; c++) unicode_sjis[c] = (uint16_t)c;
+    for (unsigned c = 0xA1; c <= 0xDF; c++) unicode_sjis[0xFF61 + (c - 0xA1)] = (uint16_t)c;
+    // Characters that CP932 maps to Microsoft variants but other Japanese
+    // text uses the JIS mappings for.
+    static const uint16_t jis_variants[][2] = {
+        { 0x301C, 0x8160 }, { 0x2016, 0x8161 }, { 0x2212, 0x817C },
+        { 0x00A2, 0x8191 }, { 0x00A3, 0x8192 }, { 0x00AC, 0x81CA },
+    };
+    for (size_t i = 0; i < sizeof(jis_variants) / sizeof(jis_variants[0]); i++) {
+        if (unicode_sjis[jis_variants[i][0]] == 0) unicode_sjis[jis_variants[i][0]] = jis_variants[i][1];
+    }
+    if (sjis_host[sjis_slot(SJIS_GETA)]) host_geta = sjis_host[sjis_slot(SJIS_GETA)];
+
+    unicode_ready = (to_unicode != (iconv_t)-1);
+    host_ready = (to_host != (iconv_t)-1);
+    if (to_unicode != (iconv_t)-1) iconv_close(to_unicode);
+    if (to_host != (iconv_t)-1) iconv_close(to_host);
+}
+
+// --- Index ---
+
+static char *index_path(const char *path) {
+    char *idx = malloc(strlen(path) + sizeof(INDEX_SUFFIX));
+    if (idx) {
+        strcpy(idx, path);
+        strcat(idx, INDEX_SUFFIX);
+    }
+    return idx;
+}
+
+// Maps PATH.idx if it was built from the file as it is now. Returns 0 on success.
+static int load_index(Dictionary *d, const char *idx, const struct stat *st) {
+    int fd = open(idx, O_RDONLY);
+    if (fd < 0) return 1;
+
+    IndexHeader h;
+    struct stat ist;
+    int ok = (fstat(fd, &ist) == 0 && pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) &&
+              memcmp(h.magic, INDEX_MAGIC, sizeof(h.magic)) == 0 && h.source_size == (uint64_t)st->st_size &&
+              h.mtime_sec == (int64_t)st->st_mtim.tv_sec && h.mtime_nsec == (int64_t)st->st_mtim.tv_nsec &&
+              (h.width == 4 || h.width == 8) && h.count > 0 &&
+              (uint64_t)ist.st_size == sizeof(h) + h.count * h.width);
+    if (ok) {
+        d->index_map_len = (size_t)ist.st_size;
+        d->index_map = mmap(NULL, d->index_map_len, PROT_READ, MAP_SHARED, fd, 0);
+        if (d->index_map == MAP_FAILED) {
+            d->index_map = NULL;
+            ok = 0;
+        }
+    }
+    close(fd);
+    if (!ok) return 1;
+
+    posix_madvise(d->index_map, d->index_map_len, POSIX_MADV_RANDOM);
+    d->offsets = (const unsigned char *)d->index_map + sizeof(IndexHeader);
+    d->wide = (h.width == 8);
+    d->count = (size_t)h.count;
+    return 0;
+}
+
+// Finds the starts of the non-empty lines. Returns NULL on error.
+static uint64_t *scan_lines(const Dictionary *d, size_t *count) {
+    size_t capacity = INDEX_INITIAL_ENTRIES, n = 0;
+    uint64_t *offsets = malloc(capacity * sizeof(uint64_t));
+    if (!offsets) return NULL;
+
+    size_t pos = 0;
+    if (d->encoding == DICTIONARY_UTF8 && d->size >= 3 && memcmp(d->data, "\xEF\xBB\xBF", 3) == 0) pos = 3;
+    while (pos < d->size) {
+        const unsigned char *nl = memchr(d->data + pos, '\n', d->size - pos);
+        size_t end = nl ? (size_t)(nl - d->data) : d->size;
+        size_t text_end = (end > pos && d->data[end - 1] == '\r') ? end - 1 : end;
+        if (text_end > pos) {
+            if (n == capacity) {
+                uint64_t *grown = realloc(offsets, 2 * capacity * sizeof(uint64_t));
+                if (!grown) {
+                    free(offsets);
+                    return NULL;
+                }
+                offsets = grown;
+                capacity *= 2;
+            }
+            offsets[n++] = pos;
+        }
+        pos = end + 1;
+    }
+    *count = n;
+    return offsets;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Writes the index to a temporary file and renames it over PATH.idx, so a
+// concurrent reader never sees a partial index. Returns 0 on success.
+static int save_index(const char *idx, const struct stat *st, const uint64_t *offsets, size_t count, int wide) {
+    char *tmp = malloc(strlen(idx) + 8);
+    if (!tmp) return 1;
+    strcpy(tmp, idx);
+    strcat(tmp, ".XXXXXX");
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        free(tmp);
+        return 1;
+    }
+
+    // Readable by whoever can read the dictionary (mkstemp() creates it 0600).
+    fchmod(fd, st->st_mode & 0666);
+
+    IndexHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, INDEX_MAGIC, sizeof(h.magic));
+    h.source_size = (uint64_t)st->st_size;
+    h.mtime_sec = (int64_t)st->st_mtim.tv_sec;
+    h.mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+    h.count = count;
+    h.width = wide ? 8 : 4;
+    int err = write_all(fd, &h, sizeof(h));
+    if (wide) {
+        if (!err) err = write_all(fd, offsets, count * sizeof(uint64_t));
+    } else {
+        uint32_t chunk[4096];
+        for (size_t i = 0; i < count && !err; i += 4096) {
+            size_t n = (count - i < 4096) ? count - i : 4096;
+            for (size_t k = 0; k < n; k++) chunk[k] = (uint32_t)offsets[i + k];
+            err = write_all(fd, chunk, n * sizeof(uint32_t));
+        }
+    }
+    if (close(fd) != 0) err = 1;
+    if (!err && rename(tmp, idx) != 0) err = 1;
+    if (err) unlink(tmp);
+    free(tmp);
+    return err;
+}
+
+static int build_index(Dictionary *d, const char *idx, const struct stat *st) {
+    size_t count;
+    uint64_t *offsets = scan_lines(d, &count);
+    if (!offsets) {
+        perror("Error allocating memory for the dictionary index");
+        return 1;
+    }
+    if (count == 0) {
+        fprintf(stderr, "Error: Dictionary %s has no entries.\n", d->path);
+        free(offsets);
+        return 1;
+    }
+    int wide = (d->size > UINT32_MAX);
+    if (save_index(idx, st, offsets, count, wide) == 0 && load_index(d, idx, st) == 0) {
+        free(offsets);
+        return 0;
+    }
+    fprintf(stderr, "Warning: Could not save the index %s; it is rebuilt on every run.\n", idx);
+    d->built = offsets;
+    d->offsets = offsets;
+    d->wide = 1;
+    d->count = count;
+    return 0;
+}
+
+Dictionary *dictionary_open(const DictionaryDef *def) {
+    Dictionary *d = calloc(1, sizeof(Dictionary));
+    if (!d || !(d->path = strdup(def->path))) {
+        perror("Error allocating memory for the dictionary");
+        free(d);
+        return NULL;
+    }
+    d->encoding = def->encoding;
+    if (d->encoding == DICTIONARY_UTF8) {
+        pthread_once(&tables_once, build_tables);
+        if (!unicode_ready) {
+            fprintf(stderr, "Error: UTF-8 dictionaries need iconv support for CP932 (dictionary %s).\n", def->name);
+            dictionary_close(d);
+            return NULL;
+        }
+    }
+
+    int fd = open(def->path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Error opening dictionary %s: %s\n", def->path, strerror(errno));
+        if (fd >= 0) close(fd);
+        dictionary_close(d);
+        return NULL;
+    }
+    if (st.st_size == 0) {
+        fprintf(stderr, "Error: Dictionary %s has no entries.\n", def->path);
+        close(fd);
+        dictionary_close(d);
+        return NULL;
+    }
+    d->size = (size_t)st.st_size;
+    void *data = mmap(NULL, d->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error mapping dictionary %s: %s\n", def->path, strerror(errno));
+        d->size = 0;
+        dictionary_close(d);
+        return NULL;
+    }
+    d->data = data;
+    posix_madvise(data, d->size, POSIX_MADV_RANDOM);
+
+    char *idx = index_path(def->path);
+    if (!idx) {
+        perror("Error allocating memory for the dictionary");
+        dictionary_close(d);
+        return NULL;
+    }
+    int err = (load_index(d, idx, &st) != 0 && build_index(d, idx, &st) != 0);
+    free(idx);
+    if (err) {
+        dictionary_close(d);
+        return NULL;
+    }
+    return d;
+}
+
+void dictionary_close(Dictionary *d) {
+    if (!d) return;
+    if (d->data) munmap((void *)d->data, d->size);
+    if (d->index_map) munmap(d->index_map, d->index_map_len);
+    free(d->built);
+    free(d->path);
+    free(d);
+}
+
+size_t dictionary_size(const Dictionary *d) {
+    return d->count;
+}
+
+// --- Writing entries ---
+
+int dictionary_writer_init(DictionaryWriter *w, const Dictionary *dict, const Config *config) {
+    const Codepage *cp = codepage_get(config->output_codepage);
+    memset(w, 0, sizeof(*w));
+    w->dictionary = dict;
+    if (cp->dbcs) {
+        w->mode = OUT_HOST;
+    } else if (cp->ebcdic) {
+        w->mode = OUT_SBCS;
+    } else {
+        w->mode = (config->text_type == TEXT_TYPE_ISO_2022) ? OUT_ISO2022 : OUT_SJIS;
+    }
+    if (w->mode == OUT_HOST) {
+        pthread_once(&tables_once, build_tables);
+        if (!host_ready) {
+            fprintf(stderr, "Error: Writing dictionary entries in %s needs iconv support for CP932 and IBM939.\n",
+                    cp->name);
+            return 1;
+        }
+    }
+
+    // Printable ASCII (and half-width katakana in Shift-JIS output); other
+    // single bytes, including the ones the codepage cannot print, become '?'.
+    int printable[128] = { 0 };
+    for (unsigned k = 0; k < cp->text_count; k++) {
+        for (unsigned c = 0x20; c < 0x7F; c++) {
+            if (cp->map[c] == cp->text[k]) printable[c] = 1;
+        }
+    }
+    for (unsigned c = 0; c < 256; c++) {
+        unsigned ascii = (c >= 0x20 && c < 0x7F && printable[c]) ? c : '?';
+        w->sbcs[c] = cp->map[ascii];
+    }
+    if (w->mode == OUT_SJIS) {
+        for (unsigned c = 0xA1; c <= 0xDF; c++) w->sbcs[c] = (unsigned char)c;
+    }
+    w->space = cp->space;
+    w->start_code = config->start_code;
+    w->start_code_len = config->start_code_len;
+    w->end_code = config->end_code;
+    w->end_code_len = config->end_code_len;
+    return 0;
+}
+
+static inline size_t entry_start(const Dictionary *d, size_t i) {
+    return d->wide ? (size_t)((const uint64_t *)d->offsets)[i] : (size_t)((const uint32_t *)d->offsets)[i];
+}
+
+// Next character of an entry: a single byte (< 0x100), a Shift-JIS double
+// byte code, or END_OF_ENTRY at the end of the line.
+static inline unsigned next_char(const Dictionary *d, size_t *pos) {
+    const unsigned char *p = d->data;
+    size_t i = *pos;
+    if (i >= d->size || p[i] == '\n' || p[i] == '\r') return END_OF_ENTRY;
+    unsigned c = p[i];
+
+    if (d->encoding == DICTIONARY_SJIS) {
+        if (sjis_lead(c) && i + 1 < d->size && sjis_trail(p[i + 1])) {
+            *pos = i + 2;
+            return c << 8 | p[i + 1];
+        }
+        *pos = i + 1;
+        return c;
+    }
+
+    if (c < 0x80) {
+        *pos = i + 1;
+        return c;
+    }
+    size_t n = (c >= 0xC2 && c <= 0xDF) ? 2 : (c >= 0xE0 && c <= 0xEF) ? 3 : (c >= 0xF0 && c <= 0xF4) ? 4 : 0;
+    uint32_t u = (n == 2) ? (c & 0x1F) : (n == 3) ? (c & 0x0F) : (c & 0x07);
+    if (n == 0 || i + n > d->size) {
+        *pos = i + 1;
+        return '?';
+    }
+    for (size_t k = 1; k < n; k++) {
+        if ((p[i + k] & 0xC0) != 0x80) {
+            *pos = i + k;
+            return '?';
+        }
+        u = (u << 6) | (p[i + k] & 0x3F);
+    }
+    *pos = i + n;
+    unsigned code = (u < 65536) ? unicode_sjis[u] : 0;
+    return code ? code : SJIS_GETA;
+}
+
+// Shift-JIS double byte code to 7-bit JIS X 0208; the vendor rows of CP932
+// (9-15 and beyond 84) have no JIS code.
+static inline unsigned sjis_to_jis(unsigned code) {
+    unsigned s1 = code >> 8, s2 = code & 0xFF;
+    unsigned row = (s1 <= 0x9F) ? (s1 - 0x81) * 2 + 1 : (s1 - 0xE0) * 2 + 63;
+    unsigned cell;
+    if (s2 >= 0x9F) {
+        row++;
+        cell = s2 - 0x9E;
+    } else {
+        cell = (s2 < 0x7F) ? s2 - 0x3F : s2 - 0x40;
+    }
+    if ((row >= 9 && row <= 15) || row > 84) return 0x222E;  // 〓
+    return (row + 0x20) << 8 | (cell + 0x20);
+}
+
+void dictionary_write(const DictionaryWriter *w, uint64_t bits, unsigned char *dst, size_t length) {
+    const Dictionary *d = w->dictionary;
+    size_t pos = entry_start(d, (size_t)(bits % d->count));
+    size_t out = 0;
+    int in_dbcs = 0;
+    unsigned c;
+
+    while ((c = next_char(d, &pos)) != END_OF_ENTRY) {
+        if (c < 0x100 || w->mode == OUT_SBCS) {
+            // An open DBCS run always has room left for its END_CODE.
+            size_t need = 1 + (in_dbcs ? w->end_code_len : 0);
+            if (out + need > length) break;
+            if (in_dbcs) {
+                memcpy(dst + out, w->end_code, w->end_code_len);
+                out += w->end_code_len;
+                in_dbcs = 0;
+            }
+            dst[out++] = (c < 0x100) ? w->sbcs[c] : w->sbcs['?'];
+        } else if (w->mode == OUT_SJIS) {
+            if (out + 2 > length) break;
+            dst[out++] = (unsigned char)(c >> 8);
+            dst[out++] = (unsigned char)c;
+        } else {
+            unsigned code = (w->mode == OUT_ISO2022) ? sjis_to_jis(c) : sjis_host[sjis_slot(c)];
+            if (code == 0) code = host_geta;
+            size_t need = 2 + w->end_code_len + (in_dbcs ? 0 : w->start_code_len);
+            if (out + need > length) break;
+            if (!in_dbcs) {
+                memcpy(dst + out, w->start_code, w->start_code_len);
+                out += w->start_code_len;
+                in_dbcs = 1;
+            }
+            dst[out++] = (unsigned char)(code >> 8);
+            dst[out++] = (unsigned char)code;
+        }
+    }
+    if (in_dbcs) {
+        memcpy(dst + out, w->end_code, w->end_code_len);
+        out += w->end_code_len;
+    }
+    memset(dst + out, w->space, length - out);
+}
@@ -0,0 +1,53 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+// Dictionaries of DICT: fields (DICTIONARY=NAME,PATH[,UTF-8|SJIS]).
+//
+// A dictionary is a text file with one entry per line, memory-mapped as it
+// is. Picking an entry is a lookup in an index of line start offsets, which
+// is kept next to the file as PATH.idx: it is built with one scan the first
+// time and then only mapped, so opening a dictionary of any size takes a
+// couple of system calls. The index records the size and modification time
+// of the file it was built from and is rebuilt when they change.
+//
+// Entries are converted while they are copied into the record: Shift-JIS
+// with ASCII output, 7-bit JIS between START_CODE/END_CODE with
+// TEXT_TYPE=ISO_2022, and host DBCS between SO/SI with CP930/CP939. A
+// double-byte character is never split, a DBCS run is always closed inside
+// the field, and the rest of the field is padded with spaces. Characters
+// the output cannot hold become '?' (single-byte) or a geta mark (double-byte).
+
+typedef struct Dictionary Dictionary;
+
+// Maps the dictionary and its index. Returns NULL on error.
+Dictionary *dictionary_open(const DictionaryDef *def);
+
+void dictionary_close(Dictionary *dict);
+
+// Number of entries (non-empty lines).
+size_t dictionary_size(const Dictionary *dict);
+
+// How entries are written for one config.
+typedef struct {
+    const Dictionary *dictionary;
+    int mode;                        // Output encoding
+    unsigned char sbcs[256];         // Shift-JIS single byte -> output byte
+    unsigned char space;
+    const unsigned char *start_code;
+    size_t start_code_len;
+    const unsigned char *end_code;
+    size_t end_code_len;
+} DictionaryWriter;
+
+// Prepares writing entries of `dict` in the encoding of the config.
+// Returns 0 on success, non-zero on error.
+int dictionary_writer_init(DictionaryWriter *writer, const Dictionary *dict, const Config *config);
+
+// Writes entry `bits` modulo the dictionary size into dst[0..length).
+void dictionary_write(const DictionaryWriter *writer, uint64_t bits, unsigned char *dst, size_t length);
+
+#endif // DICTIONARY_H
@@ -0,0 +1,312 @@
+#include "entropy.h"
+#include "randfill.h"
+#include "mbtext.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Keeps the pool of a seed apart from the record generators.
+#define ENTROPY_POOL_SALT 0x454E54524F5059ULL
+
+static int is_sjis_lead(unsigned char c) {
+    return (c >= 0x81 && c <= 0x9F) || (c >= 0xE0 && c <= 0xFC);
+}
+
+// Marks the character starts and single-byte characters of a block and
+// returns the mask of its double-byte characters.
+
+// Shift-JIS block: generated bytes are printable ASCII or 2-byte
+// characters, so a lead byte is never a single character.
+static uint64_t sjis_marks(const unsigned char *block, EntropyMarks *m) {
+    uint64_t dbcs = 0;
+    size_t i = 0;
+    m->boundaries = m->sbcs = 0;
+    while (i < ENTROPY_BLOCK) {
+        m->boundaries |= (uint64_t)1 << i;
+        if (is_sjis_lead(block[i])) {
+            dbcs |= (uint64_t)1 << i;
+            i += 2;
+        } else {
+            m->sbcs |= (uint64_t)1 << i;
+            i++;
+        }
+    }
+    return dbcs;
+}
+
+// ISO-2022 block: neither the DBCS bytes nor printable text contain the
+// first byte of a shift code.
+static uint64_t iso2022_marks(const unsigned char *block, const Config *config, EntropyMarks *m) {
+    uint64_t chars = 0;
+    int dbcs = 0;
+    size_t i = 0;
+    m->boundaries = m->sbcs = 0;
+    while (i < ENTROPY_BLOCK) {
+        if (!dbcs) {
+            m->boundaries |= (uint64_t)1 << i;
+            if (i + config->start_code_len <= ENTROPY_BLOCK &&
+                memcmp(block + i, config->start_code, config->start_code_len) == 0) {
+                i += config->start_code_len;
+                dbcs = 1;
+            } else {
+                m->sbcs |= (uint64_t)1 << i;
+                i++;
+            }
+        } else if (i + config->end_code_len <= ENTROPY_BLOCK &&
+                   memcmp(block + i, config->end_code, config->end_code_len) == 0) {
+            i += config->end_code_len;
+            dbcs = 0;
+        } else {
+            chars |= (uint64_t)1 << i;
+            i += 2;
+        }
+    }
+    return chars;
+}
+
+int entropy_pool_init(EntropyPool *pool, const Config *config, uint64_t key) {
+    memset(pool, 0, sizeof(*pool));
+    pool->blocks = ENTROPY_POOL_BYTES / ENTROPY_BLOCK;
+    pool->codepage = codepage_get(config->output_codepage);
+    pool->data = malloc(ENTROPY_POOL_BYTES);
+    if (!pool->data) {
+        perror("Error allocating memory for the entropy pool");
+        return 1;
+    }
+
+    Prng rng;
+    prng_seed(&rng, key ^ ENTROPY_POOL_SALT);
+    if (config->data_mode == DATA_MODE_BINARY) {
+        pool->kind = ENTROPY_BINARY;
+        randfill_bytes(&rng, pool->data, ENTROPY_POOL_BYTES);
+        return 0;
+    }
+    if (config->text_type == TEXT_TYPE_ASCII) {
+        // ASCII is rotated as it is; EBCDIC as alphabet indices, looked up
+        // after the rotation.
+        pool->kind = ENTROPY_TEXT;
+        pool->text_first = pool->codepage->ebcdic ? 0 : 0x20;
+        randfill_range(&rng, pool->data, ENTROPY_POOL_BYTES, pool->text_first, pool->codepage->text_count);
+        return 0;
+    }
+
+    pool->kind = ENTROPY_MULTIBYTE;
+    const Codepage *cp = pool->codepage;
+    for (unsigned i = 0; i < cp->text_count; i++) {
+        pool->text_index[cp->text[i]] = (unsigned char)i;
+        pool->text_twice[i] = pool->text_twice[cp->text_count + i] = cp->text[i];
+    }
+    MbtextAlphabet alphabet;
+    mbtext_alphabet(config, &alphabet);
+    pool->class_count = alphabet.class_count;
+
+    // Class and rank of every double-byte character, by its two bytes.
+    uint32_t *slot = calloc(65536, sizeof(uint32_t));
+    pool->marks = malloc(pool->blocks * sizeof(EntropyMarks));
+    pool->chars = malloc(pool->blocks * (ENTROPY_BLOCK / 2) * sizeof(EntropyChar));
+    pool->codes = malloc(2 * alphabet.count * 2);
+    if (!slot || !pool->marks || !pool->chars || !pool->codes) {
+        perror("Error allocating memory for the entropy pool");
+        free(slot);
+        entropy_pool_free(pool);
+        return 1;
+    }
+    for (size_t c = 0, i = 0; c < alphabet.class_count; c++) {
+        size_t size = alphabet.class_end[c] - i;
+        pool->class_first[c] = 2 * i;
+        pool->class_size[c] = size;
+        for (size_t rank = 0; rank < size; rank++, i++) {
+            const unsigned char *code = alphabet.code[i];
+            slot[code[0] << 8 | code[1]] = (uint32_t)(c << 16 | rank);
+            memcpy(pool->codes[2 * i - rank], code, 2);
+            memcpy(pool->codes[2 * i - rank + size], code, 2);
+        }
+    }
+
+    size_t chars = 0;
+    for (size_t b = 0; b < pool->blocks; b++) {
+        unsigned char *block = pool->data + b * ENTROPY_BLOCK;
+        EntropyMarks *m = &pool->marks[b];
+        uint64_t dbcs;
+        if (config->text_type == TEXT_TYPE_SJIS) {
+            mbtext_fill_sjis(&rng, block, ENTROPY_BLOCK);
+            dbcs = sjis_marks(block, m);
+        } else {
+            mbtext_fill_iso2022(&rng, block, ENTROPY_BLOCK, config);
+            dbcs = iso2022_marks(block, config, m);
+        }
+        m->first_char = (uint32_t)chars;
+        for (; dbcs; dbcs &= dbcs - 1) {
+            size_t j = (size_t)__builtin_ctzll(dbcs);
+            uint32_t s = slot[block[j] << 8 | block[j + 1]];
+            EntropyChar *ch = &pool->chars[chars++];
+            ch->offset = (uint8_t)j;
+            ch->cls = (uint8_t)(s >> 16);
+            ch->rank = (uint16_t)s;
+        }
+        m->char_count = (uint32_t)chars - m->first_char;
+    }
+    free(slot);
+    return 0;
+}
+
+void entropy_pool_free(EntropyPool *pool) {
+    free(pool->data);
+    free(pool->marks);
+    free(pool->chars);
+    free(pool->codes);
+    pool->data = NULL;
+    pool->marks = NULL;
+    pool->chars = NULL;
+    pool->codes = NULL;
+}
+
+// Both copies below apply a pattern of 8 bytes, repeated, to the words of
+// src. Byte k of the pattern is byte k of the little-endian form of the
+// word, so the output does not depend on the byte order of the CPU.
+static inline uint64_t from_le(uint64_t pattern) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap64(pattern);
+#else
+    return pattern;
+#endif
+}
+
+// dst = src XOR the pattern.
+static inline void copy_xor(unsigned char *dst, const unsigned char *src, size_t n, uint64_t pattern) {
+    uint64_t mask = from_le(pattern);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, src + i, 8);
+        w ^= mask;
+        memcpy(dst + i, &w, 8);
+    }
+    for (; i < n; i++) {
+        dst[i] = src[i] ^ (unsigned char)(pattern >> (8 * (i % 8)));
+    }
+}
+
+// dst = the bytes of src, all in [first, end) with end <= 128, each rotated
+// within that range by its byte of the pattern (< end - first). Eight bytes
+// at a time: the sums stay below 256, and adding 128 - end sets the top bit
+// of exactly the ones that wrap around.
+static inline void copy_rotate(unsigned char *dst, const unsigned char *src, size_t n,
+                               uint64_t pattern, unsigned first, unsigned end) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    unsigned count = end - first;
+    uint64_t shift = from_le(pattern);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, src + i, 8);
+        w += shift;
+        uint64_t wrap = ((w + (128 - end) * ones) >> 7) & ones;
+        w -= wrap * count;
+        memcpy(dst + i, &w, 8);
+    }
+    for (; i < n; i++) {
+        unsigned v = src[i] + (unsigned)(pattern >> (8 * (i % 8)) & 0xFF);
+        dst[i] = (unsigned char)(v >= end ? v - count : v);
+    }
+}
+
+// Maps every byte b of bits to b * count / 256, in 16-bit lanes.
+static inline uint64_t scale_bytes(uint64_t bits, unsigned count) {
+    const uint64_t lanes = 0x00FF00FF00FF00FFULL;
+    uint64_t even = (((bits & lanes) * count) >> 8) & lanes;
+    uint64_t odd = ((((bits >> 8) & lanes) * count) >> 8) & lanes;
+    return even | odd << 8;
+}
+
+// Uniform index in [0, n) from 32 random bits (n < 2^32).
+static inline size_t pick(uint64_t bits32, size_t n) {
+    return (size_t)(((bits32 & 0xFFFFFFFFu) * n) >> 32);
+}
+
+// Rotates the double-byte characters of a copied block, each within its
+// class by that class's shift, up to byte `end`. The classes are stored
+// twice in a row, so rank + shift needs no wrap around.
+static inline void rotate_dbcs(const EntropyPool *pool, unsigned char *dst, const EntropyMarks *m,
+                               const unsigned *shift, size_t end) {
+    const EntropyChar *ch = pool->chars + m->first_char;
+    const EntropyChar *last = ch + m->char_count;
+    // In locals: the stores to dst could alias the pool.
+    const unsigned char (*first[MBTEXT_MAX_CLASSES])[2];
+    for (unsigned c = 0; c < pool->class_count; c++) {
+        first[c] = pool->codes + pool->class_first[c] + shift[c];
+    }
+    for (; ch < last && ch->offset < end; ch++) {
+        const unsigned char *code = first[ch->cls][ch->rank];
+        dst[ch->offset] = code[0];
+        dst[ch->offset + 1] = code[1];
+    }
+}
+
+// Rotates the single-byte characters of a copied multibyte block.
+static inline void rotate_sbcs(const EntropyPool *pool, unsigned char *dst, uint64_t sbcs, unsigned shift) {
+    const unsigned char *index = pool->text_index;
+    const unsigned char *text = pool->text_twice + shift;
+    while (sbcs) {
+        size_t j = (size_t)__builtin_ctzll(sbcs);
+        dst[j] = text[index[dst[j]]];
+        sbcs &= sbcs - 1;
+    }
+}
+
+void entropy_pool_fill(const EntropyPool *pool, Prng *rng, unsigned char *dst, size_t length) {
+    const Codepage *cp = pool->codepage;
+    if (pool->kind != ENTROPY_MULTIBYTE) {
+        // Every byte offset starts a valid copy.
+        size_t starts = pool->blocks * ENTROPY_BLOCK - ENTROPY_BLOCK + 1;
+        unsigned char *record = dst;
+        size_t left = length;
+        while (left > 0) {
+            size_t n = (left < ENTROPY_BLOCK) ? left : ENTROPY_BLOCK;
+            const unsigned char *src = pool->data + pick(prng_next(rng), starts);
+            uint64_t pattern = prng_next(rng);
+            if (pool->kind == ENTROPY_BINARY) {
+                copy_xor(dst, src, n, pattern);
+            } else {
+                copy_rotate(dst, src, n, scale_bytes(pattern, cp->text_count),
+                            pool->text_first, pool->text_first + cp->text_count);
+            }
+            dst += n;
+            left -= n;
+        }
+        if (pool->kind == ENTROPY_TEXT && cp->ebcdic) {
+            codepage_text_from_index(cp, record, length);
+        }
+        return;
+    }
+
+    while (length > 0) {
+        uint64_t r = prng_next(rng);
+        size_t b = pick(r, pool->blocks);
+        const EntropyMarks *m = &pool->marks[b];
+        size_t keep = ENTROPY_BLOCK;
+        if (length < ENTROPY_BLOCK) {
+            // Longest prefix that ends on a boundary, padded with single-byte text.
+            uint64_t starts = m->boundaries & (((uint64_t)2 << length) - 1);
+            keep = 63 - (size_t)__builtin_clzll(starts);
+        }
+        memcpy(dst, pool->data + b * ENTROPY_BLOCK, keep);
+        uint64_t inside = (keep < ENTROPY_BLOCK) ? ((uint64_t)1 << keep) - 1 : UINT64_MAX;
+        rotate_sbcs(pool, dst, m->sbcs & inside, (unsigned)pick(r >> 32, cp->text_count));
+
+        // One draw, 16 bits per class.
+        uint64_t r2 = prng_next(rng);
+        unsigned shift[MBTEXT_MAX_CLASSES];
+        for (unsigned c = 0; c < pool->class_count; c++) {
+            shift[c] = (unsigned)(((r2 >> (16 * c)) & 0xFFFF) * pool->class_size[c] >> 16);
+        }
+        rotate_dbcs(pool, dst, m, shift, keep);
+
+        if (keep < ENTROPY_BLOCK) {
+            codepage_fill_text(cp, rng, dst + keep, length - keep);
+            return;
+        }
+        dst += ENTROPY_BLOCK;
+        length -= ENTROPY_BLOCK;
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef ENTROPY_H
+#define ENTROPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "prng.h"
+#include "codepage.h"
+#include "mbtext.h"
+
+// RANDOM_QUALITY=FAST: records stitched together from a pool of random data.
+//
+// The pool is generated once per run and keyed by the seed, so it is the
+// same for every thread, --range part and batch job. A record is a sequence
+// of ENTROPY_BLOCK-byte copies from offsets drawn by the record's own
+// generator: two random draws per 64 bytes instead of one per character.
+//
+// Every copy is also scrambled with its random draw, so records do not
+// repeat pool content even after the output is many times the pool, and
+// neither block deduplication nor a long-window compressor finds the
+// pool in the output. Binary copies are XORed with a random 8-byte pattern.
+// Single-byte text is rotated in the alphabet of the codepage by a random
+// pattern of eight shifts, eight characters at a time (EBCDIC text is
+// pooled as alphabet indices and looked up after). Multibyte text is generated in self-contained
+// blocks (every DBCS run closed inside its block) that are only copied whole,
+// with their single-byte characters rotated in the alphabet and their
+// double-byte characters within their class (kana stay kana, Kanji stay
+// Kanji); the record tail is the longest
+// prefix of a block that ends on a character boundary outside a DBCS run,
+// padded with fresh single-byte text. No double-byte character or SO/SI
+// sequence is ever cut.
+
+#define ENTROPY_BLOCK 64
+#define ENTROPY_POOL_BYTES (256 * 1024)
+
+typedef enum {
+    ENTROPY_BINARY,
+    ENTROPY_TEXT,                   // Single-byte text
+    ENTROPY_MULTIBYTE               // Shift-JIS or ISO-2022 blocks
+} EntropyKind;
+
+// Layout of a multibyte block: bit j is byte j.
+typedef struct {
+    uint64_t boundaries;            // Character starts outside a DBCS run
+    uint64_t sbcs;                  // Single-byte characters
+    uint32_t first_char;            // Its double-byte characters in EntropyPool.chars
+    uint32_t char_count;
+} EntropyMarks;
+
+// A double-byte character of a multibyte block.
+typedef struct {
+    uint8_t offset;                 // In the block
+    uint8_t cls;                    // Class in the alphabet
+    uint16_t rank;                  // Position in the class
+} EntropyChar;
+
+typedef struct {
+    EntropyKind kind;
+    unsigned char *data;
+    size_t blocks;                  // data holds blocks * ENTROPY_BLOCK bytes
+    const Codepage *codepage;
+    unsigned text_first;            // ENTROPY_TEXT: byte of alphabet index 0 (0x20 for ASCII, 0 = indices)
+
+    // ENTROPY_MULTIBYTE
+    EntropyMarks *marks;            // One per block
+    EntropyChar *chars;             // Double-byte characters of all blocks, block by block
+    unsigned char text_index[256];  // Printable character -> alphabet index
+    unsigned char text_twice[512];  // The alphabet, twice in a row
+    unsigned char (*codes)[2];      // Each class of the double-byte alphabet, twice in a row
+    size_t class_first[MBTEXT_MAX_CLASSES];  // Class c starts at codes[class_first[c]]
+    size_t class_size[MBTEXT_MAX_CLASSES];
+    unsigned class_count;
+} EntropyPool;
+
+// Generates the pool of the config from `key`. Returns 0 on success, non-zero on error.
+int entropy_pool_init(EntropyPool *pool, const Config *config, uint64_t key);
+
+void entropy_pool_free(EntropyPool *pool);
+
+// Fills dst[0..length) from the pool, drawing offsets from rng.
+void entropy_pool_fill(const EntropyPool *pool, Prng *rng, unsigned char *dst, size_t length);
+
+#endif // ENTROPY_H
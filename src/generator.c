@@ -1,180 +1,63 @@
+#define _GNU_SOURCE  // copy_file_range
 #include "generator.h"
+#include "prng.h"
+#include "randfill.h"
+#include "mbtext.h"
+#include "codepage.h"
+#include "output.h"
+#include "plan.h"
+#include "blocking.h"
+#include "stats.h"
+#include "lengths.h"
+#include "key.h"
+#include "entropy.h"
+#include "pacing.h"
+#include "parser.h"
+#include "checkpoint.h"
+#include "recmix.h"
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
-static void fill_buffer(unsigned char *buffer, size_t length, const Config *config) {
+// Records are generated in batches of about this size. Every record draws
+// from its own generator, derived from the seed and the record's index in
+// the file, so the output never depends on how many threads produced it and
+// any slice of records can be generated on its own (--range, --shard).
+#define BATCH_TARGET_BYTES (1024 * 1024)
+
+// Header and trailer records draw from generators of their own, apart from
+// the detail records' indexes.
+#define EDGE_RECORD_SALT 0x45444745524543ULL
+
+// Size of the replicated block used when every record is identical.
+#define CONSTANT_BLOCK_BYTES (4 * 1024 * 1024)
+// Largest single copy_file_range() request while doubling a constant file.
+#define CONSTANT_COPY_CHUNK ((size_t)1 << 30)
+
+// --mmap: file range mapped, filled and unmapped at a time by one worker.
+// A multiple of the 2 MiB huge page size.
+#define MMAP_WINDOW_BYTES (64 * 1024 * 1024)
+
+static void fill_buffer(unsigned char *buffer, size_t length, const Config *config, Prng *rng) {
     if (config->fill_type == FILL_PATTERN_RANDOM) {
         if (config->data_mode == DATA_MODE_TEXT) {
             if (config->text_type == TEXT_TYPE_SJIS) {
-                size_t i = 0;
-                while (i < length) {
-                    // Decide if we want a 2-byte char or 1-byte char
-                    // 70% chance of 2-byte if space allows
-                    int make_multibyte = (length - i >= 2) && ((rand() % 100) < 70);
-                    
-                    if (make_multibyte) {
-                        // Shift-JIS 2-byte construction
-                        // We will select valid characters based on JIS X 0208 rows to avoid undefined areas.
-                        // JIS X 0208 Allocation:
-                        // Row 1: Symbols
-                        // Row 4: Hiragana
-                        // Row 5: Katakana
-                        // Row 16-47: Level 1 Kanji
-                        
-                        int row, cell;
-                        int type = rand() % 100;
-                        
-                        if (type < 10) { 
-                            // Symbols (Row 1)
-                            row = 1;
-                            cell = (rand() % 60) + 1; // Limit to common symbols
-                        } else if (type < 20) {
-                            // Hiragana (Row 4)
-                            row = 4;
-                            cell = (rand() % 83) + 1;
-                        } else if (type < 30) {
-                            // Katakana (Row 5)
-                            row = 5;
-                            cell = (rand() % 86) + 1;
-                        } else {
-                            // Kanji Level 1 (Rows 16-47)
-                            row = 16 + (rand() % 32);
-                            if (row == 47) {
-                                cell = (rand() % 51) + 1; // Row 47 ends at cell 51
-                            } else {
-                                cell = (rand() % 94) + 1;
-                            }
-                        }
-
-                        // Convert JIS X 0208 (row, cell) to Shift-JIS
-                        unsigned char b1, b2;
-                        
-                        // Calculate first byte
-                        if (row <= 62) {
-                            b1 = 0x81 + (row - 1) / 2;
-                        } else {
-                            b1 = 0xE0 + (row - 63) / 2;
-                        }
-
-                        // Calculate second byte
-                        if (row % 2 != 0) {
-                            // Odd row
-                            b2 = 0x40 + (cell - 1);
-                            if (b2 >= 0x7F) b2++;
-                        } else {
-                            // Even row
-                            b2 = 0x9F + (cell - 1);
-                        }
-                        
-                        buffer[i++] = b1;
-                        buffer[i++] = b2;
-                    } else {
-                        // Random printable ASCII (0x20 - 0x7E)
-                        buffer[i++] = (rand() % (0x7E - 0x20 + 1)) + 0x20;
-                    }
-                }
+                mbtext_fill_sjis(rng, buffer, length);
             } else if (config->text_type == TEXT_TYPE_ISO_2022) {
-                // Mixed JIS X 0201 (SBCS) and JIS X 0208 (DBCS) with SO/SI codes
-                // Start Code = SO (Shift Out) -> to DBCS
-                // End Code = SI (Shift In) -> to SBCS
-                // Default state is SBCS.
-                
-                int is_dbcs_mode = 0; // 0 = SBCS, 1 = DBCS
-                size_t i = 0;
-                
-                while (i < length) {
-                    // Check if we need to force switch back to SBCS at end of buffer
-                    // We need at least 1 byte for End Code if we are in DBCS mode
-                    // But we also need to be careful about not starting DBCS if we don't have space for Start + 2 bytes + End
-                    
-                    int remaining = length - i;
-                    
-                    if (is_dbcs_mode) {
-                        // In DBCS mode
-                        // We must switch back if remaining space is small
-                        // Need space for End Code.
-                        
-                        int force_switch_back = (remaining <= (int)config->end_code_len);
-                        // Random chance to switch back: 30%
-                        int random_switch = ((rand() % 100) < 30);
-                        
-                        if (force_switch_back || random_switch) {
-                            // Switch back to SBCS
-                            memcpy(&buffer[i], config->end_code, config->end_code_len);
-                            i += config->end_code_len;
-                            is_dbcs_mode = 0;
-                        } else {
-                            // Continue DBCS char (2 bytes)
-                            // Need at least 2 bytes for char, PLUS space for eventual End Code?
-                            // We need remaining >= 2 + end_code_len to write a char safely.
-                            
-                            if (remaining >= 2 + (int)config->end_code_len) {
-                                // Generate JIS X 0208 char (7-bit)
-                                // ISO-2022-JP uses JIS X 0208 code points directly mapped to 0x21-0x7E range (GL)
-                                int row = 16 + (rand() % 32); // Kanji
-                                int cell = (rand() % 94) + 1;
-                                
-                                // Direct 7-bit mapping: 0x20 + row/cell
-                                unsigned char b1 = (unsigned char)(0x20 + row);
-                                unsigned char b2 = (unsigned char)(0x20 + cell);
-
-                                buffer[i++] = b1;
-                                buffer[i++] = b2;
-                            } else {
-                                // Not enough space for char + End Code
-                                // Force switch back
-                                memcpy(&buffer[i], config->end_code, config->end_code_len);
-                                i += config->end_code_len;
-                                is_dbcs_mode = 0;
-                            }
-                        }
-                    } else {
-                        // In SBCS mode
-                        // Decide to switch to DBCS? 30%
-                        // Need space: Start Code + Char (2) + End Code = minimal block
-                        
-                        int remaining = length - i;
-                        int want_switch = ((rand() % 100) < 30);
-                        
-                        if (want_switch && remaining >= (int)(config->start_code_len + 2 + config->end_code_len)) {
-                            memcpy(&buffer[i], config->start_code, config->start_code_len);
-                            i += config->start_code_len;
-                            is_dbcs_mode = 1;
-                        } else {
-                            // Write SBCS char (JIS X 0201 / ASCII)
-                            // Avoid 0x1B (ESC) in random data for ISO-2022-JP purity.
-                            // Restrict to 7-bit ASCII (0x20 - 0x7E) to avoid invalid ISO-2022-JP bytes.
-                            // 8-bit Katakana (0xA1-0xDF) requires ESC ( I invocations in ISO-2022-JP, 
-                            // but here we are treating SBCS as default ASCII state (ESC ( B).
-                            
-                            unsigned char ch;
-                            do {
-                                // ASCII only
-                                ch = (rand() % (0x7E - 0x20 + 1)) + 0x20;
-                            } while (ch == 0x1B); // Avoid ESC
-                            
-                            buffer[i++] = ch;
-                        }
-                    }
-                }
-                // Loop ends. Ensure we are in SBCS?
-                // The logic guarantees we switch back if remaining <= end_code_len.
-                // However, if we hit exact end, we must imply we are done.
-                
-                // Safety check: if we are somehow still in DBCS mode at end (shouldn't happen with correct logic),
-                // we can't do anything as buffer is full.
-                // The logic `if (remaining <= 1)` handles the last byte being End Code.
+                mbtext_fill_iso2022(rng, buffer, length, config);
             } else {
-                for (size_t i = 0; i < length; i++) {
-                    // Random printable ASCII (0x20 - 0x7E)
-                    buffer[i] = (rand() % (0x7E - 0x20 + 1)) + 0x20;
-                }
+                // Random printable characters (0x20 - 0x7E in ASCII)
+                codepage_fill_text(codepage_get(config->output_codepage), rng, buffer, length);
             }
         } else {
-            for (size_t i = 0; i < length; i++) {
-                buffer[i] = rand() % 256;
-            }
+            randfill_bytes(rng, buffer, length);
         }
     } else if (config->fill_type == FILL_PATTERN_HEX) {
         memset(buffer, config->single_byte_fill, length);
@@ -186,19 +69,19 @@ static void fill_buffer(unsigned char *buffer, size_t length, const Config *conf
             }
         } else {
             // Empty string pattern, fallback to default
-            memset(buffer, (config->data_mode == DATA_MODE_TEXT) ? 0x20 : 0x00, length);
+            memset(buffer, (config->data_mode == DATA_MODE_TEXT) ? codepage_get(config->output_codepage)->space : 0x00, length);
         }
     } else {
         // Default
-        memset(buffer, (config->data_mode == DATA_MODE_TEXT) ? 0x20 : 0x00, length);
+        memset(buffer, (config->data_mode == DATA_MODE_TEXT) ? codepage_get(config->output_codepage)->space : 0x00, length);
     }
 }
 
-static void write_rdw(FILE *out, size_t record_len, RdwEndian endian) {
+static void put_rdw(unsigned char *rdw, size_t record_len, RdwEndian endian) {
     // RDW is 4 bytes: LL LL 00 00
-    // LL is total length including RDW itself (record_len + 4)
+    // LL is total length including RDW itself (record_len + 4); the parser
+    // keeps unspanned records within the 16-bit limit.
     unsigned short total_len = (unsigned short)(record_len + 4);
-    unsigned char rdw[4] = {0, 0, 0, 0};
 
     if (endian == RDW_ENDIAN_BIG) {
         rdw[0] = (total_len >> 8) & 0xFF;
@@ -208,75 +91,1324 @@ static void write_rdw(FILE *out, size_t record_len, RdwEndian endian) {
         rdw[1] = (total_len >> 8) & 0xFF;
     }
     // Bytes 2 and 3 are reserved (0x00)
-
-    fwrite(rdw, 1, 4, out);
+    rdw[2] = 0;
+    rdw[3] = 0;
 }
 
-int generate_data(const Config *config, FILE *output_file) {
-    unsigned char *buffer = malloc(config->record_length);
-    if (!buffer) {
-        perror("Error allocating memory for record buffer");
-        return 1;
+// Everything the batch filler needs, derived once from the Config.
+typedef struct {
+    const Config *config;
+    unsigned char newline[2];  // Record delimiter in the output codepage
+    size_t newline_len;
+    size_t max_record_bytes;   // Largest record on disk (RDW/newline included)
+    size_t batch_records;      // Records per batch
+    size_t batch_count;
+    int has_plan;              // Records follow the compiled FIELD layout
+    GenPlan plan;
+    int has_mix;               // RECORD_TYPE: records follow the plan of their type
+    RecordMix mix;
+    LengthSampler lengths;     // VARIABLE records without a FIELD layout
+    KeyGen keys;               // KEY= (config->key_length > 0)
+    int fast;                  // RANDOM_QUALITY=FAST: records come from the entropy pool
+    EntropyPool pool;
+    int blocked;               // VB/VBS: batches hold length-prefixed records for the blocker
+    Stats *stats;              // --stats / --progress counters (NULL = off)
+    uint64_t record_key;       // Key of the per-record generators
+    Pacer *pacer;              // --rate / --duration streaming (NULL = off)
+} GenContext;
+
+static int init_context(GenContext *ctx, const Config *config) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->config = config;
+    ctx->record_key = prng_record_key(config->seed);
+    if (config->key_length > 0) {
+        key_init(&ctx->keys, config);
     }
 
-    const char *newline_str = NULL;
-    size_t newline_len = 0;
+    if (config->record_type_count > 0) {
+        if (mix_compile(&ctx->mix, config) != 0) {
+            return 1;
+        }
+        ctx->has_mix = 1;
+    } else if (config->field_count > 0) {
+        if (plan_compile(&ctx->plan, config) != 0) {
+            fprintf(stderr, "Error compiling the FIELD layout.\n");
+            return 1;
+        }
+        ctx->has_plan = 1;
+    }
 
     if (config->data_mode == DATA_MODE_TEXT) {
         switch (config->newline) {
-            case NEWLINE_LF: newline_str = "\n"; newline_len = 1; break;
-            case NEWLINE_CRLF: newline_str = "\r\n"; newline_len = 2; break;
-            case NEWLINE_CR: newline_str = "\r"; newline_len = 1; break;
-            case NEWLINE_NONE: newline_str = NULL; newline_len = 0; break;
+            case NEWLINE_LF: memcpy(ctx->newline, "\n", 1); ctx->newline_len = 1; break;
+            case NEWLINE_CRLF: memcpy(ctx->newline, "\r\n", 2); ctx->newline_len = 2; break;
+            case NEWLINE_CR: memcpy(ctx->newline, "\r", 1); ctx->newline_len = 1; break;
+            case NEWLINE_NONE: ctx->newline_len = 0; break;
         }
+        codepage_translate(codepage_get(config->output_codepage), ctx->newline, ctx->newline_len);
     }
 
     // For fixed length, if there is a newline, it's appended.
     // For variable length, usually newlines are NOT part of the structure unless payload contains them.
     // Specification says: "Even in FIXED mode... newline is appended after RECORD_LENGTH data".
-    // We will assume for Variable mode, we just write the payload inside RDW, potentially with newline if requested, 
-    // but typically variable length records in mainframe don't have newlines delimiters.
-    // However, if the user requested TEXT mode with NEWLINE, we should probably include it in the payload or append it?
     // Mainframe variable (RECFM=V) does NOT have delimiters. The RDW handles separation.
-    // If the user asks for text with newline in variable mode, it's ambiguous.
-    // I will implementation: 
+    // So we stick to:
     // FIXED: [DATA][NEWLINE]
-    // VARIABLE: [RDW][DATA]  (Ignoring newline for Variable unless user strongly implies otherwise, but let's stick to standard RECFM=V)
-    // Actually, if they want 'TEXT' mode and 'LF', they might expect standard unix text file behavior if they view it as stream.
-    // BUT the spec says "RDW is 4 bytes...". That implies binary structure (RECFM=V).
-    // Let's assume Newline is ONLY for FIXED text files to make them viewable, or if they explicitly want line breaks in the payload.
-    // For VARIABLE, I will NOT append newline outside the record. If it's inside, it increases length.
-    // Let's keep it simple: Newline is appended to the data payload if configured.
-    // If Variable, the RDW length includes the data + newline?
-    // Let's stick to: FIXED adds newline AFTER data. VARIABLE adds newline to DATA (so RDW covers it)?
-    // The safest bet for "Mainframe" style is:
-    // Fixed: Just data. (If newline requested, it's basically a Line Sequential file).
-    // Variable: RDW + Data. No "newline" delimiter usually.
-    // I will follow the spec: "Even in FIXED mode... the newline is appended...". 
-    // For Variable, I will assume Newline is NOT appended unless part of payload, but let's just warn or ignore for now if unclear.
-    // Let's assume for this tool, NEWLINE is a separator for FIXED. For VARIABLE, we just output RDW+DATA.
-    
-    for (size_t i = 0; i < config->record_count; i++) {
+    // VARIABLE: [RDW][DATA]  (newline is not written outside the record)
+    if (config->file_type == FILE_TYPE_VARIABLE) {
+        ctx->max_record_bytes = config->record_length + 4;
+        ctx->blocked = (config->block_size > 0);
+        if (!ctx->has_plan && !ctx->has_mix && length_sampler_init(&ctx->lengths, config) != 0) {
+            length_sampler_free(&ctx->lengths);
+            return 1;
+        }
+    } else {
+        ctx->max_record_bytes = config->record_length + ctx->newline_len;
+    }
+
+    // The batch size only depends on the record layout, never on the thread count.
+    ctx->batch_records = BATCH_TARGET_BYTES / ctx->max_record_bytes;
+    if (ctx->batch_records == 0) ctx->batch_records = 1;
+    // A rate-limited run writes one small batch per pacing quantum.
+    size_t paced = pacing_batch_records(config, ctx->max_record_bytes);
+    if (paced > 0 && paced < ctx->batch_records) ctx->batch_records = paced;
+    ctx->batch_count = (config->record_count + ctx->batch_records - 1) / ctx->batch_records;
+
+    // Without a FIELD layout (the parser rejects FAST with one).
+    if (config->random_quality == RANDOM_QUALITY_FAST && config->fill_type == FILL_PATTERN_RANDOM &&
+        !ctx->has_plan && !ctx->has_mix) {
+        if (entropy_pool_init(&ctx->pool, config, ctx->record_key) != 0) {
+            length_sampler_free(&ctx->lengths);
+            return 1;
+        }
+        ctx->fast = 1;
+    }
+    return 0;
+}
+
+static void free_context(GenContext *ctx) {
+    if (ctx->has_plan) {
+        plan_free(&ctx->plan);
+    }
+    if (ctx->has_mix) {
+        mix_free(&ctx->mix);
+    }
+    length_sampler_free(&ctx->lengths);
+    entropy_pool_free(&ctx->pool);
+}
+
+static void fill_record(const GenContext *ctx, const MixType *type, unsigned char *record, size_t length, Prng *rng,
+                        unsigned char *scratch) {
+    if (type) {
+        if (type->has_plan) {
+            plan_run(&type->plan, record, rng, scratch);
+        } else {
+            fill_buffer(record, length, type->config, rng);
+        }
+    } else if (ctx->has_plan) {
+        plan_run(&ctx->plan, record, rng, scratch);
+    } else if (ctx->fast) {
+        entropy_pool_fill(&ctx->pool, rng, record, length);
+    } else {
+        fill_buffer(record, length, ctx->config, rng);
+    }
+}
+
+// Per-worker scratch space for the random bits of a FIELD layout record.
+typedef struct {
+    unsigned char *scratch;
+} WorkerState;
+
+static int worker_state_init(WorkerState *state, const GenContext *ctx) {
+    size_t bits_length = ctx->has_mix ? ctx->mix.bits_length : ctx->has_plan ? ctx->plan.bits_length : 0;
+    state->scratch = NULL;
+    if (bits_length > 0) {
+        state->scratch = malloc(bits_length);
+        if (!state->scratch) {
+            perror("Error allocating memory for record buffer");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void worker_state_free(WorkerState *state) {
+    free(state->scratch);
+    state->scratch = NULL;
+}
+
+// Fills records first .. last-1 into `out` and returns the number of bytes produced.
+static size_t fill_records(const GenContext *ctx, WorkerState *state, size_t first, size_t last, unsigned char *out) {
+    const Config *config = ctx->config;
+    Prng rng;
+
+    // With statistics on, every STATS_SAMPLE_EVERY-th record has its phases
+    // timed; the counters are merged once at the end of the batch.
+    StatsCounters sc;
+    uint64_t batch_start = 0, t0 = 0, t1 = 0;
+    if (ctx->stats) {
+        memset(&sc, 0, sizeof(sc));
+        batch_start = stats_now_ns();
+    }
+    // Trailer totals of the batch (RECORD_TYPE)
+    int64_t totals[MIX_MAX_TOTALS];
+    if (ctx->has_mix) memset(totals, 0, sizeof(totals));
+
+    unsigned char *p = out;
+    for (size_t i = first; i < last; i++) {
         size_t current_len = config->record_length;
+        const MixType *type = NULL;
+        prng_seed_record(&rng, ctx->record_key, config->first_record + i);
+        int sample = ctx->stats && i % STATS_SAMPLE_EVERY == 0;
+        if (sample) t0 = stats_now_ns();
+        if (ctx->has_mix) {
+            type = mix_pick(&ctx->mix, &rng);
+            current_len = type->record_length;
+        }
 
         if (config->file_type == FILE_TYPE_VARIABLE) {
-            // Random length between 1 and MAX (config->record_length)
-            current_len = (rand() % config->record_length) + 1;
+            // Length drawn from LENGTH_DISTRIBUTION between MIN_RECORD_LENGTH
+            // and RECORD_LENGTH. A FIELD layout or a record type always
+            // produces the whole record.
+            if (!ctx->has_plan && !ctx->has_mix) {
+                current_len = length_sample(&ctx->lengths, &rng);
+            }
+            if (ctx->blocked) {
+                // Blocked records get their RDW/SDW from the blocker.
+                uint32_t n = (uint32_t)current_len;
+                memcpy(p, &n, 4);
+            } else {
+                put_rdw(p, current_len, config->rdw_endian);
+            }
+            p += 4;
+            if (sample) t1 = stats_now_ns();
+            fill_record(ctx, type, p, current_len, &rng, state->scratch);
+            if (config->key_length) key_write(&ctx->keys, config->first_record + i, p + config->key_offset);
+            if (type) mix_tally(&ctx->mix, type, p, totals);
+            p += current_len;
+            if (sample) {
+                uint64_t t2 = stats_now_ns();
+                sc.frame_ns += t1 - t0;
+                sc.fill_ns += t2 - t1;
+                sc.sampled++;
+            }
+            if (ctx->stats) stats_count_length(&sc, current_len);
+        } else {
+            fill_record(ctx, type, p, current_len, &rng, state->scratch);
+            if (config->key_length) key_write(&ctx->keys, config->first_record + i, p + config->key_offset);
+            if (type) mix_tally(&ctx->mix, type, p, totals);
+            p += current_len;
+            if (sample) t1 = stats_now_ns();
+            if (ctx->newline_len) {
+                memcpy(p, ctx->newline, ctx->newline_len);
+                p += ctx->newline_len;
+            }
+            if (sample) {
+                uint64_t t2 = stats_now_ns();
+                sc.fill_ns += t1 - t0;
+                sc.frame_ns += t2 - t1;
+                sc.sampled++;
+            }
         }
+    }
 
-        fill_buffer(buffer, current_len, config);
+    if (ctx->has_mix && ctx->mix.total_count > 0) {
+        mix_add(&ctx->mix, totals);
+    }
+    if (ctx->stats) {
+        sc.records = last - first;
+        sc.bytes = (uint64_t)(p - out);
+        sc.batch_ns = stats_now_ns() - batch_start;
+        stats_add(ctx->stats, &sc);
+    }
+    return (size_t)(p - out);
+}
 
-        if (config->file_type == FILE_TYPE_VARIABLE) {
-            write_rdw(output_file, current_len, config->rdw_endian);
-            fwrite(buffer, 1, current_len, output_file);
+// Fills the header or trailer record of a RECORD_TYPE file into `out`,
+// framed like the detail records, and returns the number of bytes produced.
+// The trailer must come after every detail record has been filled.
+static size_t fill_edge(const GenContext *ctx, WorkerState *state, const MixType *type, unsigned char *out) {
+    const Config *config = ctx->config;
+    size_t len = type->record_length;
+    unsigned char *p = out;
+    Prng rng;
+    prng_seed_record(&rng, prng_record_key(config->seed ^ EDGE_RECORD_SALT), type == ctx->mix.trailer);
+
+    if (config->file_type == FILE_TYPE_VARIABLE) {
+        if (ctx->blocked) {
+            uint32_t n = (uint32_t)len;
+            memcpy(p, &n, 4);
         } else {
-            fwrite(buffer, 1, current_len, output_file);
-            if (newline_str) {
-                fwrite(newline_str, 1, newline_len, output_file);
+            put_rdw(p, len, config->rdw_endian);
+        }
+        p += 4;
+    }
+    fill_record(ctx, type, p, len, &rng, state->scratch);
+    if (type == ctx->mix.trailer) mix_write_totals(&ctx->mix, p);
+    p += len;
+    if (config->file_type == FILE_TYPE_FIXED && ctx->newline_len) {
+        memcpy(p, ctx->newline, ctx->newline_len);
+        p += ctx->newline_len;
+    }
+    return (size_t)(p - out);
+}
+
+// Fills every record of one batch into `out` and returns the number of bytes produced.
+static size_t fill_batch(const GenContext *ctx, WorkerState *state, size_t batch, unsigned char *out) {
+    size_t first = batch * ctx->batch_records;
+    size_t last = first + ctx->batch_records;
+    if (last > ctx->config->record_count) last = ctx->config->record_count;
+    return fill_records(ctx, state, first, last, out);
+}
+
+// Counts a write done by a generating thread, plus the records it holds when
+// fill_batch() did not count them. With `started_ns` 0 the data went to the
+// output writer, which times and counts its own writes.
+static void count_write(Stats *stats, uint64_t started_ns, uint64_t records, uint64_t bytes, uint64_t written) {
+    if (!stats) return;
+    StatsCounters sc;
+    memset(&sc, 0, sizeof(sc));
+    sc.records = records;
+    sc.bytes = bytes;
+    sc.written = written;
+    sc.write_ns = started_ns ? stats_now_ns() - started_ns : 0;
+    stats_add(stats, &sc);
+}
+
+static int pwrite_all(int fd, const unsigned char *data, size_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, data, len, offset);
+        if (n < 0) {
+            perror("Error writing output file");
+            return 1;
+        }
+        data += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+// --- Parallel engine ---
+//
+// Workers claim batches in increasing order and fill them into per-thread
+// slots. In ordered mode the calling thread drains the slots in batch order
+// into the output writer. In positional mode (FIXED records on a regular
+// file) every batch offset is known in advance, so workers pwrite() their
+// batch straight to its final position and no ordering is needed.
+
+typedef enum {
+    SLOT_FREE,
+    SLOT_FILLING,
+    SLOT_READY
+} SlotState;
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t batch;
+    SlotState state;
+} BatchSlot;
+
+typedef struct {
+    GenContext ctx;
+    BatchSlot *slots;
+    size_t slot_count;
+    size_t next_batch;
+    size_t drained;     // Batches written by the ordered drain so far
+    int failed;
+    int stopped;        // The drain ended early (paced run over)
+    int positional;
+    int fd;
+    off_t base_offset;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Engine;
+
+static void *engine_worker(void *arg) {
+    Engine *eng = arg;
+    unsigned char *own = NULL;
+    WorkerState state;
+    int init_failed = worker_state_init(&state, &eng->ctx);
+
+    if (!init_failed && eng->positional) {
+        own = malloc(eng->ctx.batch_records * eng->ctx.max_record_bytes);
+        if (!own) {
+            perror("Error allocating memory for record buffer");
+            init_failed = 1;
+        }
+    }
+    if (init_failed) {
+        worker_state_free(&state);
+        pthread_mutex_lock(&eng->lock);
+        eng->failed = 1;
+        pthread_mutex_unlock(&eng->lock);
+        return NULL;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&eng->lock);
+        if (eng->failed || eng->stopped || eng->next_batch >= eng->ctx.batch_count) {
+            pthread_mutex_unlock(&eng->lock);
+            break;
+        }
+        size_t batch = eng->next_batch++;
+        BatchSlot *slot = NULL;
+        if (!eng->positional) {
+            slot = &eng->slots[batch % eng->slot_count];
+            // The slot still holds an older batch until the writer has drained it.
+            // Waiting on the drain position (not just the slot state) keeps a later
+            // batch that maps to the same slot from taking it first.
+            while (batch >= eng->drained + eng->slot_count && !eng->failed && !eng->stopped) {
+                pthread_cond_wait(&eng->cond, &eng->lock);
             }
+            if (eng->failed || eng->stopped) {
+                pthread_mutex_unlock(&eng->lock);
+                break;
+            }
+            slot->state = SLOT_FILLING;
+            slot->batch = batch;
+        }
+        pthread_mutex_unlock(&eng->lock);
+
+        if (eng->positional) {
+            size_t len = fill_batch(&eng->ctx, &state, batch, own);
+            off_t offset = eng->base_offset +
+                (off_t)(batch * eng->ctx.batch_records * eng->ctx.max_record_bytes);
+            uint64_t started = eng->ctx.stats ? stats_now_ns() : 0;
+            int rc = pwrite_all(eng->fd, own, len, offset);
+            count_write(eng->ctx.stats, started, 0, 0, len);
+            if (rc != 0) {
+                pthread_mutex_lock(&eng->lock);
+                eng->failed = 1;
+                pthread_mutex_unlock(&eng->lock);
+                break;
+            }
+        } else {
+            size_t len = fill_batch(&eng->ctx, &state, batch, slot->data);
+            pthread_mutex_lock(&eng->lock);
+            slot->len = len;
+            slot->state = SLOT_READY;
+            pthread_cond_broadcast(&eng->cond);
+            pthread_mutex_unlock(&eng->lock);
         }
     }
 
-    free(buffer);
+    free(own);
+    worker_state_free(&state);
+    return NULL;
+}
+
+// Destination of the finished batches, in batch order. Blocked output has
+// the records of each batch re-packed into VB/VBS blocks on the way, so the
+// blocks do not depend on the batch boundaries. A paced stream writes each
+// batch itself when it is due.
+typedef struct {
+    OutputWriter *out;
+    Blocker *blocker;
+    Pacer *pacer;
+} BatchSink;
+
+static int sink_batch(BatchSink *sink, const unsigned char *data, size_t len) {
+    if (!sink->blocker) {
+        return output_write(sink->out, data, len);
+    }
+    const unsigned char *end = data + len;
+    while (data < end) {
+        uint32_t n;
+        memcpy(&n, data, 4);
+        if (blocker_add(sink->blocker, data + 4, n) != 0) return 1;
+        data += 4 + (size_t)n;
+    }
+    return 0;
+}
+
+static int engine_drain(Engine *eng, BatchSink *sink) {
+    for (size_t batch = 0; batch < eng->ctx.batch_count; batch++) {
+        BatchSlot *slot = &eng->slots[batch % eng->slot_count];
+
+        pthread_mutex_lock(&eng->lock);
+        while (!(slot->state == SLOT_READY && slot->batch == batch) && !eng->failed) {
+            pthread_cond_wait(&eng->cond, &eng->lock);
+        }
+        int failed = eng->failed;
+        pthread_mutex_unlock(&eng->lock);
+        if (failed) return 1;
+
+        int rc, stop = 0;
+        if (sink->pacer) {
+            size_t records = eng->ctx.config->record_count - batch * eng->ctx.batch_records;
+            if (records > eng->ctx.batch_records) records = eng->ctx.batch_records;
+            rc = pacer_write(sink->pacer, slot->data, slot->len, records);
+            count_write(eng->ctx.stats, 0, 0, 0, slot->len);
+            stop = pacer_done(sink->pacer);
+        } else {
+            rc = sink_batch(sink, slot->data, slot->len);
+        }
+
+        pthread_mutex_lock(&eng->lock);
+        if (rc != 0) {
+            eng->failed = 1;
+        } else {
+            slot->state = SLOT_FREE;
+            eng->drained = batch + 1;
+            eng->stopped = stop;
+        }
+        pthread_cond_broadcast(&eng->cond);
+        pthread_mutex_unlock(&eng->lock);
+        if (rc != 0) return 1;
+        if (stop) break;
+    }
     return 0;
 }
+
+// FIXED records have a known offset, so shards can go straight to the file
+// when it is seekable. Pipes and other streams use the ordered path, and so
+// do O_DIRECT and compressed output, which need the blocks of the output writer.
+static int can_write_positional(const Config *config, FILE *output_file) {
+    struct stat st;
+    return config->file_type == FILE_TYPE_FIXED && !config->direct_io &&
+        config->compression == COMPRESS_NONE &&
+        fstat(fileno(output_file), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// Runs the worker pool. With a sink the batches are written to it in order,
+// otherwise they are pwrite()n to their offsets in the file.
+static int generate_parallel(const GenContext *ctx, size_t threads, FILE *output_file, BatchSink *sink) {
+    Engine eng;
+    memset(&eng, 0, sizeof(eng));
+    eng.ctx = *ctx;
+    eng.fd = fileno(output_file);
+
+    if (!sink) {
+        if (fflush(output_file) != 0) {
+            perror("Error writing output file");
+            return 1;
+        }
+        eng.base_offset = ftello(output_file);
+        if (eng.base_offset < 0) {
+            perror("Error writing output file");
+            return 1;
+        }
+        eng.positional = 1;
+    }
+
+    if (!eng.positional) {
+        eng.slot_count = threads * 2;
+        if (sink->pacer) {
+            // Paced batches are small: keep a deeper ring generated ahead of the writer.
+            size_t ahead = PACE_RING_BYTES / (ctx->batch_records * ctx->max_record_bytes);
+            if (ahead > PACE_RING_BATCHES) ahead = PACE_RING_BATCHES;
+            if (ahead > eng.slot_count) eng.slot_count = ahead;
+        }
+        eng.slots = calloc(eng.slot_count, sizeof(BatchSlot));
+        if (!eng.slots) {
+            perror("Error allocating memory for record buffer");
+            return 1;
+        }
+        for (size_t s = 0; s < eng.slot_count; s++) {
+            eng.slots[s].data = malloc(ctx->batch_records * ctx->max_record_bytes);
+            if (!eng.slots[s].data) {
+                perror("Error allocating memory for record buffer");
+                for (size_t k = 0; k < s; k++) free(eng.slots[k].data);
+                free(eng.slots);
+                return 1;
+            }
+        }
+    }
+
+    pthread_mutex_init(&eng.lock, NULL);
+    pthread_cond_init(&eng.cond, NULL);
+
+    pthread_t *tids = malloc(threads * sizeof(pthread_t));
+    size_t started = 0;
+    if (tids) {
+        for (; started < threads; started++) {
+            if (pthread_create(&tids[started], NULL, engine_worker, &eng) != 0) break;
+        }
+    }
+
+    int rc = 0;
+    if (started == 0) {
+        fprintf(stderr, "Error: could not start worker threads.\n");
+        rc = 1;
+    } else if (!eng.positional) {
+        rc = engine_drain(&eng, sink);
+    }
+
+    if (rc != 0) {
+        pthread_mutex_lock(&eng.lock);
+        eng.failed = 1;
+        pthread_cond_broadcast(&eng.cond);
+        pthread_mutex_unlock(&eng.lock);
+    }
+    for (size_t t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    if (eng.failed) rc = 1;
+
+    if (eng.positional && rc == 0) {
+        // Leave the stream positioned after the generated data.
+        off_t end = eng.base_offset +
+            (off_t)(ctx->config->record_count * ctx->max_record_bytes);
+        if (fseeko(output_file, end, SEEK_SET) != 0) {
+            perror("Error writing output file");
+            rc = 1;
+        }
+    }
+
+    free(tids);
+    if (eng.slots) {
+        for (size_t s = 0; s < eng.slot_count; s++) free(eng.slots[s].data);
+        free(eng.slots);
+    }
+    pthread_cond_destroy(&eng.cond);
+    pthread_mutex_destroy(&eng.lock);
+    return rc;
+}
+
+// --- Mapped output (--mmap) ---
+//
+// FIXED records on a regular file: the file is extended to its final size
+// up front and workers fill their batches straight into a shared mapping,
+// so records are never copied after generation. The file is mapped one
+// window of whole batches at a time; a window is unmapped as soon as it is
+// filled and its writeback started, which keeps both the mapped and the
+// dirty memory bounded by a few windows per thread.
+
+typedef struct {
+    const GenContext *ctx;
+    int fd;
+    off_t base_offset;
+    size_t window_batches;
+    size_t window_count;
+    size_t next_window;
+    size_t page_size;
+    int failed;
+    pthread_mutex_t lock;
+} MappedOutput;
+
+static int fill_window(MappedOutput *mo, WorkerState *state, size_t window) {
+    const GenContext *ctx = mo->ctx;
+    size_t batch_bytes = ctx->batch_records * ctx->max_record_bytes;
+    size_t first = window * mo->window_batches;
+    size_t last = first + mo->window_batches;
+    if (last > ctx->batch_count) last = ctx->batch_count;
+
+    // Mappings start on a page boundary; neighbouring windows may share a page.
+    off_t start = mo->base_offset + (off_t)(first * batch_bytes);
+    off_t end = mo->base_offset + (off_t)(ctx->config->record_count * ctx->max_record_bytes);
+    if (last < ctx->batch_count) end = mo->base_offset + (off_t)(last * batch_bytes);
+    off_t map_start = start - start % (off_t)mo->page_size;
+    size_t map_len = (size_t)(end - map_start);
+
+    unsigned char *map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, mo->fd, map_start);
+    if (map == MAP_FAILED) {
+        perror("Error mapping output file");
+        return 1;
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(map, map_len, MADV_HUGEPAGE);
+#endif
+    madvise(map, map_len, MADV_SEQUENTIAL);
+
+    unsigned char *p = map + (start - map_start);
+    for (size_t batch = first; batch < last; batch++) {
+        p += fill_batch(ctx, state, batch, p);
+    }
+
+    uint64_t started = ctx->stats ? stats_now_ns() : 0;
+    int rc = 0;
+    if (munmap(map, map_len) != 0) {
+        perror("Error unmapping output file");
+        rc = 1;
+    }
+    // Start writing the window back now rather than when the dirty limit is hit.
+    sync_file_range(mo->fd, start, end - start, SYNC_FILE_RANGE_WRITE);
+    count_write(ctx->stats, started, 0, 0, (uint64_t)(end - start));
+    return rc;
+}
+
+static void *mapped_worker(void *arg) {
+    MappedOutput *mo = arg;
+    WorkerState state;
+    int rc = worker_state_init(&state, mo->ctx);
+
+    while (rc == 0) {
+        pthread_mutex_lock(&mo->lock);
+        if (mo->failed || mo->next_window >= mo->window_count) {
+            pthread_mutex_unlock(&mo->lock);
+            break;
+        }
+        size_t window = mo->next_window++;
+        pthread_mutex_unlock(&mo->lock);
+
+        rc = fill_window(mo, &state, window);
+    }
+    if (rc != 0) {
+        pthread_mutex_lock(&mo->lock);
+        mo->failed = 1;
+        pthread_mutex_unlock(&mo->lock);
+    }
+    worker_state_free(&state);
+    return NULL;
+}
+
+static int generate_mapped(const GenContext *ctx, size_t threads, FILE *output_file) {
+    MappedOutput mo;
+    memset(&mo, 0, sizeof(mo));
+    mo.ctx = ctx;
+    mo.fd = fileno(output_file);
+    long page = sysconf(_SC_PAGESIZE);
+    mo.page_size = (page > 0) ? (size_t)page : 4096;
+
+    if (fflush(output_file) != 0 || (mo.base_offset = ftello(output_file)) < 0) {
+        perror("Error writing output file");
+        return 1;
+    }
+    off_t total = (off_t)(ctx->config->record_count * ctx->max_record_bytes);
+    if (total == 0) return 0;
+
+    // Allocate the blocks up front, so a full disk is an error here and not
+    // a SIGBUS on a page fault later. File systems without fallocate get a
+    // sparse file.
+    if (ftruncate(mo.fd, mo.base_offset + total) != 0) {
+        perror("Error extending output file");
+        return 1;
+    }
+    int err = posix_fallocate(mo.fd, mo.base_offset, total);
+    if (err != 0 && err != EOPNOTSUPP && err != EINVAL) {
+        errno = err;
+        perror("Error allocating output file");
+        return 1;
+    }
+
+    size_t batch_bytes = ctx->batch_records * ctx->max_record_bytes;
+    mo.window_batches = MMAP_WINDOW_BYTES / batch_bytes;
+    if (mo.window_batches == 0) mo.window_batches = 1;
+    mo.window_count = (ctx->batch_count + mo.window_batches - 1) / mo.window_batches;
+    if (threads > mo.window_count) threads = mo.window_count;
+    pthread_mutex_init(&mo.lock, NULL);
+
+    // The calling thread is one of the workers.
+    pthread_t *tids = (threads > 1) ? malloc((threads - 1) * sizeof(pthread_t)) : NULL;
+    size_t started = 0;
+    if (tids) {
+        for (; started < threads - 1; started++) {
+            if (pthread_create(&tids[started], NULL, mapped_worker, &mo) != 0) break;
+        }
+    }
+    mapped_worker(&mo);
+    for (size_t t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    free(tids);
+    pthread_mutex_destroy(&mo.lock);
+
+    int rc = mo.failed;
+    if (rc == 0 && fseeko(output_file, mo.base_offset + total, SEEK_SET) != 0) {
+        perror("Error writing output file");
+        rc = 1;
+    }
+    return rc;
+}
+
+static size_t resolve_threads(const Config *config) {
+    if (config->threads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        return (n > 0) ? (size_t)n : 1;
+    }
+    return config->threads;
+}
+
+// Opens the block writer for the config. `threads` also sizes the
+// compression pool.
+static OutputWriter *open_writer(const GenContext *ctx, FILE *output_file, size_t max_reserve, size_t threads) {
+    const Config *config = ctx->config;
+    OutputOptions options;
+    options.block_size = config->output_block_size;
+    options.direct_io = config->direct_io;
+    options.max_reserve = max_reserve;
+    options.compression = config->compression;
+    options.compression_level = config->compression_level;
+    options.compression_threads = threads;
+    options.stats = ctx->stats ? stats_output(ctx->stats) : NULL;
+    return output_open(output_file, &options);
+}
+
+// --- Constant records ---
+//
+// With a HEX or STRING fill (or the default padding) every FIXED record is
+// byte-for-byte the same, so one block of replicated records is built once.
+// On a regular file the first block is written and the file is then doubled
+// in place with copy_file_range(), which the kernel can serve by reflinking
+// or by copying without a round trip through user space. Other outputs
+// (pipes, O_DIRECT, compression) get the block streamed through the output
+// writer.
+
+static int is_constant_output(const Config *config) {
+    return config->file_type == FILE_TYPE_FIXED && config->fill_type != FILL_PATTERN_RANDOM &&
+        config->field_count == 0 && config->key_length == 0 && config->record_type_count == 0;
+}
+
+// Duplicates [base, base + done) after itself until `total` bytes exist.
+// Returns the number of bytes present when copying stopped (== total on success).
+static size_t double_in_file(const GenContext *ctx, int fd, off_t base, size_t done, size_t total) {
+    size_t rb = ctx->max_record_bytes;
+    size_t chunk = CONSTANT_COPY_CHUNK - CONSTANT_COPY_CHUNK % rb;
+    if (chunk == 0) chunk = rb;
+    while (done < total) {
+        size_t len = total - done;
+        if (len > done) len = done;
+        if (len > chunk) len = chunk;
+
+        // The content is periodic in the record size and `done` is a whole
+        // number of records, so copying from the start always fits.
+        loff_t in = base;
+        loff_t at = base + (off_t)done;
+        uint64_t started = ctx->stats ? stats_now_ns() : 0;
+        ssize_t n = copy_file_range(fd, &in, fd, &at, len, 0);
+        if (n <= 0) break;
+        // Keep `done` on a record boundary: a partial record at the end of a
+        // short copy is copied (or written) again.
+        size_t whole = (size_t)n - (size_t)n % rb;
+        if (whole == 0) break;
+        count_write(ctx->stats, started, whole / rb, whole, whole);
+        done += whole;
+    }
+    return done;
+}
+
+static int generate_constant(const GenContext *ctx, FILE *output_file) {
+    const Config *config = ctx->config;
+    size_t record_bytes = ctx->max_record_bytes;
+    size_t total_records = config->record_count;
+
+    size_t block_records = CONSTANT_BLOCK_BYTES / record_bytes;
+    if (block_records > total_records) block_records = total_records;
+    // Room for the one record built below, even in a file of none.
+    if (block_records == 0) block_records = 1;
+    size_t block_len = block_records * record_bytes;
+
+    unsigned char *block = malloc(block_len);
+    if (!block) {
+        perror("Error allocating memory for record buffer");
+        return 1;
+    }
+
+    // Build one record, then replicate it by doubling.
+    Prng unused;
+    prng_seed(&unused, config->seed);
+    fill_buffer(block, config->record_length, config, &unused);
+    if (ctx->newline_len) {
+        memcpy(block + config->record_length, ctx->newline, ctx->newline_len);
+    }
+    for (size_t have = record_bytes; have < block_len; ) {
+        size_t n = (have < block_len - have) ? have : block_len - have;
+        memcpy(block + have, block, n);
+        have += n;
+    }
+
+    size_t total = total_records * record_bytes;
+    int rc = 0;
+    struct stat st;
+    int fd = fileno(output_file);
+
+    if (!config->direct_io && config->compression == COMPRESS_NONE &&
+        fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        off_t base;
+        if (fflush(output_file) != 0 || (base = ftello(output_file)) < 0) {
+            perror("Error writing output file");
+            free(block);
+            return 1;
+        }
+
+        size_t first = (total < block_len) ? total : block_len;
+        uint64_t started = ctx->stats ? stats_now_ns() : 0;
+        rc = pwrite_all(fd, block, first, base);
+        count_write(ctx->stats, started, first / record_bytes, first, first);
+        size_t done = (rc == 0 && first > 0) ? double_in_file(ctx, fd, base, first, total) : total;
+
+        // copy_file_range() is unavailable or stopped early (e.g. across file
+        // systems or on old kernels): finish with plain block writes.
+        while (rc == 0 && done < total) {
+            size_t n = total - done;
+            if (n > block_len) n = block_len;
+            started = ctx->stats ? stats_now_ns() : 0;
+            rc = pwrite_all(fd, block, n, base + (off_t)done);
+            count_write(ctx->stats, started, n / record_bytes, n, n);
+            done += n;
+        }
+
+        if (rc == 0 && fseeko(output_file, base + (off_t)total, SEEK_SET) != 0) {
+            perror("Error writing output file");
+            rc = 1;
+        }
+    } else {
+        OutputWriter *out = open_writer(ctx, output_file, 0, resolve_threads(config));
+        if (!out) {
+            free(block);
+            return 1;
+        }
+        for (size_t done = 0; done < total && rc == 0; ) {
+            size_t n = total - done;
+            if (n > block_len) n = block_len;
+            rc = output_write(out, block, n);
+            count_write(ctx->stats, 0, n / record_bytes, n, 0);
+            done += n;
+        }
+        if (output_close(out) != 0) rc = 1;
+    }
+
+    free(block);
+    return rc;
+}
+
+// Writes the header, or after the details the trailer, of a RECORD_TYPE
+// file (nothing for a NULL type): through the sink, or at the stream
+// position when the details go straight to their offsets in the file.
+static int write_edge(const GenContext *ctx, const MixType *type, FILE *output_file, BatchSink *sink) {
+    if (!type) return 0;
+    WorkerState state;
+    unsigned char *record = NULL;
+    int rc = worker_state_init(&state, ctx);
+    if (rc == 0 && !(record = malloc(ctx->max_record_bytes))) {
+        perror("Error allocating memory for record buffer");
+        rc = 1;
+    }
+    if (rc == 0) {
+        size_t len = fill_edge(ctx, &state, type, record);
+        if (sink) {
+            rc = sink_batch(sink, record, len);
+        } else if (fwrite(record, 1, len, output_file) != len) {
+            perror("Error writing output file");
+            rc = 1;
+        }
+    }
+    free(record);
+    worker_state_free(&state);
+    return rc;
+}
+
+static int generate_records(const GenContext *ctx, FILE *output_file) {
+    const Config *config = ctx->config;
+
+    if (!ctx->pacer && is_constant_output(config)) {
+        return generate_constant(ctx, output_file);
+    }
+
+    size_t threads = resolve_threads(config);
+    if (threads > ctx->batch_count) threads = ctx->batch_count;
+
+    if (ctx->pacer) {
+        // Even one worker generates ahead of the writing thread, so a slow
+        // reader does not hold up generation.
+        if (fflush(output_file) != 0) {
+            perror("Error writing output file");
+            return 1;
+        }
+        BatchSink sink = { NULL, NULL, ctx->pacer };
+        return generate_parallel(ctx, threads, output_file, &sink);
+    }
+
+    if (config->mmap_output) {
+        if (can_write_positional(config, output_file)) {
+            if (write_edge(ctx, ctx->mix.header, output_file, NULL) != 0 ||
+                generate_mapped(ctx, threads, output_file) != 0) {
+                return 1;
+            }
+            return write_edge(ctx, ctx->mix.trailer, output_file, NULL);
+        }
+        fprintf(stderr, "Warning: --mmap needs FIXED records written uncompressed and without DIRECT_IO "
+                        "to a regular file; writing normally.\n");
+    }
+
+    if (threads > 1 && can_write_positional(config, output_file)) {
+        if (write_edge(ctx, ctx->mix.header, output_file, NULL) != 0 ||
+            generate_parallel(ctx, threads, output_file, NULL) != 0) {
+            return 1;
+        }
+        return write_edge(ctx, ctx->mix.trailer, output_file, NULL);
+    }
+
+    size_t batch_bytes = ctx->batch_records * ctx->max_record_bytes;
+    size_t max_reserve = ctx->blocked ? config->block_size : batch_bytes;
+    OutputWriter *out = open_writer(ctx, output_file, max_reserve, threads);
+    if (!out) {
+        return 1;
+    }
+
+    Blocker blocker;
+    BatchSink sink = { out, NULL, NULL };
+    if (ctx->blocked) {
+        blocker_init(&blocker, out, config);
+        sink.blocker = &blocker;
+    }
+
+    int rc = write_edge(ctx, ctx->mix.header, output_file, &sink);
+    if (rc == 0 && threads > 1) {
+        rc = generate_parallel(ctx, threads, output_file, &sink);
+    } else if (rc == 0 && ctx->blocked) {
+        // Single thread, blocked: each batch is re-packed from a private buffer.
+        WorkerState state;
+        unsigned char *buffer = NULL;
+        rc = worker_state_init(&state, ctx);
+        if (rc == 0 && !(buffer = malloc(batch_bytes))) {
+            perror("Error allocating memory for record buffer");
+            rc = 1;
+        }
+        for (size_t batch = 0; batch < ctx->batch_count && rc == 0; batch++) {
+            size_t len = fill_batch(ctx, &state, batch, buffer);
+            rc = sink_batch(&sink, buffer, len);
+        }
+        worker_state_free(&state);
+        free(buffer);
+    } else if (rc == 0) {
+        // Single thread: batches are filled straight into the output blocks.
+        WorkerState state;
+        rc = worker_state_init(&state, ctx);
+
+        for (size_t batch = 0; batch < ctx->batch_count && rc == 0; batch++) {
+            unsigned char *dst = output_reserve(out, max_reserve);
+            size_t len = fill_batch(ctx, &state, batch, dst);
+            rc = output_commit(out, len);
+        }
+        worker_state_free(&state);
+    }
+
+    if (rc == 0) {
+        rc = write_edge(ctx, ctx->mix.trailer, output_file, &sink);
+    }
+    if (rc == 0 && ctx->blocked) {
+        rc = blocker_finish(&blocker);
+    }
+    if (output_close(out) != 0) {
+        rc = 1;
+    }
+    return rc;
+}
+
+// --- Checkpoints ---
+//
+// A checkpointed run is generated in segments of about checkpoint_bytes,
+// each one like a --range run appended to the file, so the output is the
+// same as without checkpoints. After every segment the file is synced and
+// only then is the checkpoint replaced; a resumed run starts with the first
+// record the checkpoint does not count, at the file size it gives.
+
+// Makes the output durable up to its current end and records it.
+static int save_checkpoint(const GenContext *ctx, FILE *output_file, size_t done) {
+    const Config *config = ctx->config;
+    int fd = fileno(output_file);
+    // The output writer and pwrite() bypass the stdio position: take the
+    // descriptor's and hand it back to the stream.
+    off_t end;
+    if (fflush(output_file) != 0 || (end = lseek(fd, 0, SEEK_CUR)) < 0 ||
+        fseeko(output_file, end, SEEK_SET) != 0 || fdatasync(fd) != 0) {
+        perror("Error syncing output file");
+        return 1;
+    }
+
+    Checkpoint cp;
+    cp.seed = config->seed;
+    cp.definition = config->definition_hash;
+    cp.first_record = config->first_record;
+    cp.record_count = config->record_count;
+    cp.records_done = done;
+    cp.output_bytes = (uint64_t)end;
+    return checkpoint_write(config->checkpoint_path, &cp);
+}
+
+static int generate_checkpointed(GenContext *ctx, FILE *output_file) {
+    const Config *config = ctx->config;
+    size_t batch_bytes = ctx->batch_records * ctx->max_record_bytes;
+    size_t segment_batches = config->checkpoint_bytes / batch_bytes;
+    if (segment_batches == 0) segment_batches = 1;
+    size_t segment = segment_batches * ctx->batch_records;
+
+    Config part = *config;
+    int rc = 0;
+    for (size_t done = config->resume_records; done < config->record_count && rc == 0; ) {
+        size_t n = config->record_count - done;
+        if (n > segment) n = segment;
+        part.first_record = config->first_record + done;
+        part.record_count = n;
+        // O_DIRECT only while segments end on its alignment (FIXED records
+        // of a suitable size); the writer would otherwise warn every time.
+        off_t at = ftello(output_file);
+        part.direct_io = config->direct_io && at >= 0 && at % OUTPUT_ALIGNMENT == 0;
+        ctx->config = &part;
+        ctx->batch_count = (n + ctx->batch_records - 1) / ctx->batch_records;
+        rc = generate_records(ctx, output_file);
+        ctx->config = config;
+        if (rc == 0) {
+            done += n;
+            rc = save_checkpoint(ctx, output_file, done);
+        }
+    }
+
+    // A finished file needs no checkpoint.
+    if (rc == 0 && unlink(config->checkpoint_path) != 0 && errno != ENOENT) {
+        perror("Error removing checkpoint");
+    }
+    return rc;
+}
+
+int generate_init(void) {
+    randfill_init();
+    codepage_init();
+    if (mbtext_init() != 0) {
+        fprintf(stderr, "Error initializing multibyte text tables.\n");
+        return 1;
+    }
+    return 0;
+}
+
+const char *generate_output_mode(const char *path) {
+    struct stat st;
+    return (stat(path, &st) == 0 && !S_ISREG(st.st_mode)) ? "wb" : "w+b";
+}
+
+int generate_data(const Config *config, FILE *output_file) {
+    if (generate_init() != 0) {
+        return 1;
+    }
+
+    // --duration ignores RECORD_COUNT: records are numbered on until the run ends.
+    Config timed;
+    if (config->timed) {
+        timed = *config;
+        timed.record_count = PACE_UNBOUNDED_RECORDS;
+        config = &timed;
+    }
+
+    GenContext ctx;
+    if (init_context(&ctx, config) != 0) {
+        return 1;
+    }
+
+    // Before the statistics reporter, so that every thread inherits the signal mask.
+    if (config->rate > 0 || config->timed) {
+        ctx.pacer = pacer_create(config, fileno(output_file));
+        if (!ctx.pacer) {
+            free_context(&ctx);
+            return 1;
+        }
+    }
+
+    // A resumed run reports progress over the records still to generate.
+    Config remaining = *config;
+    remaining.record_count -= config->resume_records;
+    if (config->stats || config->progress) {
+        ctx.stats = stats_create(&remaining, resolve_threads(config));
+        if (!ctx.stats) {
+            pacer_finish(ctx.pacer);
+            free_context(&ctx);
+            return 1;
+        }
+    }
+
+    int rc = config->checkpoint_path ? generate_checkpointed(&ctx, output_file)
+                                     : generate_records(&ctx, output_file);
+    pacer_finish(ctx.pacer);
+
+    if (ctx.stats && stats_finish(ctx.stats) != 0) {
+        rc = 1;
+    }
+    free_context(&ctx);
+    return rc;
+}
+
+// --- Split jobs ---
+
+struct GenSplit {
+    GenContext ctx;
+    int fd;
+    off_t base_offset;
+    size_t parts;
+    size_t batches_per_part;
+};
+
+GenSplit *generate_split_open(const Config *config, FILE *output_file, size_t max_parts) {
+    // Header and trailer records are written by generate_data().
+    if (max_parts < 2 || is_constant_output(config) || config->record_type_count > 0 ||
+        !can_write_positional(config, output_file)) {
+        return NULL;
+    }
+
+    GenSplit *split = calloc(1, sizeof(GenSplit));
+    if (!split) {
+        perror("Error allocating memory for record buffer");
+        return NULL;
+    }
+    if (init_context(&split->ctx, config) != 0) {
+        free(split);
+        return NULL;
+    }
+    if (split->ctx.batch_count < 2 ||
+        fflush(output_file) != 0 || (split->base_offset = ftello(output_file)) < 0) {
+        generate_split_close(split);
+        return NULL;
+    }
+    split->fd = fileno(output_file);
+
+    size_t parts = (split->ctx.batch_count < max_parts) ? split->ctx.batch_count : max_parts;
+    split->batches_per_part = (split->ctx.batch_count + parts - 1) / parts;
+    split->parts = (split->ctx.batch_count + split->batches_per_part - 1) / split->batches_per_part;
+    return split;
+}
+
+size_t generate_split_parts(const GenSplit *split) {
+    return split->parts;
+}
+
+int generate_split_run(GenSplit *split, size_t part) {
+    const GenContext *ctx = &split->ctx;
+    size_t first = part * split->batches_per_part;
+    size_t last = first + split->batches_per_part;
+    if (last > ctx->batch_count) last = ctx->batch_count;
+
+    WorkerState state;
+    unsigned char *buffer = NULL;
+    int rc = worker_state_init(&state, ctx);
+    if (rc == 0 && !(buffer = malloc(ctx->batch_records * ctx->max_record_bytes))) {
+        perror("Error allocating memory for record buffer");
+        rc = 1;
+    }
+    for (size_t batch = first; batch < last && rc == 0; batch++) {
+        size_t len = fill_batch(ctx, &state, batch, buffer);
+        off_t offset = split->base_offset +
+            (off_t)(batch * ctx->batch_records * ctx->max_record_bytes);
+        rc = pwrite_all(split->fd, buffer, len, offset);
+    }
+    free(buffer);
+    worker_state_free(&state);
+    return rc;
+}
+
+void generate_split_close(GenSplit *split) {
+    if (!split) return;
+    free_context(&split->ctx);
+    free(split);
+}
+
+// --- Record stream ---
+
+struct GenStream {
+    GenContext ctx;
+    WorkerState state;
+    size_t next_record;   // Index of the next record to hand out
+    int owns_config;      // Opened from a definition text: `config` is ours
+    Config config;
+};
+
+static GenStream *stream_open(GenStream *stream) {
+    const Config *config = stream->ctx.config;
+    if (config->block_size > 0) {
+        fprintf(stderr, "Error: blocked files (BLOCK_SIZE) can only be written to a file.\n");
+        return NULL;
+    }
+    if (config->record_type_count > 0) {
+        fprintf(stderr, "Error: files with RECORD_TYPE sections can only be written to a file.\n");
+        return NULL;
+    }
+    if (generate_init() != 0) {
+        return NULL;
+    }
+    if (init_context(&stream->ctx, config) != 0) {
+        return NULL;
+    }
+    if (worker_state_init(&stream->state, &stream->ctx) != 0) {
+        free_context(&stream->ctx);
+        return NULL;
+    }
+    return stream;
+}
+
+GenStream *generate_stream_open(const Config *config) {
+    GenStream *stream = calloc(1, sizeof(GenStream));
+    if (!stream) {
+        perror("Error allocating memory for record buffer");
+        return NULL;
+    }
+    stream->ctx.config = config;
+    if (!stream_open(stream)) {
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+GenStream *generate_stream_open_definition(const char *definition) {
+    GenStream *stream = calloc(1, sizeof(GenStream));
+    if (!stream) {
+        perror("Error allocating memory for record buffer");
+        return NULL;
+    }
+    stream->config.newline = NEWLINE_LF;
+    stream->config.rdw_endian = RDW_ENDIAN_BIG;
+    stream->owns_config = 1;
+    if (parse_definition_string(definition, &stream->config) != 0) {
+        fprintf(stderr, "Error parsing definition.\n");
+        free_config(&stream->config);
+        free(stream);
+        return NULL;
+    }
+    stream->ctx.config = &stream->config;
+    if (!stream_open(stream)) {
+        free_config(&stream->config);
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+size_t generate_stream_record_bytes(const GenStream *stream) {
+    return stream->ctx.max_record_bytes;
+}
+
+size_t generate_stream_records_left(const GenStream *stream) {
+    return stream->ctx.config->record_count - stream->next_record;
+}
+
+size_t generate_stream_next(GenStream *stream, void *buf, size_t cap) {
+    const GenContext *ctx = &stream->ctx;
+    const Config *config = ctx->config;
+    size_t first = stream->next_record;
+    size_t last = first;
+    size_t room = cap;
+
+    if (config->file_type == FILE_TYPE_VARIABLE && !ctx->has_plan) {
+        // Record lengths are drawn from each record's own generator, so they
+        // can be looked up ahead to take exactly the records that fit.
+        Prng rng;
+        while (last < config->record_count) {
+            prng_seed_record(&rng, ctx->record_key, config->first_record + last);
+            size_t bytes = length_sample(&ctx->lengths, &rng) + 4;
+            if (bytes > room) break;
+            room -= bytes;
+            last++;
+        }
+    } else {
+        size_t fit = cap / ctx->max_record_bytes;
+        last = (fit < config->record_count - first) ? first + fit : config->record_count;
+    }
+    if (last == first) return 0;
+
+    stream->next_record = last;
+    return fill_records(ctx, &stream->state, first, last, buf);
+}
+
+size_t generate_stream_record(GenStream *stream, uint64_t record_key, size_t index, void *buf) {
+    GenContext ctx = stream->ctx;
+    ctx.record_key = record_key;
+    return fill_records(&ctx, &stream->state, index, index + 1, buf);
+}
+
+void generate_stream_close(GenStream *stream) {
+    if (!stream) return;
+    worker_state_free(&stream->state);
+    free_context(&stream->ctx);
+    if (stream->owns_config) free_config(&stream->config);
+    free(stream);
+}
@@ -4,8 +4,75 @@
 #include <stdio.h>
 #include "config.h"
 
+// Builds the shared generation tables. generate_data() calls it itself;
+// call it once up front when several threads generate at the same time.
+// Returns 0 on success, non-zero on error.
+int generate_init(void);
+
 // Generates data based on the configuration and writes it to the output file.
 // Returns 0 on success, non-zero on error.
 int generate_data(const Config *config, FILE *output_file);
 
+// fopen() mode for a new output file at `path`. Regular files are opened for
+// reading as well, since constant records are copied within the file and
+// --mmap maps it; FIFOs and devices stay write-only.
+const char *generate_output_mode(const char *path);
+
+// A job split into parts that can be generated independently, by any thread
+// and in any order (batch mode). Only FIXED records written to a regular
+// file can be split: every part is a run of whole batches pwrite()n to its
+// final offset, so the file is identical to the one generate_data() writes.
+typedef struct GenSplit GenSplit;
+
+// Splits the job into at most `max_parts` parts. Returns NULL if the job
+// cannot be split (the caller then uses generate_data()) or on error.
+// generate_init() must have been called.
+GenSplit *generate_split_open(const Config *config, FILE *output_file, size_t max_parts);
+
+size_t generate_split_parts(const GenSplit *split);
+
+// Generates one part. Thread-safe for different parts.
+// Returns 0 on success, non-zero on error.
+int generate_split_run(GenSplit *split, size_t part);
+
+void generate_split_close(GenSplit *split);
+
+// Pull interface for generating records in memory (libmfdatagen). The
+// stream hands out the records of the file generate_data() would write,
+// in order and byte for byte the same, into buffers owned by the caller;
+// nothing is allocated or copied per call. FIXED records carry their
+// NEWLINE, VARIABLE records their RDW. Output settings (COMPRESSION,
+// DIRECT_IO, THREADS, OUTPUT_BLOCK_SIZE) do not apply; blocked files
+// (BLOCK_SIZE) cannot be streamed. A stream is used by one thread at a
+// time; to generate in parallel, open one stream per part of the file with
+// first_record/record_count set like --range does.
+typedef struct GenStream GenStream;
+
+// Opens a stream over the records `config` describes. The Config must stay
+// valid until the stream is closed. The seed is config->seed as given.
+// Returns NULL on error.
+GenStream *generate_stream_open(const Config *config);
+
+// Same, for the text of a definition file; the stream keeps its own Config.
+// Without SEED= in the text, the seed is 0.
+GenStream *generate_stream_open_definition(const char *definition);
+
+// Bytes of the largest record: a buffer of this size always takes one.
+size_t generate_stream_record_bytes(const GenStream *stream);
+
+size_t generate_stream_records_left(const GenStream *stream);
+
+// Fills `buf` with as many whole records as fit in `cap` bytes and returns
+// the number of bytes filled; 0 once every record has been handed out, or
+// if the next record does not fit in `cap`.
+size_t generate_stream_next(GenStream *stream, void *buf, size_t cap);
+
+// Fills record `index` of the file into `buf` (generate_stream_record_bytes()
+// at least) and returns its bytes, drawing from the per-record generators
+// of `record_key` instead of the seed's; the KEY is still that of `index`.
+// Derived files (--mutate) get their new versions of records this way.
+size_t generate_stream_record(GenStream *stream, uint64_t record_key, size_t index, void *buf);
+
+void generate_stream_close(GenStream *stream);
+
 #endif // GENERATOR_H
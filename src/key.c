@@ -0,0 +1,124 @@
+#include "key.h"
+#include "prng.h"
+#include "codepage.h"
+#include <string.h>
+
+// Decimal keys hold at most 19 significant digits (10^19 < 2^64); longer
+// ones get leading zeros.
+#define KEY_MAX_DIGITS 19
+
+// Keeps the permutation of a seed apart from the record generators.
+#define KEY_SEED_SALT 0x4B45595045524DULL
+
+static uint64_t pow10_u64(size_t digits) {
+    uint64_t v = 1;
+    for (size_t i = 0; i < digits; i++) v *= 10;
+    return v;
+}
+
+uint64_t key_space(FieldType format, size_t length) {
+    switch (format) {
+        case FIELD_ZONED: return pow10_u64(length < KEY_MAX_DIGITS ? length : KEY_MAX_DIGITS);
+        case FIELD_PACKED: {
+            size_t digits = 2 * length - 1;
+            return pow10_u64(digits < KEY_MAX_DIGITS ? digits : KEY_MAX_DIGITS);
+        }
+        default: return (length >= 8) ? 0 : (uint64_t)1 << (8 * length);
+    }
+}
+
+void key_init(KeyGen *keys, const Config *config) {
+    memset(keys, 0, sizeof(*keys));
+    keys->offset = config->key_offset;
+    keys->length = config->key_length;
+    keys->format = config->key_format;
+    keys->random = config->key_random;
+    keys->space = key_space(config->key_format, config->key_length);
+    keys->digit_zero = codepage_get(config->output_codepage)->digit_zero;
+
+    // Halves of ceil(n/2) and floor(n/2) decimal digits or bits.
+    if (config->key_format == FIELD_BINARY) {
+        unsigned bits = (unsigned)(8 * (config->key_length < 8 ? config->key_length : 8));
+        keys->high = (uint64_t)1 << ((bits + 1) / 2);
+        keys->low = (uint64_t)1 << (bits / 2);
+    } else {
+        size_t digits = 0;
+        for (uint64_t v = keys->space; v > 1; v /= 10) digits++;
+        keys->high = pow10_u64((digits + 1) / 2);
+        keys->low = pow10_u64(digits / 2);
+    }
+
+    uint64_t x = config->seed ^ KEY_SEED_SALT;
+    for (int i = 0; i < KEY_ROUNDS; i++) {
+        keys->round_keys[i] = prng_splitmix64(&x);
+    }
+}
+
+// Keyed round function, reduced to [0, range) by a multiply-high.
+static inline uint64_t round_function(uint64_t v, uint64_t key, uint64_t range) {
+    v = (v ^ key) * 0xBF58476D1CE4E5B9ULL;
+    v ^= v >> 31;
+    return (uint64_t)(((unsigned __int128)v * range) >> 64);
+}
+
+// (x + y) mod m for x, y < m.
+static inline uint64_t add_mod(uint64_t x, uint64_t y, uint64_t m) {
+    return (x >= m - y) ? x - (m - y) : x + y;
+}
+
+uint64_t key_value(const KeyGen *keys, uint64_t index) {
+    if (!keys->random) {
+        uint64_t number = index + 1;
+        return keys->space ? number % keys->space : number;
+    }
+    uint64_t x = keys->space ? index % keys->space : index;
+    uint64_t hi = x / keys->low, lo = x % keys->low;
+    for (int i = 0; i < KEY_ROUNDS; i += 2) {
+        hi = add_mod(hi, round_function(lo, keys->round_keys[i], keys->high), keys->high);
+        lo = add_mod(lo, round_function(hi, keys->round_keys[i + 1], keys->low), keys->low);
+    }
+    return hi * keys->low + lo;
+}
+
+// Two decimal digits per step.
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+void key_write(const KeyGen *keys, uint64_t index, unsigned char *dst) {
+    uint64_t v = key_value(keys, index);
+    size_t n = keys->length;
+
+    switch (keys->format) {
+        case FIELD_ZONED: {
+            unsigned char zone = (unsigned char)(keys->digit_zero - '0');
+            size_t i = n;
+            for (; i >= 2; i -= 2) {
+                const char *pair = &DIGIT_PAIRS[2 * (v % 100)];
+                dst[i - 2] = (unsigned char)(pair[0] + zone);
+                dst[i - 1] = (unsigned char)(pair[1] + zone);
+                v /= 100;
+            }
+            if (i) dst[0] = (unsigned char)(keys->digit_zero + v % 10);
+            break;
+        }
+        case FIELD_PACKED:
+            // Digits in nibbles, ending with the C (positive) sign nibble.
+            dst[n - 1] = (unsigned char)((v % 10) << 4 | 0x0C);
+            v /= 10;
+            for (size_t i = n - 1; i-- > 0; ) {
+                unsigned low = (unsigned)(v % 10);
+                v /= 10;
+                dst[i] = (unsigned char)((v % 10) << 4 | low);
+                v /= 10;
+            }
+            break;
+        default:
+            for (size_t i = n; i-- > 0; ) {
+                dst[i] = (unsigned char)v;
+                v >>= 8;
+            }
+            break;
+    }
+}
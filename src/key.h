@@ -0,0 +1,48 @@
+#ifndef KEY_H
+#define KEY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+// Unique record keys (KEY=OFFSET,LENGTH,FORMAT[,ASCENDING|RANDOM]).
+//
+// The key of a record is a pure function of its index in the file, so the
+// keys stay unique however the records are shared out between threads,
+// --range/--shard parts, batch jobs or library calls, and nothing is
+// remembered between records. ASCENDING keys are the record number
+// (index + 1). RANDOM keys are the index sent through a keyed permutation
+// of the whole key space. The space (10^digits or 2^bits) is split into a
+// high and a low half of a x b values, and the rounds of an alternating
+// Feistel network add a keyed function of one half to the other, modulo its
+// size. Every round can be undone, so the whole is a bijection of exactly
+// the key space: it cannot repeat a key and never needs to retry.
+
+#define KEY_ROUNDS 4
+#define KEY_MAX_LENGTH 31        // Zoned keys; packed ones hold 31 digits in 16 bytes
+
+typedef struct {
+    size_t offset;
+    size_t length;
+    FieldType format;            // FIELD_ZONED, FIELD_PACKED or FIELD_BINARY
+    int random;
+    uint64_t space;              // Distinct keys (0 = 2^64)
+    uint64_t high;               // Values of the high half (a)
+    uint64_t low;                // Values of the low half (b); key = hi * low + lo
+    uint64_t round_keys[KEY_ROUNDS];
+    unsigned char digit_zero;    // Zoned keys: '0' in the output codepage
+} KeyGen;
+
+// Number of distinct keys of a format and length (0 = 2^64).
+uint64_t key_space(FieldType format, size_t length);
+
+// Prepares the keys of the config; the permutation is keyed by the seed.
+void key_init(KeyGen *keys, const Config *config);
+
+// Key value of record `index` of the file.
+uint64_t key_value(const KeyGen *keys, uint64_t index);
+
+// Writes the keys->length bytes of the key of record `index` to dst.
+void key_write(const KeyGen *keys, uint64_t index, unsigned char *dst);
+
+#endif // KEY_H
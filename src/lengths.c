@@ -0,0 +1,182 @@
+#include "lengths.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define SAMPLE_READ_SIZE (1024 * 1024)
+
+// P(X > x) of a normal distribution. Working with the upper tail above the
+// mean (and the lower tail below it) keeps differences of tiny
+// probabilities accurate far from the mean.
+static double normal_sf(double x, double mean, double stddev) {
+    return 0.5 * erfc((x - mean) / (stddev * sqrt(2.0)));
+}
+
+static double normal_mass(double lo, double hi, double mean, double stddev) {
+    if (lo >= mean) {
+        return normal_sf(lo, mean, stddev) - normal_sf(hi, mean, stddev);
+    }
+    // Below the mean, use the mirror image 2 * mean - X (same distribution).
+    return normal_sf(2 * mean - hi, mean, stddev) - normal_sf(2 * mean - lo, mean, stddev);
+}
+
+// Weight of the lengths [lo, hi] of a parametric distribution. Lengths are
+// integers, so the continuous ones are integrated over [lo - 0.5, hi + 0.5].
+static double bucket_weight(const Config *config, size_t min, size_t lo, size_t hi) {
+    const double *p = config->length_param;
+    switch (config->length_distribution) {
+        case LENGTH_NORMAL:
+            return normal_mass(lo - 0.5, hi + 0.5, p[0], p[1]);
+        case LENGTH_LOGNORMAL:
+            return normal_mass(log(lo - 0.5), log(hi + 0.5), log(p[0]), p[1]);
+        case LENGTH_ZIPF: {
+            // Rank 1 is the shortest length.
+            double r_lo = (double)(lo - min + 1), r_hi = (double)(hi - min + 1), s = p[0];
+            if (lo == hi) return pow(r_lo, -s);
+            double a = r_lo - 0.5, b = r_hi + 0.5;
+            return (s == 1.0) ? log(b / a) : (pow(b, 1.0 - s) - pow(a, 1.0 - s)) / (1.0 - s);
+        }
+        default:
+            return 1.0;
+    }
+}
+
+// Adds the data lengths found in the RDWs of a RECFM=V sample file to the
+// bucket weights. Lengths outside the configured range are skipped.
+static int load_sample(const LengthSampler *ls, const Config *config, double *weights) {
+    FILE *file = fopen(config->length_sample, "rb");
+    if (!file) {
+        perror("Error opening LENGTH_DISTRIBUTION sample file");
+        return 1;
+    }
+    unsigned char *buf = malloc(SAMPLE_READ_SIZE);
+    if (!buf) {
+        perror("Error allocating memory for the sample file");
+        fclose(file);
+        return 1;
+    }
+
+    unsigned char rdw[4];
+    size_t rdw_len = 0;
+    size_t skip = 0;                 // Data bytes of the current record still to pass
+    unsigned long long offset = 0;   // Offset of the next RDW
+    unsigned long long used = 0, outside = 0;
+    int rc = 0;
+    size_t have;
+
+    while (rc == 0 && (have = fread(buf, 1, SAMPLE_READ_SIZE, file)) > 0) {
+        for (size_t i = 0; i < have && rc == 0; ) {
+            if (skip > 0) {
+                size_t n = (skip < have - i) ? skip : have - i;
+                skip -= n;
+                i += n;
+                continue;
+            }
+            rdw[rdw_len++] = buf[i++];
+            if (rdw_len < 4) continue;
+            rdw_len = 0;
+
+            size_t total = (config->rdw_endian == RDW_ENDIAN_BIG) ? ((size_t)rdw[0] << 8 | rdw[1])
+                                                                   : ((size_t)rdw[1] << 8 | rdw[0]);
+            if (total < 4 || rdw[2] != 0 || rdw[3] != 0) {
+                fprintf(stderr, "Invalid RDW at offset %llu of sample file %s\n", offset, config->length_sample);
+                rc = 1;
+                break;
+            }
+            size_t len = total - 4;
+            if (len >= ls->min && len <= ls->max) {
+                weights[(len - ls->min) / ls->bucket_width] += 1.0;
+                used++;
+            } else {
+                outside++;
+            }
+            skip = len;
+            offset += total;
+        }
+    }
+    if (rc == 0 && ferror(file)) {
+        perror("Error reading LENGTH_DISTRIBUTION sample file");
+        rc = 1;
+    }
+    if (rc == 0 && (rdw_len > 0 || skip > 0)) {
+        fprintf(stderr, "Sample file %s ends inside a record\n", config->length_sample);
+        rc = 1;
+    }
+    if (rc == 0 && outside > 0) {
+        fprintf(stderr, "Warning: %llu of %llu sample records are outside the length range %zu-%zu and were ignored.\n",
+                outside, used + outside, ls->min, ls->max);
+    }
+    if (rc == 0 && used == 0) {
+        fprintf(stderr, "Sample file %s has no records in the length range %zu-%zu\n",
+                config->length_sample, ls->min, ls->max);
+        rc = 1;
+    }
+    free(buf);
+    fclose(file);
+    return rc;
+}
+
+int length_sampler_init(LengthSampler *ls, const Config *config) {
+    ls->min = config->min_record_length ? config->min_record_length : 1;
+    ls->max = config->record_length;
+    ls->uniform = (config->length_distribution == LENGTH_UNIFORM);
+    ls->bucket_width = 1;
+    ls->table.n = 0;
+    ls->table.prob = NULL;
+    ls->table.alias = NULL;
+    if (ls->uniform) return 0;
+
+    size_t range = ls->max - ls->min + 1;
+    ls->bucket_width = (range + LENGTH_MAX_BUCKETS - 1) / LENGTH_MAX_BUCKETS;
+    size_t buckets = (range + ls->bucket_width - 1) / ls->bucket_width;
+
+    double *weights = calloc(buckets, sizeof(double));
+    if (!weights) {
+        perror("Error allocating memory for the length distribution");
+        return 1;
+    }
+    int rc = 0;
+    if (config->length_distribution == LENGTH_EMPIRICAL) {
+        rc = load_sample(ls, config, weights);
+    } else {
+        for (size_t b = 0; b < buckets; b++) {
+            size_t lo = ls->min + b * ls->bucket_width;
+            size_t hi = lo + ls->bucket_width - 1;
+            if (hi > ls->max) hi = ls->max;
+            double w = bucket_weight(config, ls->min, lo, hi);
+            weights[b] = (w > 0.0) ? w : 0.0;
+        }
+    }
+    if (rc == 0 && alias_build(&ls->table, weights, buckets) != 0) {
+        fprintf(stderr, "LENGTH_DISTRIBUTION gives no weight to the lengths %zu-%zu\n", ls->min, ls->max);
+        rc = 1;
+    }
+    free(weights);
+    return rc;
+}
+
+void length_sampler_free(LengthSampler *ls) {
+    alias_free(&ls->table);
+}
+
+// Mean length of the bucket: its lengths are equally likely.
+static double bucket_mean(const LengthSampler *ls, size_t bucket) {
+    size_t lo = ls->min + bucket * ls->bucket_width;
+    size_t hi = lo + ls->bucket_width - 1;
+    if (hi > ls->max) hi = ls->max;
+    return ((double)lo + (double)hi) / 2.0;
+}
+
+double length_sampler_mean(const LengthSampler *ls) {
+    if (ls->uniform) {
+        return ((double)ls->min + (double)ls->max) / 2.0;
+    }
+    // Column c is picked with probability 1/n and yields bucket c with
+    // probability prob[c], otherwise its alias.
+    double sum = 0.0;
+    for (size_t c = 0; c < ls->table.n; c++) {
+        double keep = ls->table.prob[c] / 4294967296.0;
+        sum += keep * bucket_mean(ls, c) + (1.0 - keep) * bucket_mean(ls, ls->table.alias[c]);
+    }
+    return sum / (double)ls->table.n;
+}
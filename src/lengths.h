@@ -0,0 +1,46 @@
+#ifndef LENGTHS_H
+#define LENGTHS_H
+
+#include <stddef.h>
+#include "config.h"
+#include "prng.h"
+#include "alias.h"
+
+// Record lengths of VARIABLE files.
+//
+// Every distribution except plain UNIFORM is compiled into an alias table
+// over at most LENGTH_MAX_BUCKETS buckets of equal width, so a length costs
+// one table lookup whatever the shape. Ranges wider than that use buckets of
+// several lengths, and a second draw picks the length inside the bucket.
+
+#define LENGTH_MAX_BUCKETS 65536
+
+typedef struct {
+    size_t min;
+    size_t max;
+    int uniform;             // Plain uniform: no table
+    size_t bucket_width;     // Lengths per bucket
+    AliasTable table;
+} LengthSampler;
+
+// Builds the sampler for the config (loading the EMPIRICAL sample file).
+// Returns 0 on success, non-zero on error.
+int length_sampler_init(LengthSampler *sampler, const Config *config);
+
+void length_sampler_free(LengthSampler *sampler);
+
+// Expected length of a sample.
+double length_sampler_mean(const LengthSampler *sampler);
+
+static inline size_t length_sample(const LengthSampler *ls, Prng *rng) {
+    if (ls->uniform) {
+        return ls->min + (size_t)prng_bounded64(rng, ls->max - ls->min + 1);
+    }
+    size_t lo = ls->min + alias_sample(&ls->table, rng) * ls->bucket_width;
+    if (ls->bucket_width == 1) return lo;
+    size_t span = ls->max - lo + 1;
+    if (span > ls->bucket_width) span = ls->bucket_width;
+    return lo + (size_t)prng_bounded64(rng, span);
+}
+
+#endif // LENGTHS_H
@@ -1,28 +1,341 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <getopt.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "config.h"
 #include "parser.h"
 #include "generator.h"
+#include "batch.h"
+#include "verify.h"
+#include "checkpoint.h"
+#include "mutate.h"
+
+// Long-only options.
+enum {
+    OPT_STATS = 256,
+    OPT_PROGRESS,
+    OPT_RANGE,
+    OPT_SHARD,
+    OPT_VERIFY,
+    OPT_MMAP,
+    OPT_RATE,
+    OPT_DURATION,
+    OPT_CHECKPOINT,
+    OPT_RESUME,
+    OPT_BASE,
+    OPT_MUTATE,
+    OPT_CHANGES
+};
 
 void print_usage(const char *prog_name) {
-    fprintf(stderr, "Usage: %s -d <definition_file> -o <output_file>\n", prog_name);
+    fprintf(stderr, "Usage: %s -d <definition_file> -o <output_file> [-j <threads>] [-s <seed>] [-z gzip|zstd] [--mmap]\n"
+                    "       [--stats[=<json_file>]] [--progress=<seconds>] [--range <start>:<count> | --shard <k>/<n>]\n"
+                    "       [--rate <n>[K|M|G]B/s | --rate <n>[K|M|G]rec/s] [--duration <seconds>]\n"
+                    "       [--checkpoint[=<size>]] [--resume]\n"
+                    "       %s -d <definition_file> -o <output_file> --base <file> --mutate <changes> [--changes <file>] [-s <seed>]\n"
+                    "       %s -d <definition_file> --verify <file> [-j <threads>] [-s <seed>] [--range <start>:<count> | --shard <k>/<n>]\n"
+                    "       %s -m <manifest> | -d <def1> -o <out1> -d <def2> -o <out2> ... [-j <workers>] [-s <seed>] [-z gzip|zstd]\n",
+            prog_name, prog_name, prog_name, prog_name);
+    fprintf(stderr, "  -m <manifest> Batch mode: one \"<definition_file> <output_file>\" pair per line.\n");
+    fprintf(stderr, "  -j <threads>  Worker threads (0 = one per CPU). Overrides THREADS in the definition.\n");
+    fprintf(stderr, "  -s <seed>     Random seed for reproducible output. Overrides SEED in the definition.\n");
+    fprintf(stderr, "  -z <codec>    Compress the output in parallel blocks (gzip or zstd). Overrides COMPRESSION.\n");
+    fprintf(stderr, "  --stats[=<json_file>]  Print throughput and time statistics at the end; JSON goes to\n"
+                    "                         the file if given, otherwise to stderr.\n");
+    fprintf(stderr, "  --progress=<seconds>   Print a progress line with ETA every interval (0 = only on SIGUSR1).\n");
+    fprintf(stderr, "  --range <start>:<count>  Generate only records start .. start+count-1 (0-based) of the file.\n");
+    fprintf(stderr, "  --shard <k>/<n>          Generate the k-th (1..n) of n equal parts of the file.\n");
+    fprintf(stderr, "  --verify <file>          Check an existing file against the definition instead of generating.\n");
+    fprintf(stderr, "  --mmap                   Fill FIXED records straight into a memory mapping of the output file.\n");
+    fprintf(stderr, "  --rate <rate>            Stream at this rate, e.g. 50MB/s or 20000rec/s (-o - writes to stdout).\n");
+    fprintf(stderr, "  --duration <seconds>     Stream for this long, ignoring RECORD_COUNT (0 = until stopped).\n");
+    fprintf(stderr, "  --checkpoint[=<size>]    Sync the output and save a checkpoint in <output_file>.ckpt after every\n"
+                    "                           <size> bytes (K, M, G or T; default 4G).\n");
+    fprintf(stderr, "  --resume                 Continue the run recorded in <output_file>.ckpt.\n");
+    fprintf(stderr, "  --base <file> --mutate update=<p>%%,insert=<p>%%,delete=<p>%%[,version=<n>]\n"
+                    "                           Derive a new version of a file generated from the definition.\n");
+    fprintf(stderr, "  --changes <file>         With --mutate: list the changed records in <file>.\n");
+}
+
+// Parses "<a><sep><b>" into two unsigned numbers. Returns 0 on success.
+static int parse_pair(const char *arg, char sep, unsigned long long *a, unsigned long long *b) {
+    char *endp;
+    if (*arg == '\0' || *arg == '-') return 1;
+    errno = 0;
+    *a = strtoull(arg, &endp, 10);
+    if (errno == ERANGE || endp == arg || *endp != sep) return 1;
+    const char *second = endp + 1;
+    if (*second == '\0' || *second == '-') return 1;
+    *b = strtoull(second, &endp, 10);
+    if (errno == ERANGE || *endp != '\0') return 1;
+    return 0;
+}
+
+// Parses "<number>[K|M|G]<unit>[/s]" with unit B (bytes) or rec (records).
+// K, M and G are powers of 1000, as in MB/s. Returns 0 on success.
+static int parse_rate(const char *arg, double *rate, int *records) {
+    char *endp;
+    errno = 0;
+    *rate = strtod(arg, &endp);
+    if (errno == ERANGE || endp == arg || !(*rate > 0)) return 1;
+    if (*endp == 'K') { *rate *= 1e3; endp++; }
+    else if (*endp == 'M') { *rate *= 1e6; endp++; }
+    else if (*endp == 'G') { *rate *= 1e9; endp++; }
+
+    if (*endp == 'B') { *records = 0; endp++; }
+    else if (strncmp(endp, "rec", 3) == 0) { *records = 1; endp += 3; }
+    else return 1;
+    if (strcmp(endp, "/s") == 0) endp += 2;
+    return *endp != '\0';
+}
+
+// Parses "<number>[K|M|G|T]" (powers of 1024). Returns 0 on success.
+static int parse_bytes(const char *arg, size_t *bytes) {
+    char *endp;
+    if (*arg == '\0' || *arg == '-') return 1;
+    errno = 0;
+    unsigned long long n = strtoull(arg, &endp, 10);
+    if (errno == ERANGE || endp == arg || n == 0) return 1;
+    int shift = 0;
+    if (*endp == 'K') { shift = 10; endp++; }
+    else if (*endp == 'M') { shift = 20; endp++; }
+    else if (*endp == 'G') { shift = 30; endp++; }
+    else if (*endp == 'T') { shift = 40; endp++; }
+    if (*endp != '\0' || n > (unsigned long long)SIZE_MAX >> shift) return 1;
+    *bytes = (size_t)(n << shift);
+    return 0;
+}
+
+// Loads the checkpoint of an interrupted run into `config` and checks that
+// it belongs to the same definition, slice and seed. Returns 0 on success.
+static int load_checkpoint(Config *config, int seed_given, uint64_t seed, Checkpoint *cp) {
+    if (checkpoint_read(config->checkpoint_path, cp) != 0) {
+        return 1;
+    }
+    if (cp->definition != config->definition_hash) {
+        fprintf(stderr, "Error: The definition has changed since checkpoint %s was written.\n", config->checkpoint_path);
+        return 1;
+    }
+    if (cp->first_record != config->first_record || cp->record_count != config->record_count) {
+        fprintf(stderr, "Error: Checkpoint %s is for records %zu:%zu, not %zu:%zu.\n", config->checkpoint_path,
+                cp->first_record, cp->record_count, config->first_record, config->record_count);
+        return 1;
+    }
+    if ((seed_given && seed != cp->seed) || (!seed_given && config->seed_set && config->seed != cp->seed)) {
+        fprintf(stderr, "Error: Checkpoint %s was written with seed %llu.\n", config->checkpoint_path,
+                (unsigned long long)cp->seed);
+        return 1;
+    }
+    config->seed = cp->seed;
+    config->seed_set = 1;
+    config->resume_records = cp->records_done;
+    return 0;
+}
+
+// Batch mode: a manifest, or several -d/-o pairs.
+static int run_batch(const char *manifest, BatchJobSpec *pairs, size_t def_count, size_t out_count,
+                     const BatchOptions *options) {
+    if (manifest && (def_count > 0 || out_count > 0)) {
+        fprintf(stderr, "Error: -m cannot be combined with -d/-o.\n");
+        return 1;
+    }
+    if (!manifest && def_count != out_count) {
+        fprintf(stderr, "Error: Every -d needs a matching -o.\n");
+        return 1;
+    }
+
+    int rc;
+    if (manifest) {
+        BatchJobSpec *jobs;
+        size_t count;
+        if (batch_read_manifest(manifest, &jobs, &count) != 0) {
+            return 1;
+        }
+        rc = batch_run(jobs, count, options);
+        batch_free_manifest(jobs, count);
+    } else {
+        rc = batch_run(pairs, def_count, options);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Error generating data.\n");
+        return 1;
+    }
+    printf("Data generation completed successfully.\n");
+    return 0;
 }
 
 int main(int argc, char *argv[]) {
     int opt;
     char *def_file = NULL;
     char *out_file = NULL;
+    const char *manifest = NULL;
+    // Repeated -d/-o options are paired in order (batch mode).
+    BatchJobSpec *pairs = calloc((size_t)argc, sizeof(BatchJobSpec));
+    size_t def_count = 0;
+    size_t out_count = 0;
+    long threads = -1;
+    unsigned long long seed = 0;
+    int seed_given = 0;
+    int compression = -1;
+    int stats = 0;
+    const char *stats_json = NULL;
+    long progress = -1;
+    // Slice of the file: --range start:count, or --shard k/n
+    const char *range = NULL;
+    const char *shard = NULL;
+    unsigned long long part_a = 0, part_b = 0;
+    const char *verify = NULL;
+    int mmap_output = 0;
+    double rate = 0;
+    int rate_records = 0;
+    long duration = -1;
+    size_t checkpoint_bytes = 0;
+    int resume = 0;
+    const char *base = NULL;
+    const char *mutate = NULL;
+    MutateOptions mutation;
+    memset(&mutation, 0, sizeof(mutation));
+
+    static const struct option long_options[] = {
+        { "stats", optional_argument, NULL, OPT_STATS },
+        { "progress", required_argument, NULL, OPT_PROGRESS },
+        { "range", required_argument, NULL, OPT_RANGE },
+        { "shard", required_argument, NULL, OPT_SHARD },
+        { "verify", required_argument, NULL, OPT_VERIFY },
+        { "mmap", no_argument, NULL, OPT_MMAP },
+        { "rate", required_argument, NULL, OPT_RATE },
+        { "duration", required_argument, NULL, OPT_DURATION },
+        { "checkpoint", optional_argument, NULL, OPT_CHECKPOINT },
+        { "resume", no_argument, NULL, OPT_RESUME },
+        { "base", required_argument, NULL, OPT_BASE },
+        { "mutate", required_argument, NULL, OPT_MUTATE },
+        { "changes", required_argument, NULL, OPT_CHANGES },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
 
-    while ((opt = getopt(argc, argv, "d:o:h")) != -1) {
+    if (!pairs) {
+        perror("Error allocating memory");
+        return 1;
+    }
+
+    while ((opt = getopt_long(argc, argv, "d:o:m:j:s:z:h", long_options, NULL)) != -1) {
         switch (opt) {
             case 'd':
                 def_file = optarg;
+                pairs[def_count++].def_file = optarg;
                 break;
             case 'o':
                 out_file = optarg;
+                pairs[out_count++].out_file = optarg;
+                break;
+            case 'm':
+                manifest = optarg;
+                break;
+            case 'j': {
+                char *endp;
+                threads = strtol(optarg, &endp, 10);
+                if (*optarg == '\0' || *endp != '\0' || threads < 0) {
+                    fprintf(stderr, "Error: Invalid thread count '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case 's': {
+                char *endp;
+                errno = 0;
+                seed = strtoull(optarg, &endp, 0);
+                if (*optarg == '\0' || *optarg == '-' || *endp != '\0' || errno == ERANGE) {
+                    fprintf(stderr, "Error: Invalid seed '%s'.\n", optarg);
+                    return 1;
+                }
+                seed_given = 1;
+                break;
+            }
+            case 'z':
+                if (strcmp(optarg, "gzip") == 0) compression = COMPRESS_GZIP;
+                else if (strcmp(optarg, "zstd") == 0) compression = COMPRESS_ZSTD;
+                else if (strcmp(optarg, "none") == 0) compression = COMPRESS_NONE;
+                else {
+                    fprintf(stderr, "Error: Unknown compression '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_STATS:
+                stats = 1;
+                stats_json = optarg;
+                break;
+            case OPT_PROGRESS: {
+                char *endp;
+                progress = strtol(optarg, &endp, 10);
+                if (*optarg == '\0' || *endp != '\0' || progress < 0 || progress > 86400) {
+                    fprintf(stderr, "Error: Invalid progress interval '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case OPT_RANGE:
+                if (shard || parse_pair(optarg, ':', &part_a, &part_b) != 0) {
+                    fprintf(stderr, "Error: Invalid range '%s' (expected <start>:<count>, without --shard).\n", optarg);
+                    return 1;
+                }
+                range = optarg;
+                break;
+            case OPT_SHARD:
+                if (range || parse_pair(optarg, '/', &part_a, &part_b) != 0 ||
+                    part_a < 1 || part_a > part_b) {
+                    fprintf(stderr, "Error: Invalid shard '%s' (expected <k>/<n> with 1 <= k <= n, without --range).\n", optarg);
+                    return 1;
+                }
+                shard = optarg;
+                break;
+            case OPT_VERIFY:
+                verify = optarg;
+                break;
+            case OPT_MMAP:
+                mmap_output = 1;
+                break;
+            case OPT_RATE:
+                if (parse_rate(optarg, &rate, &rate_records) != 0) {
+                    fprintf(stderr, "Error: Invalid rate '%s' (expected e.g. 50MB/s or 20000rec/s).\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_DURATION: {
+                char *endp;
+                duration = strtol(optarg, &endp, 10);
+                if (*optarg == '\0' || *endp != '\0' || duration < 0 || duration > 31536000) {
+                    fprintf(stderr, "Error: Invalid duration '%s'.\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case OPT_CHECKPOINT:
+                checkpoint_bytes = CHECKPOINT_DEFAULT_BYTES;
+                if (optarg && parse_bytes(optarg, &checkpoint_bytes) != 0) {
+                    fprintf(stderr, "Error: Invalid checkpoint interval '%s' (expected e.g. 64G).\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_RESUME:
+                resume = 1;
+                break;
+            case OPT_BASE:
+                base = optarg;
+                break;
+            case OPT_MUTATE:
+                if (mutate_parse(optarg, &mutation) != 0) {
+                    fprintf(stderr, "Error: Invalid mutation '%s' (expected e.g. update=5%%,insert=1%%,delete=1%%).\n", optarg);
+                    return 1;
+                }
+                mutate = optarg;
+                break;
+            case OPT_CHANGES:
+                mutation.changes_path = optarg;
                 break;
             case 'h':
                 print_usage(argv[0]);
@@ -33,15 +346,64 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    if (!def_file || !out_file) {
+    if (manifest || def_count > 1 || out_count > 1) {
+        if (stats || progress >= 0 || range || shard || verify || mmap_output || rate > 0 || duration >= 0 ||
+            checkpoint_bytes > 0 || resume || base || mutate) {
+            fprintf(stderr, "Error: --stats, --progress, --range, --shard, --verify, --mmap, --rate, --duration, "
+                            "--checkpoint, --resume and --mutate are not available in batch mode.\n");
+            free(pairs);
+            return 1;
+        }
+        BatchOptions options;
+        options.workers = (threads >= 0) ? (size_t)threads : 0;
+        options.seed_given = seed_given;
+        options.seed = (uint64_t)seed;
+        options.compression = compression;
+        int rc = run_batch(manifest, pairs, def_count, out_count, &options);
+        free(pairs);
+        return rc;
+    }
+    free(pairs);
+
+    if (verify && (out_file || stats || progress >= 0 || mmap_output || rate > 0 || duration >= 0 ||
+                   checkpoint_bytes > 0 || resume)) {
+        fprintf(stderr, "Error: --verify cannot be combined with -o, --stats, --progress, --mmap, --rate, --duration, "
+                        "--checkpoint or --resume.\n");
+        return 1;
+    }
+    int streaming = (rate > 0 || duration >= 0);
+    if (!base != !mutate || (mutation.changes_path && !mutate)) {
+        fprintf(stderr, "Error: --base and --mutate go together (and --changes needs them).\n");
+        return 1;
+    }
+    if (mutate && (verify || stats || progress >= 0 || range || shard || mmap_output || streaming ||
+                   checkpoint_bytes > 0 || resume)) {
+        fprintf(stderr, "Error: --mutate cannot be combined with --verify, --stats, --progress, --range, --shard, "
+                        "--mmap, --rate, --duration, --checkpoint or --resume.\n");
+        return 1;
+    }
+    // --resume keeps checkpointing, at the default interval unless given.
+    if (resume && checkpoint_bytes == 0) {
+        checkpoint_bytes = CHECKPOINT_DEFAULT_BYTES;
+    }
+    if (checkpoint_bytes > 0 && (streaming || (out_file && strcmp(out_file, "-") == 0))) {
+        fprintf(stderr, "Error: --checkpoint and --resume need an output file, without --rate or --duration.\n");
+        return 1;
+    }
+    if (streaming && mmap_output) {
+        fprintf(stderr, "Error: --mmap cannot be combined with --rate or --duration.\n");
+        return 1;
+    }
+    if (duration >= 0 && (range || shard)) {
+        fprintf(stderr, "Error: --duration cannot be combined with --range or --shard.\n");
+        return 1;
+    }
+    if (!def_file || (!out_file && !verify)) {
         fprintf(stderr, "Error: Definition file and output file are required.\n");
         print_usage(argv[0]);
         return 1;
     }
 
-    // Initialize random seed
-    srand((unsigned int)time(NULL));
-
     Config config;
     memset(&config, 0, sizeof(Config));
 
@@ -55,23 +417,184 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    FILE *f_out = fopen(out_file, "wb");
+    if (threads >= 0) {
+        config.threads = (size_t)threads;
+    }
+    if (compression >= 0) {
+        config.compression = (CompressionType)compression;
+    }
+    if (config.record_type_count > 0 && (range || shard || streaming || checkpoint_bytes > 0 || mutate)) {
+        // The trailer totals every detail record, so the file is written in one run.
+        fprintf(stderr, "Error: files with RECORD_TYPE sections cannot be used with --range, --shard, --rate, "
+                        "--duration, --checkpoint, --resume or --mutate.\n");
+        free_config(&config);
+        return 1;
+    }
+    if (range || shard) {
+        size_t total = config.record_count;
+        size_t start, count;
+        if (config.block_size > 0) {
+            fprintf(stderr, "Error: --range and --shard cannot be used with BLOCK_SIZE (blocks span records).\n");
+            free_config(&config);
+            return 1;
+        }
+        if (range) {
+            if (part_a > total || part_b > total - part_a) {
+                fprintf(stderr, "Error: Range '%s' is outside the %zu records of the definition.\n", range, total);
+                free_config(&config);
+                return 1;
+            }
+            start = (size_t)part_a;
+            count = (size_t)part_b;
+        } else {
+            // Shard sizes differ by at most one record.
+            size_t n = (size_t)part_b, k = (size_t)part_a - 1;
+            size_t base = total / n, rem = total % n;
+            start = k * base + (k < rem ? k : rem);
+            count = base + (k < rem ? 1 : 0);
+        }
+        config.first_record = start;
+        config.record_count = count;
+    }
+    if (streaming && (config.block_size > 0 || config.compression != COMPRESS_NONE)) {
+        // Paced batches are written as they are; blocks and compressed frames would span them.
+        fprintf(stderr, "Error: --rate and --duration cannot be used with BLOCK_SIZE or COMPRESSION.\n");
+        free_config(&config);
+        return 1;
+    }
+    if (verify) {
+        // The file is checked against what this definition generates.
+        if (config.compression != COMPRESS_NONE) {
+            fprintf(stderr, "Error: --verify reads uncompressed files; decompress the file and pass -z none.\n");
+            free_config(&config);
+            return 1;
+        }
+        if (seed_given) {
+            config.seed = (uint64_t)seed;
+            config.seed_set = 1;
+        }
+        int rc = verify_file(&config, verify);
+        free_config(&config);
+        return rc ? 1 : 0;
+    }
+    if (mutate) {
+        // The new file is written in record order from the base's bytes.
+        struct stat base_st, out_st;
+        if (config.compression != COMPRESS_NONE || config.block_size > 0) {
+            fprintf(stderr, "Error: --mutate cannot be used with COMPRESSION or BLOCK_SIZE.\n");
+            free_config(&config);
+            return 1;
+        }
+        if (stat(base, &base_st) == 0 && stat(out_file, &out_st) == 0 &&
+            base_st.st_dev == out_st.st_dev && base_st.st_ino == out_st.st_ino) {
+            fprintf(stderr, "Error: The output file cannot be the base file.\n");
+            free_config(&config);
+            return 1;
+        }
+        if (config.key_length > 0 && config.key_random && !seed_given && !config.seed_set) {
+            // Inserted records take the keys after the base's in the seed's
+            // permutation; any other seed would repeat keys of the base.
+            fprintf(stderr, "Error: --mutate with a RANDOM KEY needs the seed of the base file (-s or SEED).\n");
+            free_config(&config);
+            return 1;
+        }
+    }
+    config.mmap_output = mmap_output;
+    config.rate = rate;
+    config.rate_records = rate_records;
+    if (duration >= 0) {
+        config.timed = 1;
+        config.duration = (unsigned)duration;
+    }
+    char *checkpoint_path = NULL;
+    Checkpoint cp;
+    if (checkpoint_bytes > 0) {
+        // Resuming appends to the file, so it must come out the same way.
+        if (config.compression != COMPRESS_NONE || config.block_size > 0) {
+            fprintf(stderr, "Error: --checkpoint and --resume cannot be used with COMPRESSION or BLOCK_SIZE.\n");
+            free_config(&config);
+            return 1;
+        }
+        checkpoint_path = malloc(strlen(out_file) + sizeof(CHECKPOINT_SUFFIX));
+        if (!checkpoint_path) {
+            perror("Error allocating memory");
+            free_config(&config);
+            return 1;
+        }
+        strcpy(checkpoint_path, out_file);
+        strcat(checkpoint_path, CHECKPOINT_SUFFIX);
+        config.checkpoint_path = checkpoint_path;
+        config.checkpoint_bytes = checkpoint_bytes;
+        if (checkpoint_hash_file(def_file, &config.definition_hash) != 0 ||
+            (resume && load_checkpoint(&config, seed_given, (uint64_t)seed, &cp) != 0)) {
+            free(checkpoint_path);
+            free_config(&config);
+            return 1;
+        }
+    }
+    config.stats = stats;
+    config.stats_json = stats_json;
+    if (progress >= 0) {
+        config.progress = 1;
+        config.progress_interval = (unsigned)progress;
+    }
+
+    // Initialize random seed: -s wins over SEED=, otherwise derive one from the clock
+    // and report it so the run can be reproduced.
+    if (seed_given) {
+        config.seed = (uint64_t)seed;
+    } else if (!config.seed_set) {
+        config.seed = (uint64_t)time(NULL);
+        fprintf(stderr, "Using random seed %llu\n", (unsigned long long)config.seed);
+    }
+
+    // "-o -" streams to standard output.
+    int to_stdout = (strcmp(out_file, "-") == 0);
+    FILE *f_out = to_stdout ? stdout : fopen(out_file, resume ? "r+b" : generate_output_mode(out_file));
     if (!f_out) {
         fprintf(stderr, "DEBUG: trying to open '%s'\n", out_file);
         perror("Error opening output file");
+        free(checkpoint_path);
         free_config(&config);
         return 1;
     }
 
-    if (generate_data(&config, f_out) != 0) {
+    if (resume) {
+        // Whatever was written after the checkpoint is generated again.
+        struct stat st;
+        off_t end = (off_t)cp.output_bytes;
+        if (fstat(fileno(f_out), &st) != 0 || st.st_size < end) {
+            fprintf(stderr, "Error: %s is shorter than checkpoint %s says (%llu bytes).\n", out_file,
+                    checkpoint_path, (unsigned long long)cp.output_bytes);
+            fclose(f_out);
+            free(checkpoint_path);
+            free_config(&config);
+            return 1;
+        }
+        if (ftruncate(fileno(f_out), end) != 0 || fseeko(f_out, end, SEEK_SET) != 0) {
+            perror("Error truncating output file");
+            fclose(f_out);
+            free(checkpoint_path);
+            free_config(&config);
+            return 1;
+        }
+        fprintf(stderr, "Resuming at record %zu of %zu (%llu bytes)\n", config.first_record + cp.records_done,
+                config.first_record + config.record_count, (unsigned long long)cp.output_bytes);
+    }
+
+    int rc = mutate ? mutate_file(&config, &mutation, base, f_out) : generate_data(&config, f_out);
+    if (rc != 0) {
         fprintf(stderr, "Error generating data.\n");
         fclose(f_out);
+        free(checkpoint_path);
         free_config(&config);
         return 1;
     }
 
     fclose(f_out);
+    free(checkpoint_path);
     free_config(&config);
-    printf("Data generation completed successfully.\n");
+    // The data itself may be on stdout.
+    fprintf(to_stdout ? stderr : stdout, "Data generation completed successfully.\n");
     return 0;
 }
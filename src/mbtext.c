@@ -0,0 +1,271 @@
+#include "mbtext.h"
+#include "alias.h"
+#include "randfill.h"
+#include "codepage.h"
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+
+// Shift-JIS: chance that the next character is a 2-byte one (when it fits).
+#define SJIS_DBCS_RATE 0.70
+// ISO-2022: chance of switching between SBCS and DBCS at each position.
+#define ISO_SWITCH_RATE 0.30
+
+#define MAX_CODES 4096
+
+// We select valid characters based on JIS X 0208 rows to avoid undefined areas.
+// JIS X 0208 Allocation:
+// Row 1: Symbols
+// Row 4: Hiragana
+// Row 5: Katakana
+// Row 16-47: Level 1 Kanji (row 47 ends at cell 51)
+typedef struct {
+    int first_row;
+    int last_row;
+    int cells;       // Cells used per row
+    int last_cells;  // Cells used in the last row
+    double weight;   // Share of all 2-byte characters, spread evenly over the rows
+} JisClass;
+
+static const JisClass SJIS_CLASSES[] = {
+    { 1, 1, 60, 60, 0.10 },     // Symbols, limited to the common ones
+    { 4, 4, 83, 83, 0.10 },     // Hiragana
+    { 5, 5, 86, 86, 0.10 },     // Katakana
+    { 16, 47, 94, 51, 0.70 },   // Kanji Level 1
+};
+
+static const JisClass ISO_CLASSES[] = {
+    { 16, 47, 94, 51, 1.00 },   // Kanji Level 1
+};
+
+// IBM host DBCS (CCSID 300, used by CP930/CP939). Both bytes are 0x41-0xFE.
+// Row 0x42 holds the full-width forms of the EBCDIC letters and digits at
+// their single-byte code points; rows 0x45-0x55 are the basic Kanji, of which
+// the fully populated rows are used.
+#define HOST_KANJI_FIRST_ROW 0x45
+#define HOST_KANJI_LAST_ROW 0x54
+#define HOST_ALNUM_ROW 0x42
+#define HOST_KANJI_WEIGHT 0.90
+
+typedef struct {
+    unsigned char code[MAX_CODES][2];
+    size_t count;
+    size_t class_end[MBTEXT_MAX_CLASSES];  // Codes of class c end before class_end[c]
+    size_t class_count;
+    AliasTable alias;
+} CodeTable;
+
+static CodeTable sjis_table;
+static CodeTable iso_table;
+static CodeTable host_table;
+static double log_sjis_dbcs;    // log(SJIS_DBCS_RATE)
+static double log_sjis_sbcs;    // log(1 - SJIS_DBCS_RATE)
+static double log_iso_stay;     // log(1 - ISO_SWITCH_RATE)
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+static int tables_status;      // Result of build_tables()
+
+// Convert JIS X 0208 (row, cell) to Shift-JIS
+static void jis_to_sjis(int row, int cell, unsigned char out[2]) {
+    // Calculate first byte
+    if (row <= 62) {
+        out[0] = (unsigned char)(0x81 + (row - 1) / 2);
+    } else {
+        out[0] = (unsigned char)(0xE0 + (row - 63) / 2);
+    }
+
+    // Calculate second byte
+    if (row % 2 != 0) {
+        // Odd row
+        out[1] = (unsigned char)(0x40 + (cell - 1));
+        if (out[1] >= 0x7F) out[1]++;
+    } else {
+        // Even row
+        out[1] = (unsigned char)(0x9F + (cell - 1));
+    }
+}
+
+// ISO-2022-JP uses JIS X 0208 code points directly mapped to the 0x21-0x7E range (GL)
+static void jis_to_iso(int row, int cell, unsigned char out[2]) {
+    out[0] = (unsigned char)(0x20 + row);
+    out[1] = (unsigned char)(0x20 + cell);
+}
+
+static int build_table(CodeTable *table, const JisClass *classes, size_t n_classes,
+                       void (*encode)(int, int, unsigned char *)) {
+    static double weights[MAX_CODES];
+    table->count = 0;
+    table->class_count = 0;
+    if (n_classes > MBTEXT_MAX_CLASSES) return 1;
+
+    for (size_t c = 0; c < n_classes; c++) {
+        const JisClass *jc = &classes[c];
+        int rows = jc->last_row - jc->first_row + 1;
+        for (int row = jc->first_row; row <= jc->last_row; row++) {
+            int cells = (row == jc->last_row) ? jc->last_cells : jc->cells;
+            for (int cell = 1; cell <= cells; cell++) {
+                if (table->count >= MAX_CODES) return 1;
+                encode(row, cell, table->code[table->count]);
+                weights[table->count] = jc->weight / rows / cells;
+                table->count++;
+            }
+        }
+        table->class_end[table->class_count++] = table->count;
+    }
+    return alias_build(&table->alias, weights, table->count);
+}
+
+static int build_host_table(CodeTable *table) {
+    static double weights[MAX_CODES];
+    static const char ALNUM[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+    const Codepage *cp037 = codepage_get(CODEPAGE_CP037);
+    size_t kanji = (size_t)(HOST_KANJI_LAST_ROW - HOST_KANJI_FIRST_ROW + 1) * (0xFE - 0x41 + 1);
+    size_t alnum = sizeof(ALNUM) - 1;
+    table->count = 0;
+
+    for (int row = HOST_KANJI_FIRST_ROW; row <= HOST_KANJI_LAST_ROW; row++) {
+        for (int cell = 0x41; cell <= 0xFE; cell++) {
+            table->code[table->count][0] = (unsigned char)row;
+            table->code[table->count][1] = (unsigned char)cell;
+            weights[table->count++] = HOST_KANJI_WEIGHT / kanji;
+        }
+    }
+    table->class_end[0] = table->count;
+    for (size_t k = 0; k < alnum; k++) {
+        table->code[table->count][0] = HOST_ALNUM_ROW;
+        table->code[table->count][1] = cp037->map[(unsigned char)ALNUM[k]];
+        weights[table->count++] = (1.0 - HOST_KANJI_WEIGHT) / alnum;
+    }
+    table->class_end[1] = table->count;
+    table->class_count = 2;
+    return alias_build(&table->alias, weights, table->count);
+}
+
+static void build_tables(void) {
+    codepage_init();
+
+    if (build_table(&sjis_table, SJIS_CLASSES, sizeof(SJIS_CLASSES) / sizeof(SJIS_CLASSES[0]), jis_to_sjis) != 0 ||
+        build_table(&iso_table, ISO_CLASSES, sizeof(ISO_CLASSES) / sizeof(ISO_CLASSES[0]), jis_to_iso) != 0 ||
+        build_host_table(&host_table) != 0) {
+        tables_status = 1;
+        return;
+    }
+    log_sjis_dbcs = log(SJIS_DBCS_RATE);
+    log_sjis_sbcs = log(1.0 - SJIS_DBCS_RATE);
+    log_iso_stay = log(1.0 - ISO_SWITCH_RATE);
+}
+
+int mbtext_init(void) {
+    pthread_once(&tables_once, build_tables);
+    return tables_status;
+}
+
+// Number of further steps a run continues when each step continues with
+// probability exp(log_continue): P(n) = c^n * (1 - c), sampled by inversion.
+static size_t geometric(Prng *rng, double log_continue) {
+    double u = (double)((prng_next(rng) >> 11) + 1) * 0x1p-53;  // (0, 1]
+    double n = log(u) / log_continue;
+    return (n >= 1e15) ? (size_t)1e15 : (size_t)n;
+}
+
+static void emit_dbcs(const CodeTable *table, Prng *rng, unsigned char *out, size_t chars) {
+    for (size_t k = 0; k < chars; k++) {
+        const unsigned char *code = table->code[alias_sample(&table->alias, rng)];
+        out[0] = code[0];
+        out[1] = code[1];
+        out += 2;
+    }
+}
+
+void mbtext_fill_sjis(Prng *rng, unsigned char *buffer, size_t length) {
+    // Characters are independently 2-byte with SJIS_DBCS_RATE, so run lengths
+    // of both kinds are geometric. The first run's kind is drawn the same way.
+    int dbcs = (prng_next(rng) >> 11) * 0x1p-53 < SJIS_DBCS_RATE;
+    size_t i = 0;
+
+    while (i < length) {
+        size_t room = length - i;
+        if (dbcs && room >= 2) {
+            size_t run = 1 + geometric(rng, log_sjis_dbcs);
+            if (run > room / 2) run = room / 2;
+            emit_dbcs(&sjis_table, rng, buffer + i, run);
+            i += run * 2;
+        } else {
+            // Random printable ASCII (0x20 - 0x7E); also covers a single byte left at the end.
+            size_t run = 1 + geometric(rng, log_sjis_sbcs);
+            if (run > room) run = room;
+            randfill_ascii(rng, buffer + i, run);
+            i += run;
+        }
+        dbcs = !dbcs;
+    }
+}
+
+// Double-byte characters of the output codepage: host DBCS for EBCDIC,
+// otherwise Shift-JIS (PIC N) or 7-bit JIS (inside ISO-2022 escapes).
+static const CodeTable *dbcs_table(const Config *config, const CodeTable *ascii_table) {
+    return codepage_get(config->output_codepage)->dbcs ? &host_table : ascii_table;
+}
+
+void mbtext_alphabet(const Config *config, MbtextAlphabet *alphabet) {
+    const CodeTable *table = (config->text_type == TEXT_TYPE_SJIS) ? &sjis_table : dbcs_table(config, &iso_table);
+    alphabet->code = (const unsigned char (*)[2])table->code;
+    alphabet->count = table->count;
+    alphabet->class_end = table->class_end;
+    alphabet->class_count = table->class_count;
+}
+
+void mbtext_fill_dbcs(Prng *rng, unsigned char *buffer, size_t length, const Config *config) {
+    emit_dbcs(dbcs_table(config, &sjis_table), rng, buffer, length / 2);
+    if (length % 2) buffer[length - 1] = codepage_get(config->output_codepage)->space;
+}
+
+void mbtext_fill_dbcs_bits(const unsigned char *bits, unsigned char *buffer, size_t length, const Config *config) {
+    const CodeTable *table = dbcs_table(config, &sjis_table);
+    for (size_t k = 0; k < length / 2; k++) {
+        uint64_t r;
+        memcpy(&r, bits + k * 8, sizeof(r));
+        const unsigned char *code = table->code[alias_sample_bits(&table->alias, r)];
+        buffer[2 * k] = code[0];
+        buffer[2 * k + 1] = code[1];
+    }
+    if (length % 2) buffer[length - 1] = codepage_get(config->output_codepage)->space;
+}
+
+void mbtext_fill_iso2022(Prng *rng, unsigned char *buffer, size_t length, const Config *config) {
+    // Mixed JIS X 0201 (SBCS) and JIS X 0208 (DBCS) with SO/SI codes
+    // Start Code = SO (Shift Out) -> to DBCS
+    // End Code = SI (Shift In) -> to SBCS
+    // Default state is SBCS, and every record ends in SBCS.
+    // A DBCS run needs room for Start Code + one character (2) + End Code.
+    size_t frame = config->start_code_len + config->end_code_len;
+    size_t min_run = frame + 2;
+    size_t i = 0;
+    const Codepage *cp = codepage_get(config->output_codepage);
+    const CodeTable *table = dbcs_table(config, &iso_table);
+
+    while (i < length) {
+        size_t room = length - i;
+        size_t sbcs = geometric(rng, log_iso_stay);
+
+        // SBCS characters are printable (0x20 - 0x7E in ASCII), which never
+        // contains ESC (0x1B) or SO/SI, so no stray shift codes can appear.
+        if (room < min_run || sbcs > room - min_run) {
+            // No DBCS run fits after this SBCS run: the rest is SBCS.
+            codepage_fill_text(cp, rng, buffer + i, room);
+            break;
+        }
+        codepage_fill_text(cp, rng, buffer + i, sbcs);
+        i += sbcs;
+
+        size_t chars = 1 + geometric(rng, log_iso_stay);
+        size_t fit = (length - i - frame) / 2;
+        if (chars > fit) chars = fit;
+
+        memcpy(&buffer[i], config->start_code, config->start_code_len);
+        i += config->start_code_len;
+        emit_dbcs(table, rng, buffer + i, chars);
+        i += chars * 2;
+        memcpy(&buffer[i], config->end_code, config->end_code_len);
+        i += config->end_code_len;
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef MBTEXT_H
+#define MBTEXT_H
+
+#include <stddef.h>
+#include "config.h"
+#include "prng.h"
+
+// Table-driven generation of Japanese multibyte text.
+//
+// The JIS X 0208 code points are converted once into Shift-JIS and 7-bit JIS
+// tables and sampled through alias tables. Instead of deciding the character
+// class per byte, the generators draw the length of each single-byte and
+// double-byte run and emit the whole run at once.
+
+// Builds the code point tables. Must be called before the first fill;
+// later calls return the first one's result. Thread-safe.
+// Returns 0 on success, non-zero on error.
+int mbtext_init(void);
+
+// Random Shift-JIS text: 2-byte characters interspersed with printable ASCII.
+// A 2-byte character is never split at the end of the buffer.
+void mbtext_fill_sjis(Prng *rng, unsigned char *buffer, size_t length);
+
+// Random double-byte characters only (PIC N style): Shift-JIS, or IBM host
+// DBCS with an EBCDIC OUTPUT_CODEPAGE. An odd trailing byte is padded with a
+// space.
+void mbtext_fill_dbcs(Prng *rng, unsigned char *buffer, size_t length, const Config *config);
+
+// Same as mbtext_fill_dbcs(), drawing each character from 8 bytes of
+// caller-supplied random bits (length / 2 * 8 bytes).
+void mbtext_fill_dbcs_bits(const unsigned char *bits, unsigned char *buffer, size_t length, const Config *config);
+
+// Random ISO-2022 text: printable characters with DBCS runs framed by the
+// start and end codes of the config (7-bit JIS, or host DBCS between SO/SI
+// for CP930/CP939). Every DBCS run contains at least one character and is
+// closed before the end of the buffer.
+void mbtext_fill_iso2022(Prng *rng, unsigned char *buffer, size_t length, const Config *config);
+
+#define MBTEXT_MAX_CLASSES 4
+
+// Double-byte characters drawn by mbtext_fill_sjis() or inside the DBCS
+// runs of mbtext_fill_iso2022(), class by class (symbols, kana, Kanji, ...).
+// The characters of a class are about equally likely.
+typedef struct {
+    const unsigned char (*code)[2];
+    size_t count;
+    const size_t *class_end;         // Codes of class c end before class_end[c]
+    size_t class_count;
+} MbtextAlphabet;
+
+// Double-byte alphabet of TEXT_TYPE=SJIS or ISO_2022 text of the config.
+void mbtext_alphabet(const Config *config, MbtextAlphabet *alphabet);
+
+#endif // MBTEXT_H
@@ -0,0 +1,28 @@
+#ifndef MFDATAGEN_H
+#define MFDATAGEN_H
+
+// libmfdatagen: the generator as a library (libmfdatagen.a / libmfdatagen.so).
+// mnfgendat itself is main.c linked against it.
+//
+// Records in memory, pulled into a caller-owned buffer:
+//
+//     GenStream *s = generate_stream_open_definition("RECORD_LENGTH=100\nRECORD_COUNT=1000\nSEED=1\n");
+//     size_t cap = 1 << 20, n;
+//     unsigned char *buf = malloc(cap);
+//     while ((n = generate_stream_next(s, buf, cap)) > 0) consume(buf, n);
+//     generate_stream_close(s);
+//
+// Files, as the command line writes them: parse_definition() into a
+// zeroed Config, then generate_data() or verify_file(). batch_run() takes
+// definition/output path pairs (BatchJobSpec) and runs them as -m does.
+//
+// Link with -lmfdatagen -pthread -lm, plus -lz / -lzstd when the library
+// was built with compression.
+
+#include "config.h"
+#include "parser.h"
+#include "generator.h"
+#include "verify.h"
+#include "batch.h"
+
+#endif // MFDATAGEN_H
@@ -0,0 +1,304 @@
+#define _GNU_SOURCE  // copy_file_range
+#include "mutate.h"
+#include "generator.h"
+#include "prng.h"
+#include "key.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Keep the draws of a derived version apart from the base's generators.
+#define MUTATE_DECISION_SALT 0x4D555444454349ULL
+#define MUTATE_RECORD_SALT 0x4D555452454344ULL
+
+// Generated records are collected up to this size before they are written.
+#define MUTATE_BUFFER_BYTES (1024 * 1024)
+// Largest single copy_file_range() request.
+#define MUTATE_COPY_CHUNK ((size_t)1 << 30)
+
+static int parse_percent(const char *value, double *share) {
+    char *endp;
+    double p = strtod(value, &endp);
+    if (endp == value || !(p >= 0.0 && p <= 100.0)) return -1;
+    if (*endp == '%') endp++;
+    if (*endp != '\0') return -1;
+    *share = p / 100.0;
+    return 0;
+}
+
+int mutate_parse(const char *spec, MutateOptions *options) {
+    char buf[256];
+    if (strlen(spec) >= sizeof(buf)) return -1;
+    strcpy(buf, spec);
+    options->update = 0.0;
+    options->remove = 0.0;
+    options->insert = 0.0;
+    options->version = 2;
+
+    for (char *item = strtok(buf, ","); item; item = strtok(NULL, ",")) {
+        char *value = strchr(item, '=');
+        if (!value) return -1;
+        *value++ = '\0';
+        if (strcmp(item, "update") == 0) {
+            if (parse_percent(value, &options->update) != 0) return -1;
+        } else if (strcmp(item, "delete") == 0) {
+            if (parse_percent(value, &options->remove) != 0) return -1;
+        } else if (strcmp(item, "insert") == 0) {
+            if (parse_percent(value, &options->insert) != 0) return -1;
+        } else if (strcmp(item, "version") == 0) {
+            char *endp;
+            unsigned long n = strtoul(value, &endp, 10);
+            if (*value == '\0' || *value == '-' || *endp != '\0' || n > 0xFFFFFFFFul) return -1;
+            options->version = (unsigned)n;
+        } else {
+            return -1;
+        }
+    }
+    return (options->update + options->remove <= 1.0) ? 0 : -1;
+}
+
+// The new file: runs of kept base bytes and buffered new records, written
+// in order. At most one of the two is pending at a time.
+typedef struct {
+    int fd;
+    int base_fd;
+    const unsigned char *base;
+    int can_copy;               // copy_file_range() works between the two files
+    off_t run_start;            // Kept base bytes not yet written
+    size_t run_len;
+    unsigned char *buffer;      // New records not yet written
+    size_t buffered;
+} MutateWriter;
+
+static int write_all(int fd, const unsigned char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Error writing output file");
+            return 1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int flush_run(MutateWriter *w) {
+    while (w->run_len > 0 && w->can_copy) {
+        size_t len = (w->run_len < MUTATE_COPY_CHUNK) ? w->run_len : MUTATE_COPY_CHUNK;
+        loff_t in = w->run_start;
+        ssize_t n = copy_file_range(w->base_fd, &in, w->fd, NULL, len, 0);
+        if (n <= 0) {
+            // Not between these files (pipes, other file systems, old
+            // kernels): write the rest from the mapping.
+            w->can_copy = 0;
+            break;
+        }
+        w->run_start += n;
+        w->run_len -= (size_t)n;
+    }
+    int rc = write_all(w->fd, w->base + w->run_start, w->run_len);
+    w->run_start += (off_t)w->run_len;
+    w->run_len = 0;
+    return rc;
+}
+
+static int flush_buffer(MutateWriter *w) {
+    int rc = write_all(w->fd, w->buffer, w->buffered);
+    w->buffered = 0;
+    return rc;
+}
+
+static int keep_bytes(MutateWriter *w, off_t offset, size_t len) {
+    if (w->buffered > 0 && flush_buffer(w) != 0) return 1;
+    if (w->run_len > 0 && w->run_start + (off_t)w->run_len != offset && flush_run(w) != 0) return 1;
+    if (w->run_len == 0) w->run_start = offset;
+    w->run_len += len;
+    return 0;
+}
+
+// Space for one new record at the end of the buffer.
+static unsigned char *new_record(MutateWriter *w, size_t record_bytes) {
+    if (w->run_len > 0 && flush_run(w) != 0) return NULL;
+    if (w->buffered + record_bytes > MUTATE_BUFFER_BYTES && flush_buffer(w) != 0) return NULL;
+    return w->buffer + w->buffered;
+}
+
+// Uniform draw in [0, 1).
+static double draw_share(Prng *rng) {
+    return (double)(prng_next(rng) >> 11) / 9007199254740992.0;
+}
+
+typedef struct {
+    size_t kept;
+    size_t updated;
+    size_t deleted;
+    size_t inserted;
+} MutateCounts;
+
+static int walk_base(const Config *config, const MutateOptions *options, GenStream *stream,
+                     MutateWriter *w, size_t base_size, FILE *changes, MutateCounts *counts) {
+    int variable = (config->file_type == FILE_TYPE_VARIABLE);
+    size_t record_bytes = generate_stream_record_bytes(stream);
+    size_t data_offset = variable ? 4 : 0;
+    uint64_t decision_key = prng_record_key(config->seed ^ MUTATE_DECISION_SALT ^ options->version);
+    uint64_t record_key = prng_record_key(config->seed ^ MUTATE_RECORD_SALT ^ options->version);
+    uint64_t key_space_size = config->key_length ? key_space(config->key_format, config->key_length) : 0;
+    size_t new_index = 0;
+    size_t offset = 0;
+    size_t index = 0;
+
+    for (; offset < base_size; index++) {
+        size_t bytes = record_bytes;
+        if (variable) {
+            const unsigned char *rdw = w->base + offset;
+            size_t total = 0;
+            if (base_size - offset >= 4) {
+                total = (config->rdw_endian == RDW_ENDIAN_BIG) ? ((size_t)rdw[0] << 8 | rdw[1])
+                                                               : ((size_t)rdw[1] << 8 | rdw[0]);
+            }
+            if (total < 5 || total > record_bytes || rdw[2] != 0 || rdw[3] != 0) {
+                fprintf(stderr, "Invalid RDW of record %zu at offset %zu of the base file\n", index, offset);
+                return 1;
+            }
+            bytes = total;
+        }
+        if (bytes > base_size - offset) {
+            fprintf(stderr, "The base file ends inside record %zu\n", index);
+            return 1;
+        }
+        if (index >= config->record_count) {
+            fprintf(stderr, "The base file holds more than the %zu records of the definition\n", config->record_count);
+            return 1;
+        }
+
+        Prng rng;
+        prng_seed_record(&rng, decision_key, index);
+        double fate = draw_share(&rng);
+        if (fate < options->remove) {
+            if (changes) fprintf(changes, "DELETE %zu -\n", index);
+            counts->deleted++;
+        } else if (fate < options->remove + options->update) {
+            unsigned char *dst = new_record(w, record_bytes);
+            if (!dst) return 1;
+            size_t len = generate_stream_record(stream, record_key, index, dst);
+            if (config->key_length) {
+                // Same record, new contents.
+                memcpy(dst + data_offset + config->key_offset, w->base + offset + data_offset + config->key_offset,
+                       config->key_length);
+            }
+            w->buffered += len;
+            if (changes) fprintf(changes, "UPDATE %zu %zu\n", index, new_index);
+            counts->updated++;
+            new_index++;
+        } else {
+            if (keep_bytes(w, (off_t)offset, bytes) != 0) return 1;
+            counts->kept++;
+            new_index++;
+        }
+
+        if (draw_share(&rng) < options->insert) {
+            // New records take the indexes (and KEYs) after the base's.
+            size_t insert_index = config->record_count + counts->inserted;
+            if (key_space_size != 0 && insert_index + (config->key_random ? 1 : 2) > key_space_size) {
+                fprintf(stderr, "KEY has no distinct values left for inserted records\n");
+                return 1;
+            }
+            unsigned char *dst = new_record(w, record_bytes);
+            if (!dst) return 1;
+            w->buffered += generate_stream_record(stream, record_key, insert_index, dst);
+            if (changes) fprintf(changes, "INSERT - %zu\n", new_index);
+            counts->inserted++;
+            new_index++;
+        }
+        offset += bytes;
+    }
+
+    if (index != config->record_count) {
+        fprintf(stderr, "The base file holds %zu records, the definition %zu\n", index, config->record_count);
+        return 1;
+    }
+    if (w->run_len > 0 && flush_run(w) != 0) return 1;
+    if (w->buffered > 0 && flush_buffer(w) != 0) return 1;
+    return 0;
+}
+
+int mutate_file(const Config *config, const MutateOptions *options, const char *base_path, FILE *output_file) {
+    int base_fd = open(base_path, O_RDONLY);
+    if (base_fd < 0) {
+        perror("Error opening base file");
+        return 1;
+    }
+    struct stat st;
+    if (fstat(base_fd, &st) != 0) {
+        perror("Error reading base file");
+        close(base_fd);
+        return 1;
+    }
+    size_t base_size = (size_t)st.st_size;
+
+    MutateWriter w;
+    memset(&w, 0, sizeof(w));
+    w.fd = fileno(output_file);
+    w.base_fd = base_fd;
+    w.can_copy = 1;
+
+    GenStream *stream = generate_stream_open(config);
+    FILE *changes = NULL;
+    int rc = 0;
+    if (!stream) {
+        rc = 1;
+    } else if (generate_stream_record_bytes(stream) > MUTATE_BUFFER_BYTES) {
+        fprintf(stderr, "Error: --mutate handles records of up to %d bytes.\n", MUTATE_BUFFER_BYTES);
+        rc = 1;
+    } else if (!(w.buffer = malloc(MUTATE_BUFFER_BYTES))) {
+        perror("Error allocating memory for record buffer");
+        rc = 1;
+    } else if (options->changes_path && !(changes = fopen(options->changes_path, "w"))) {
+        perror("Error opening change manifest");
+        rc = 1;
+    } else if (fflush(output_file) != 0) {
+        perror("Error writing output file");
+        rc = 1;
+    }
+
+    void *map = NULL;
+    if (rc == 0 && base_size > 0) {
+        map = mmap(NULL, base_size, PROT_READ, MAP_SHARED, base_fd, 0);
+        if (map == MAP_FAILED) {
+            perror("Error mapping base file");
+            map = NULL;
+            rc = 1;
+        } else {
+            madvise(map, base_size, MADV_SEQUENTIAL);
+        }
+    }
+
+    MutateCounts counts;
+    memset(&counts, 0, sizeof(counts));
+    if (rc == 0) {
+        w.base = map;
+        if (changes) fprintf(changes, "# operation base_record new_record\n");
+        rc = walk_base(config, options, stream, &w, base_size, changes, &counts);
+    }
+    if (changes && fclose(changes) != 0 && rc == 0) {
+        perror("Error writing change manifest");
+        rc = 1;
+    }
+    if (rc == 0) {
+        fprintf(stderr, "Derived %zu records from %zu: %zu kept, %zu updated, %zu deleted, %zu inserted.\n",
+                counts.kept + counts.updated + counts.inserted, counts.kept + counts.updated + counts.deleted,
+                counts.kept, counts.updated, counts.deleted, counts.inserted);
+    }
+
+    if (map) munmap(map, base_size);
+    free(w.buffer);
+    generate_stream_close(stream);
+    close(base_fd);
+    return rc;
+}
@@ -0,0 +1,37 @@
+#ifndef MUTATE_H
+#define MUTATE_H
+
+#include <stdio.h>
+#include "config.h"
+
+// Derived versions of a file (--base, --mutate).
+//
+// The base file, generated earlier from the same definition, is mapped and
+// walked record by record: FIXED records of the definition's size, or
+// VARIABLE records by their RDWs. A draw from a generator keyed by the seed,
+// the version and the record's index decides whether a record is kept,
+// updated or deleted, and whether a new record is inserted after it, so the
+// same options always derive the same file. Runs of kept records are copied
+// with copy_file_range(), which the kernel can serve by sharing extents
+// (reflink) or copying without a round trip through user space; only the
+// updated and inserted records are generated, by the normal fill logic. An
+// updated record keeps the KEY of the original, and inserted records take
+// the KEYs that follow RECORD_COUNT, so keys stay unique.
+
+typedef struct {
+    double update;              // Share of the base records regenerated
+    double remove;              // Share of the base records dropped
+    double insert;              // New records per base record
+    unsigned version;           // Keys the draws, so versions of a base differ
+    const char *changes_path;   // Change manifest (NULL = none)
+} MutateOptions;
+
+// Parses "update=<p>%,insert=<p>%,delete=<p>%[,version=<n>]" (any subset, in
+// any order). Returns 0 on success, non-zero on error.
+int mutate_parse(const char *spec, MutateOptions *options);
+
+// Writes the derived version of `base_path` to `output_file`.
+// Returns 0 on success, non-zero on error.
+int mutate_file(const Config *config, const MutateOptions *options, const char *base_path, FILE *output_file);
+
+#endif // MUTATE_H
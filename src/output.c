@@ -0,0 +1,407 @@
+#define _GNU_SOURCE  // O_DIRECT
+#include "output.h"
+#include "compress.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define OUTPUT_BUFFERS 4
+#define MAX_IOV 64
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+typedef enum {
+    BLOCK_FREE,
+    BLOCK_SUBMITTED,   // Waiting for a compression thread
+    BLOCK_READY        // Ready to be written
+} BlockState;
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    unsigned char *packed;   // Compressed form (compression only)
+    size_t packed_len;
+    BlockState state;
+} Block;
+
+struct OutputWriter {
+    int fd;
+    OutputOptions options;
+    Block *blocks;
+    size_t block_count;
+    size_t head;        // Blocks submitted so far (the current block is blocks[head % N])
+    size_t tail;        // Blocks written so far
+    size_t next_pack;   // Next block to hand to a compression thread
+    size_t fill_pos;    // Bytes in the current block
+    int direct;         // O_DIRECT is active on fd
+    int error;          // errno of the first failed write, 0 if none
+    int closing;
+    pthread_t flusher;
+    pthread_t *packers;
+    size_t packer_count;
+    size_t packed_capacity;
+    unsigned long long raw_bytes;
+    unsigned long long written_bytes;
+    unsigned long long write_ns;   // Flusher only
+    unsigned long long wait_ns;    // Producer only
+    struct timespec started;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static void set_direct(OutputWriter *w, int on) {
+#ifdef O_DIRECT
+    int flags = fcntl(w->fd, F_GETFL);
+    if (flags < 0) return;
+    flags = on ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    if (fcntl(w->fd, F_SETFL, flags) == 0) {
+        w->direct = on;
+    }
+#else
+    (void)w;
+    (void)on;
+#endif
+}
+
+// Writes the iovecs completely, resuming after short writes. If the file
+// system refuses O_DIRECT, it is switched off and the write is retried.
+static int writev_all(OutputWriter *w, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(w->fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EINVAL && w->direct) {
+                set_direct(w, 0);
+                if (!w->direct) continue;
+            }
+            return errno;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (unsigned char *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+static int write_blocks(OutputWriter *w, size_t first, size_t count) {
+    struct iovec iov[MAX_IOV];
+    int n = 0;
+
+    for (size_t b = first; b < first + count; b++) {
+        Block *blk = &w->blocks[b % w->block_count];
+        unsigned char *data = blk->packed ? blk->packed : blk->data;
+        size_t len = blk->packed ? blk->packed_len : blk->len;
+
+        if ((w->direct && len % OUTPUT_ALIGNMENT != 0) || n == MAX_IOV) {
+            int rc = writev_all(w, iov, n);
+            if (rc != 0) return rc;
+            n = 0;
+            // Only the final block can be unaligned; write it through the page cache.
+            if (w->direct && len % OUTPUT_ALIGNMENT != 0) set_direct(w, 0);
+        }
+        iov[n].iov_base = data;
+        iov[n].iov_len = len;
+        n++;
+        w->written_bytes += len;
+    }
+    return writev_all(w, iov, n);
+}
+
+// Writes finished blocks in submission order.
+static void *flusher_main(void *arg) {
+    OutputWriter *w = arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!(w->tail < w->head && w->blocks[w->tail % w->block_count].state == BLOCK_READY) &&
+               !(w->closing && w->tail == w->head)) {
+            pthread_cond_wait(&w->cond, &w->lock);
+        }
+        if (w->tail == w->head) break;  // closing and drained
+
+        size_t first = w->tail;
+        size_t count = 0;
+        while (first + count < w->head &&
+               w->blocks[(first + count) % w->block_count].state == BLOCK_READY) {
+            count++;
+        }
+        int failed = (w->error != 0);
+        pthread_mutex_unlock(&w->lock);
+
+        unsigned long long t0 = w->options.stats ? now_ns() : 0;
+        int rc = failed ? 0 : write_blocks(w, first, count);
+        if (w->options.stats) w->write_ns += now_ns() - t0;
+
+        pthread_mutex_lock(&w->lock);
+        if (rc != 0 && w->error == 0) w->error = rc;
+        for (size_t b = first; b < first + count; b++) {
+            w->blocks[b % w->block_count].state = BLOCK_FREE;
+        }
+        w->tail += count;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+// Compresses submitted blocks; several packers work on different blocks.
+static void *packer_main(void *arg) {
+    OutputWriter *w = arg;
+    Compressor *c = compressor_create(w->options.compression, w->options.compression_level);
+
+    pthread_mutex_lock(&w->lock);
+    if (!c && w->error == 0) w->error = ENOMEM;
+    for (;;) {
+        while (w->next_pack == w->head && !w->closing) {
+            pthread_cond_wait(&w->cond, &w->lock);
+        }
+        if (w->next_pack == w->head) break;  // closing and drained
+
+        Block *blk = &w->blocks[w->next_pack % w->block_count];
+        w->next_pack++;
+        pthread_mutex_unlock(&w->lock);
+
+        size_t n = c ? compressor_run(c, blk->data, blk->len, blk->packed, w->packed_capacity) : 0;
+
+        pthread_mutex_lock(&w->lock);
+        if (n == 0 && w->error == 0) w->error = EIO;
+        blk->packed_len = n;
+        blk->state = BLOCK_READY;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    compressor_free(c);
+    return NULL;
+}
+
+static void free_writer(OutputWriter *w) {
+    if (w->blocks) {
+        for (size_t i = 0; i < w->block_count; i++) {
+            free(w->blocks[i].data);
+            free(w->blocks[i].packed);
+        }
+        free(w->blocks);
+    }
+    free(w->packers);
+    free(w);
+}
+
+OutputWriter *output_open(FILE *file, const OutputOptions *options) {
+    if (fflush(file) != 0) {
+        perror("Error writing output file");
+        return NULL;
+    }
+    if (!compress_available(options->compression)) {
+        fprintf(stderr, "Error: %s compression is not supported by this build.\n", compress_name(options->compression));
+        return NULL;
+    }
+
+    OutputWriter *w = calloc(1, sizeof(OutputWriter));
+    if (!w) {
+        perror("Error allocating output writer");
+        return NULL;
+    }
+    w->fd = fileno(file);
+    w->options = *options;
+    if (w->options.block_size < OUTPUT_MIN_BLOCK_SIZE) w->options.block_size = OUTPUT_DEFAULT_BLOCK_SIZE;
+    w->options.block_size -= w->options.block_size % OUTPUT_ALIGNMENT;
+
+    int compressing = (w->options.compression != COMPRESS_NONE);
+    if (compressing) {
+        w->packer_count = w->options.compression_threads ? w->options.compression_threads : 1;
+        // Keep every packer busy while the flusher writes and the filler fills.
+        w->block_count = w->packer_count * 2 + 2;
+        w->packers = calloc(w->packer_count, sizeof(pthread_t));
+    } else {
+        w->block_count = OUTPUT_BUFFERS;
+    }
+
+    // Each block has room for one reservation beyond its nominal size; the
+    // overflow is carried over into the next block when it is submitted.
+    size_t capacity = w->options.block_size + w->options.max_reserve;
+    capacity += OUTPUT_ALIGNMENT - capacity % OUTPUT_ALIGNMENT;
+    if (compressing) {
+        Compressor *probe = compressor_create(w->options.compression, w->options.compression_level);
+        if (!probe) {
+            fprintf(stderr, "Error initializing %s compression.\n", compress_name(w->options.compression));
+            free_writer(w);
+            return NULL;
+        }
+        w->packed_capacity = compressor_bound(probe, capacity);
+        compressor_free(probe);
+    }
+
+    w->blocks = calloc(w->block_count, sizeof(Block));
+    if (!w->blocks || (compressing && !w->packers)) {
+        fprintf(stderr, "Error allocating output buffers.\n");
+        free_writer(w);
+        return NULL;
+    }
+    for (size_t i = 0; i < w->block_count; i++) {
+        void *p = NULL;
+        if (posix_memalign(&p, OUTPUT_ALIGNMENT, capacity) != 0 ||
+            (compressing && !(w->blocks[i].packed = malloc(w->packed_capacity)))) {
+            free(p);
+            fprintf(stderr, "Error allocating output buffers.\n");
+            free_writer(w);
+            return NULL;
+        }
+        w->blocks[i].data = p;
+    }
+
+    if (w->options.direct_io) {
+        off_t pos = lseek(w->fd, 0, SEEK_CUR);
+        // Compressed blocks have arbitrary sizes, which O_DIRECT cannot write.
+        if (!compressing && pos >= 0 && pos % OUTPUT_ALIGNMENT == 0) {
+            set_direct(w, 1);
+        }
+        if (!w->direct) {
+            fprintf(stderr, "Warning: O_DIRECT not available for this output, using buffered writes.\n");
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &w->started);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+
+    if (pthread_create(&w->flusher, NULL, flusher_main, w) != 0) {
+        fprintf(stderr, "Error starting output threads.\n");
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->lock);
+        free_writer(w);
+        return NULL;
+    }
+    for (size_t i = 0; i < w->packer_count; i++) {
+        if (pthread_create(&w->packers[i], NULL, packer_main, w) != 0) {
+            fprintf(stderr, "Error starting output threads.\n");
+            w->packer_count = i;
+            pthread_mutex_lock(&w->lock);
+            w->error = EAGAIN;
+            pthread_mutex_unlock(&w->lock);
+            output_close(w);
+            return NULL;
+        }
+    }
+    return w;
+}
+
+// Hands the current block (its first `len` bytes) to the compression and
+// output threads and waits until the next buffer is free. Returns the sticky
+// error state.
+static int submit_block(OutputWriter *w, size_t len) {
+    pthread_mutex_lock(&w->lock);
+    Block *blk = &w->blocks[w->head % w->block_count];
+    blk->len = len;
+    blk->state = (w->packer_count > 0) ? BLOCK_SUBMITTED : BLOCK_READY;
+    w->raw_bytes += len;
+    w->head++;
+    pthread_cond_broadcast(&w->cond);
+    if (w->head - w->tail >= w->block_count) {
+        unsigned long long t0 = w->options.stats ? now_ns() : 0;
+        while (w->head - w->tail >= w->block_count) {
+            pthread_cond_wait(&w->cond, &w->lock);
+        }
+        if (w->options.stats) w->wait_ns += now_ns() - t0;
+    }
+    int error = w->error;
+    pthread_mutex_unlock(&w->lock);
+    return error;
+}
+
+unsigned char *output_reserve(OutputWriter *w, size_t max_len) {
+    (void)max_len;
+    return w->blocks[w->head % w->block_count].data + w->fill_pos;
+}
+
+int output_commit(OutputWriter *w, size_t len) {
+    w->fill_pos += len;
+    while (w->fill_pos >= w->options.block_size) {
+        unsigned char *full = w->blocks[w->head % w->block_count].data;
+        size_t carry = w->fill_pos - w->options.block_size;
+        if (submit_block(w, w->options.block_size) != 0) {
+            return 1;
+        }
+        // The other threads only read the submitted block, so copying its overflow is safe.
+        memcpy(w->blocks[w->head % w->block_count].data, full + w->options.block_size, carry);
+        w->fill_pos = carry;
+    }
+    return 0;
+}
+
+int output_write(OutputWriter *w, const void *data, size_t len) {
+    const unsigned char *p = data;
+    while (len > 0) {
+        size_t n = w->options.block_size - w->fill_pos;
+        if (n > len) n = len;
+        memcpy(w->blocks[w->head % w->block_count].data + w->fill_pos, p, n);
+        if (output_commit(w, n) != 0) return 1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int output_close(OutputWriter *w) {
+    // An empty compressed output still gets one (empty) member or frame, so
+    // it is a valid stream.
+    pthread_mutex_lock(&w->lock);
+    int failed = (w->error != 0);
+    pthread_mutex_unlock(&w->lock);
+    if ((w->fill_pos > 0 || (w->head == 0 && w->packer_count > 0)) && !failed) {
+        submit_block(w, w->fill_pos);
+        w->fill_pos = 0;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    w->closing = 1;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    for (size_t i = 0; i < w->packer_count; i++) {
+        pthread_join(w->packers[i], NULL);
+    }
+    pthread_join(w->flusher, NULL);
+
+    if (w->direct) set_direct(w, 0);
+
+    if (w->options.stats) {
+        w->options.stats->written_bytes += w->written_bytes;
+        w->options.stats->write_ns += w->write_ns;
+        w->options.stats->wait_ns += w->wait_ns;
+    }
+
+    int rc = 0;
+    if (w->error != 0) {
+        fprintf(stderr, "Error writing output file: %s\n", strerror(w->error));
+        rc = 1;
+    } else if (w->packer_count > 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double secs = (double)(now.tv_sec - w->started.tv_sec) + (now.tv_nsec - w->started.tv_nsec) / 1e9;
+        fprintf(stderr, "Compression (%s): %.1f MiB -> %.1f MiB, ratio %.2f:1, %.1f MB/s\n",
+                compress_name(w->options.compression),
+                w->raw_bytes / 1048576.0, w->written_bytes / 1048576.0,
+                w->written_bytes ? (double)w->raw_bytes / (double)w->written_bytes : 0.0,
+                secs > 0 ? w->raw_bytes / secs / 1e6 : 0.0);
+    }
+
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+    free_writer(w);
+    return rc;
+}
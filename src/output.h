@@ -0,0 +1,64 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "config.h"
+
+// Block-buffered output writer.
+//
+// Records are assembled into large page-aligned blocks. Full blocks are handed
+// to a background flusher thread that writes every pending block with a single
+// writev() call, so filling the next block overlaps with writing the previous
+// ones. With O_DIRECT the page cache is bypassed; the final partial block is
+// written without it because it is not a multiple of the alignment.
+//
+// With compression, submitted blocks are first compressed by a pool of
+// threads, each into an independent gzip member or zstd frame, and written
+// in their original order. A summary of the ratio and throughput is printed
+// to stderr when the writer is closed.
+
+#define OUTPUT_DEFAULT_BLOCK_SIZE (4 * 1024 * 1024)
+#define OUTPUT_MIN_BLOCK_SIZE (64 * 1024)
+#define OUTPUT_MAX_BLOCK_SIZE (1024 * 1024 * 1024)
+#define OUTPUT_ALIGNMENT 4096
+
+// Writer totals, for --stats.
+typedef struct {
+    unsigned long long written_bytes;  // Bytes written to the file (after compression)
+    unsigned long long write_ns;       // Time the flusher spent in writev()
+    unsigned long long wait_ns;        // Time the producer waited for a free block
+} OutputStats;
+
+typedef struct {
+    size_t block_size;   // Bytes per block, a multiple of OUTPUT_ALIGNMENT
+    int direct_io;       // Try to bypass the page cache (O_DIRECT)
+    size_t max_reserve;  // Largest size passed to output_reserve()
+    CompressionType compression;
+    int compression_level;       // 0 = codec default
+    size_t compression_threads;  // Compression threads (at least 1 when compressing)
+    OutputStats *stats;          // Totals are added here by output_close() (NULL = none)
+} OutputOptions;
+
+typedef struct OutputWriter OutputWriter;
+
+// Takes over writing to `file`, which is flushed first. Nothing else may
+// write to the file until output_close() returns. Returns NULL on error.
+OutputWriter *output_open(FILE *file, const OutputOptions *options);
+
+// Returns space for up to `max_len` (<= max_reserve) bytes in the current block.
+// The bytes become part of the output when output_commit() is called.
+unsigned char *output_reserve(OutputWriter *writer, size_t max_len);
+
+// Appends `len` bytes previously written to the reserved space.
+// Returns 0 on success, non-zero if the output has failed.
+int output_commit(OutputWriter *writer, size_t len);
+
+// Copies `len` bytes into the output. Returns 0 on success, non-zero on error.
+int output_write(OutputWriter *writer, const void *data, size_t len);
+
+// Writes the remaining data, stops the flusher and frees the writer.
+// Returns 0 on success, non-zero if any write failed.
+int output_close(OutputWriter *writer);
+
+#endif // OUTPUT_H
@@ -0,0 +1,250 @@
+#include "pacing.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+// Interval histogram: 16 linear sub-buckets per power of two of nanoseconds,
+// so every quantile is within about 6 %.
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB (1u << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB)
+
+typedef enum {
+    END_COUNT,        // RECORD_COUNT written
+    END_DURATION,
+    END_READER,       // EPIPE
+    END_INTERRUPTED   // SIGINT / SIGTERM
+} EndReason;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+struct Pacer {
+    int fd;
+    double rate;                // Bytes or records per second (0 = unpaced)
+    int rate_records;
+    double ns_per_unit;
+    uint64_t duration_ns;       // --duration (0 = no time limit)
+    double due_ns;              // When the next batch may be written
+    uint64_t started_ns;        // Start of the first write (0 = none yet)
+    uint64_t deadline_ns;
+    uint64_t last_ns;           // Start of the previous write
+    uint64_t ended_ns;          // End of the last write
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t batches;
+    uint64_t blocked_ns;        // Time spent inside write(): reader backpressure
+    uint64_t max_interval_ns;
+    uint64_t intervals[LATENCY_BUCKETS];
+    int done;
+    EndReason end;
+    sigset_t signals;           // SIGINT, SIGTERM
+    sigset_t old_mask;
+    struct sigaction old_int, old_term, old_pipe;
+};
+
+static unsigned latency_bucket(uint64_t ns) {
+    if (ns < LATENCY_SUB) return (unsigned)ns;
+    unsigned e = 0;
+    for (uint64_t v = ns; v > 1; v >>= 1) e++;
+    return ((e - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) |
+           (unsigned)((ns >> (e - LATENCY_SUB_BITS)) & (LATENCY_SUB - 1));
+}
+
+// Largest interval that falls into bucket `b`.
+static uint64_t latency_bucket_max(unsigned b) {
+    if (b < LATENCY_SUB) return b;
+    unsigned e = (b >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+    uint64_t low = (uint64_t)(LATENCY_SUB + (b & (LATENCY_SUB - 1))) << (e - LATENCY_SUB_BITS);
+    return low + ((uint64_t)1 << (e - LATENCY_SUB_BITS)) - 1;
+}
+
+static double latency_quantile(const Pacer *p, double q) {
+    uint64_t count = p->batches > 1 ? p->batches - 1 : 0;
+    if (count == 0) return 0.0;
+    uint64_t rank = (uint64_t)(q * (double)count + 0.999999);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += p->intervals[b];
+        if (seen >= rank) {
+            uint64_t v = latency_bucket_max(b);
+            return (v < p->max_interval_ns ? v : p->max_interval_ns) / 1e6;
+        }
+    }
+    return p->max_interval_ns / 1e6;
+}
+
+size_t pacing_batch_records(const Config *config, size_t record_bytes) {
+    if (config->rate <= 0) return 0;
+    double units = config->rate * (double)PACE_QUANTUM_NS / 1e9;
+    double records = config->rate_records ? units : units / (double)record_bytes;
+    return (records < 1.0) ? 1 : (size_t)records;
+}
+
+Pacer *pacer_create(const Config *config, int fd) {
+    Pacer *p = calloc(1, sizeof(Pacer));
+    if (!p) {
+        perror("Error allocating memory for the pacer");
+        return NULL;
+    }
+    p->fd = fd;
+    p->rate = config->rate;
+    p->rate_records = config->rate_records;
+    p->ns_per_unit = (config->rate > 0) ? 1e9 / config->rate : 0.0;
+    p->duration_ns = config->timed ? (uint64_t)config->duration * 1000000000ull : 0;
+
+    // The handlers only raise a flag; the writer checks it between batches.
+    // Without SA_RESTART a signal also cuts a pacing sleep short.
+    stop_requested = 0;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = request_stop;
+    sigaction(SIGINT, &sa, &p->old_int);
+    sigaction(SIGTERM, &sa, &p->old_term);
+    // A closed pipe ends the run; it is seen as EPIPE instead of killing the process.
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, &p->old_pipe);
+
+    sigemptyset(&p->signals);
+    sigaddset(&p->signals, SIGINT);
+    sigaddset(&p->signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &p->signals, &p->old_mask);
+
+#if defined(__linux__) && defined(PR_SET_TIMERSLACK)
+    // Wake up within microseconds of the deadline instead of the default 50 us slack.
+    if (p->rate > 0) prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+#endif
+    return p;
+}
+
+// Sleeps until the absolute monotonic time `ns`. Returns early on SIGINT/SIGTERM.
+static void sleep_until(uint64_t ns) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(ns / 1000000000ull);
+    ts.tv_nsec = (long)(ns % 1000000000ull);
+    while (!stop_requested && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+static void end_run(Pacer *p, EndReason end) {
+    p->done = 1;
+    p->end = end;
+}
+
+int pacer_write(Pacer *p, const unsigned char *data, size_t len, size_t records) {
+    uint64_t now = stats_now_ns();
+    if (p->started_ns == 0) {
+        p->started_ns = now;
+        p->due_ns = (double)now;
+        if (p->duration_ns > 0) p->deadline_ns = now + p->duration_ns;
+        pthread_sigmask(SIG_UNBLOCK, &p->signals, NULL);
+    }
+
+    if (p->ns_per_unit > 0) {
+        // After a stall, catch up at most PACE_BURST_NS worth of output at once.
+        if (p->due_ns + (double)PACE_BURST_NS < (double)now) p->due_ns = (double)now - (double)PACE_BURST_NS;
+        if (p->due_ns > (double)now) {
+            uint64_t due = (uint64_t)p->due_ns;
+            sleep_until((p->deadline_ns && due > p->deadline_ns) ? p->deadline_ns : due);
+            now = stats_now_ns();
+        }
+        p->due_ns += (double)(p->rate_records ? records : len) * p->ns_per_unit;
+    }
+    if (stop_requested) {
+        end_run(p, END_INTERRUPTED);
+        return 0;
+    }
+    if (p->deadline_ns && now >= p->deadline_ns) {
+        end_run(p, END_DURATION);
+        return 0;
+    }
+
+    if (p->last_ns) {
+        uint64_t interval = now - p->last_ns;
+        p->intervals[latency_bucket(interval)]++;
+        if (interval > p->max_interval_ns) p->max_interval_ns = interval;
+    }
+    p->last_ns = now;
+
+    // A started batch is always finished, so the stream holds whole records.
+    while (len > 0) {
+        ssize_t n = write(p->fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EPIPE) {
+                end_run(p, END_READER);
+                break;
+            }
+            perror("Error writing output file");
+            return 1;
+        }
+        data += n;
+        len -= (size_t)n;
+        p->bytes += (uint64_t)n;
+    }
+    p->ended_ns = stats_now_ns();
+    p->blocked_ns += p->ended_ns - now;
+    if (!p->done) {
+        p->records += records;
+        p->batches++;
+    }
+    return 0;
+}
+
+int pacer_done(const Pacer *p) {
+    return p->done;
+}
+
+void pacer_finish(Pacer *p) {
+    if (!p) return;
+
+    if (p->started_ns) {
+        static const char *const ends[] = {
+            "all records written", "duration reached", "reader closed the output", "interrupted"
+        };
+        double elapsed = (p->ended_ns > p->started_ns) ? (p->ended_ns - p->started_ns) / 1e9 : 0.0;
+        double mb_rate = elapsed > 0 ? p->bytes / elapsed / 1e6 : 0.0;
+        double rec_rate = elapsed > 0 ? p->records / elapsed : 0.0;
+
+        fprintf(stderr, "Streamed %llu records, %.1f MiB in %.2f s (%s): %.2f MB/s, %.0f rec/s",
+                (unsigned long long)p->records, p->bytes / 1048576.0, elapsed, ends[p->done ? p->end : END_COUNT],
+                mb_rate, rec_rate);
+        if (p->rate > 0) {
+            if (p->rate_records) fprintf(stderr, " (target %.0f rec/s)", p->rate);
+            else fprintf(stderr, " (target %.2f MB/s)", p->rate / 1e6);
+        }
+        fprintf(stderr, "\n");
+        if (p->batches > 1) {
+            fprintf(stderr, "Interval between batches: p50 %.3f ms, p99 %.3f ms, max %.3f ms over %llu batches; "
+                            "%.2f s blocked writing\n",
+                    latency_quantile(p, 0.50), latency_quantile(p, 0.99), p->max_interval_ns / 1e6,
+                    (unsigned long long)p->batches, p->blocked_ns / 1e9);
+        }
+    }
+
+    // Unblock only what pacer_create() blocked, whatever else changed since.
+    sigset_t added;
+    sigemptyset(&added);
+    if (!sigismember(&p->old_mask, SIGINT)) sigaddset(&added, SIGINT);
+    if (!sigismember(&p->old_mask, SIGTERM)) sigaddset(&added, SIGTERM);
+    pthread_sigmask(SIG_UNBLOCK, &added, NULL);
+    sigaction(SIGINT, &p->old_int, NULL);
+    sigaction(SIGTERM, &p->old_term, NULL);
+    sigaction(SIGPIPE, &p->old_pipe, NULL);
+    free(p);
+}
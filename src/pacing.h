@@ -0,0 +1,58 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <stddef.h>
+#include "config.h"
+
+// Paced streaming (--rate, --duration).
+//
+// The writing thread takes the finished batches in order from the ring the
+// workers fill ahead of it and writes each one to the output descriptor once
+// the token bucket allows it. The bucket is kept as the time the next batch
+// is due: it advances by the batch's bytes (or records) over the rate, the
+// writer sleeps on an absolute CLOCK_MONOTONIC deadline until then, and after
+// a stall (a slow reader) at most PACE_BURST_NS of missed output is caught
+// up. Batches are sized to about PACE_QUANTUM_NS of output at the rate, so
+// the stream stays smooth at any rate without a write per record.
+//
+// A run ends after RECORD_COUNT records, or for --duration after the given
+// time, when the reader closes the pipe, or on SIGINT / SIGTERM. The end
+// report gives the achieved rate and the distribution of the intervals
+// between batch writes.
+
+#define PACE_QUANTUM_NS 1000000ull   // Target output time of one batch
+#define PACE_BURST_NS 10000000ull    // Catch-up allowed after a stall
+// Batches generated ahead of the writer: up to PACE_RING_BYTES, and with
+// a rate at most about a second of output.
+#define PACE_RING_BYTES (32 * 1024 * 1024)
+#define PACE_RING_BATCHES 1024
+
+// Record indexes of a --duration run are unbounded; this many are never reached.
+#define PACE_UNBOUNDED_RECORDS ((size_t)1 << 62)
+
+typedef struct Pacer Pacer;
+
+// Records per batch for a paced run, given the largest record on disk.
+// Returns 0 if the run is not rate limited (keep the default batch size).
+size_t pacing_batch_records(const Config *config, size_t record_bytes);
+
+// Prepares a paced run writing to `fd`. SIGINT and SIGTERM end the run
+// gracefully and SIGPIPE is ignored; the two signals are blocked in the
+// calling thread so that threads created afterwards inherit the mask, and
+// are unblocked in the writing thread when the first batch is written.
+// Call it before starting any other thread. Returns NULL on error.
+Pacer *pacer_create(const Config *config, int fd);
+
+// Waits until the batch is due and writes it. Returns 0 on success (also
+// when the run has just ended, see pacer_done()), non-zero on a write error.
+int pacer_write(Pacer *pacer, const unsigned char *data, size_t len, size_t records);
+
+// Non-zero once the run is over before RECORD_COUNT: duration elapsed,
+// reader gone or interrupted.
+int pacer_done(const Pacer *pacer);
+
+// Prints the report to stderr (if anything was written), restores the
+// signal handling and frees the pacer. Accepts NULL.
+void pacer_finish(Pacer *pacer);
+
+#endif // PACING_H
@@ -1,8 +1,16 @@
 #include "parser.h"
+#include "output.h"
+#include "codepage.h"
+#include "blocking.h"
+#include "key.h"
+#include "lengths.h"
+#include "recmix.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <math.h>
 
 #define MAX_LINE_LENGTH 1024
 
@@ -25,6 +33,39 @@ static char *trim_whitespace(char *str) {
     return str;
 }
 
+// Parses a byte size with an optional K, M, G or T suffix (powers of 1024).
+// Returns 0 on success, non-zero on error.
+static int parse_size(const char *value, size_t *out) {
+    char *endp;
+    errno = 0;
+    if (*value == '\0' || *value == '-') return -1;
+    unsigned long long n = strtoull(value, &endp, 10);
+    if (errno == ERANGE || endp == value) return -1;
+
+    unsigned long long mult = 1;
+    if (*endp == 'K' || *endp == 'k') { mult = 1024ULL; endp++; }
+    else if (*endp == 'M' || *endp == 'm') { mult = 1024ULL * 1024; endp++; }
+    else if (*endp == 'G' || *endp == 'g') { mult = 1024ULL * 1024 * 1024; endp++; }
+    else if (*endp == 'T' || *endp == 't') { mult = 1024ULL * 1024 * 1024 * 1024; endp++; }
+    if (*endp != '\0') return -1;
+    if (n > (unsigned long long)SIZE_MAX / mult) return -1;
+
+    *out = (size_t)(n * mult);
+    return 0;
+}
+
+// Parses a positive decimal count. Returns 0 on success, non-zero on error
+// (also when it does not fit a size_t).
+static int parse_count(const char *value, size_t *out) {
+    char *endp;
+    errno = 0;
+    if (!isdigit((unsigned char)*value)) return -1;
+    unsigned long long n = strtoull(value, &endp, 10);
+    if (errno == ERANGE || *endp != '\0' || n == 0 || n > SIZE_MAX) return -1;
+    *out = (size_t)n;
+    return 0;
+}
+
 static int parse_fill_pattern(const char *value, Config *config) {
     if (strcmp(value, "RANDOM") == 0) {
         config->fill_type = FILL_PATTERN_RANDOM;
@@ -40,25 +81,556 @@ static int parse_fill_pattern(const char *value, Config *config) {
     } else {
         // String pattern
         config->fill_type = FILL_PATTERN_STRING;
+        free(config->string_pattern);
         config->string_pattern = strdup(value);
     }
     return 0;
 }
 
-int parse_definition(const char *filename, Config *config) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        perror("Error opening definition file");
+// Parses <number>[:<number>] parameters of LENGTH_DISTRIBUTION.
+static int parse_params(const char *value, double *params, int count) {
+    for (int i = 0; i < count; i++) {
+        if (*value != ':') return -1;
+        char *endp;
+        params[i] = strtod(value + 1, &endp);
+        if (endp == value + 1 || !(params[i] > 0.0) || !isfinite(params[i])) return -1;
+        value = endp;
+    }
+    return (*value == '\0') ? 0 : -1;
+}
+
+static int parse_length_distribution(const char *value, Config *config) {
+    if (strcmp(value, "UNIFORM") == 0) {
+        config->length_distribution = LENGTH_UNIFORM;
+    } else if (strncmp(value, "NORMAL", 6) == 0) {
+        config->length_distribution = LENGTH_NORMAL;
+        return parse_params(value + 6, config->length_param, 2);
+    } else if (strncmp(value, "LOGNORMAL", 9) == 0) {
+        config->length_distribution = LENGTH_LOGNORMAL;
+        return parse_params(value + 9, config->length_param, 2);
+    } else if (strncmp(value, "ZIPF", 4) == 0) {
+        config->length_distribution = LENGTH_ZIPF;
+        return parse_params(value + 4, config->length_param, 1);
+    } else if (strncmp(value, "EMPIRICAL:", 10) == 0 && value[10] != '\0') {
+        config->length_distribution = LENGTH_EMPIRICAL;
+        free(config->length_sample);
+        config->length_sample = strdup(value + 10);
+        if (!config->length_sample) return -1;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    FieldType type;
+} FIELD_TYPES[] = {
+    { "X", FIELD_TEXT },
+    { "9", FIELD_ZONED },
+    { "S9", FIELD_ZONED_SIGNED },
+    { "P", FIELD_PACKED },
+    { "COMP-3", FIELD_PACKED },
+    { "B", FIELD_BINARY },
+    { "COMP", FIELD_BINARY },
+    { "N", FIELD_DBCS },
+    { "M", FIELD_MIXED },
+    { "F", FIELD_FILLER },
+    { "FILLER", FIELD_FILLER },
+};
+
+static int is_numeric_field(FieldType type) {
+    return type == FIELD_ZONED || type == FIELD_ZONED_SIGNED || type == FIELD_PACKED || type == FIELD_BINARY;
+}
+
+// Parses the contents part of a FIELD line: VALUE:<text>, COUNT[:<type>]
+// or SUM:<field>. Returns 0 on success, non-zero on error.
+static int parse_field_content(const char *value, FieldDef *field) {
+    const char *source;
+    if (strncmp(value, "VALUE:", 6) == 0 && field->type == FIELD_TEXT) {
+        field->content = FIELD_CONTENT_VALUE;
+        source = value + 6;
+    } else if (strcmp(value, "COUNT") == 0 && is_numeric_field(field->type)) {
+        field->content = FIELD_CONTENT_COUNT;
+        source = "";
+    } else if (strncmp(value, "COUNT:", 6) == 0 && value[6] != '\0' && is_numeric_field(field->type)) {
+        field->content = FIELD_CONTENT_COUNT;
+        source = value + 6;
+    } else if (strncmp(value, "SUM:", 4) == 0 && value[4] != '\0' && is_numeric_field(field->type)) {
+        field->content = FIELD_CONTENT_SUM;
+        source = value + 4;
+    } else {
+        return -1;
+    }
+    if (strlen(source) >= FIELD_NAME_MAX) return -1;
+    strcpy(field->source, source);
+    return 0;
+}
+
+// Parses "NAME,TYPE,LENGTH[,CONTENT]" and appends the field to the layout.
+// DICT: names refer to the dictionaries of `config`.
+// Returns 0 on success, non-zero on error.
+static int parse_field(const char *value, Config *layout, const Config *config) {
+    char buf[MAX_LINE_LENGTH];
+    strncpy(buf, value, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *name = strtok(buf, ",");
+    char *type = strtok(NULL, ",");
+    char *length = strtok(NULL, ",");
+    char *content = strtok(NULL, ",");
+    if (!name || !type || !length || strtok(NULL, ",")) return -1;
+    name = trim_whitespace(name);
+    type = trim_whitespace(type);
+    length = trim_whitespace(length);
+    if (strlen(name) == 0 || strlen(name) >= FIELD_NAME_MAX) return -1;
+
+    FieldDef field;
+    memset(&field, 0, sizeof(field));
+    strcpy(field.name, name);
+
+    if (strncmp(type, "DICT:", 5) == 0) {
+        // The dictionary must be declared on an earlier line.
+        size_t d;
+        for (d = 0; d < config->dictionary_count; d++) {
+            if (strcmp(type + 5, config->dictionaries[d].name) == 0) break;
+        }
+        if (d == config->dictionary_count) return -1;
+        field.type = FIELD_DICTIONARY;
+        field.dictionary = d;
+    } else {
+        size_t t;
+        for (t = 0; t < sizeof(FIELD_TYPES) / sizeof(FIELD_TYPES[0]); t++) {
+            if (strcmp(type, FIELD_TYPES[t].name) == 0) break;
+        }
+        if (t == sizeof(FIELD_TYPES) / sizeof(FIELD_TYPES[0])) return -1;
+        field.type = FIELD_TYPES[t].type;
+    }
+
+    if (parse_size(length, &field.length) != 0 || field.length == 0) return -1;
+    // Packed decimals hold at most 31 digits (16 bytes); binary integers at most 8 bytes.
+    if (field.type == FIELD_PACKED && field.length > 16) return -1;
+    if (field.type == FIELD_BINARY && field.length > 8) return -1;
+    if (content) {
+        if (parse_field_content(trim_whitespace(content), &field) != 0) return -1;
+        if (field.content == FIELD_CONTENT_VALUE && strlen(field.source) > field.length) return -1;
+    }
+
+    FieldDef *grown = realloc(layout->fields, (layout->field_count + 1) * sizeof(FieldDef));
+    if (!grown) return -1;
+    layout->fields = grown;
+    layout->fields[layout->field_count++] = field;
+    return 0;
+}
+
+// Parses "NAME,HEADER|DETAIL|TRAILER[,WEIGHT]" and adds the record type. Its
+// section starts from the record settings given so far, with a layout of
+// its own. Returns 0 on success, non-zero on error.
+static int parse_record_type(const char *value, Config *config) {
+    char buf[MAX_LINE_LENGTH];
+    strncpy(buf, value, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *name = strtok(buf, ",");
+    char *role = strtok(NULL, ",");
+    char *weight = strtok(NULL, ",");
+    if (!name || !role || strtok(NULL, ",")) return -1;
+    name = trim_whitespace(name);
+    role = trim_whitespace(role);
+    if (strlen(name) == 0 || strlen(name) >= FIELD_NAME_MAX) return -1;
+    for (size_t t = 0; t < config->record_type_count; t++) {
+        if (strcmp(name, config->record_types[t].name) == 0) return -1;
+    }
+
+    RecordType type;
+    memset(&type, 0, sizeof(type));
+    strcpy(type.name, name);
+    if (strcmp(role, "HEADER") == 0) type.role = RECORD_ROLE_HEADER;
+    else if (strcmp(role, "DETAIL") == 0) type.role = RECORD_ROLE_DETAIL;
+    else if (strcmp(role, "TRAILER") == 0) type.role = RECORD_ROLE_TRAILER;
+    else return -1;
+
+    type.weight = 1.0;
+    if (weight) {
+        char *endp;
+        weight = trim_whitespace(weight);
+        type.weight = strtod(weight, &endp);
+        if (type.role != RECORD_ROLE_DETAIL || endp == weight || *endp != '\0' ||
+            !(type.weight > 0.0) || !isfinite(type.weight)) {
+            return -1;
+        }
+    }
+
+    type.config = *config;
+    type.config.record_length = 0;
+    type.config.fields = NULL;
+    type.config.field_count = 0;
+    type.config.record_types = NULL;
+    type.config.record_type_count = 0;
+    if (config->string_pattern && !(type.config.string_pattern = strdup(config->string_pattern))) return -1;
+
+    RecordType *grown = realloc(config->record_types, (config->record_type_count + 1) * sizeof(RecordType));
+    if (!grown) {
+        free(type.config.string_pattern);
+        return -1;
+    }
+    config->record_types = grown;
+    config->record_types[config->record_type_count++] = type;
+    return 0;
+}
+
+// Parses "NAME,PATH[,UTF-8|SJIS]" and adds the dictionary. Names are unique.
+// Returns 0 on success, non-zero on error.
+static int parse_dictionary(const char *value, Config *config) {
+    char buf[MAX_LINE_LENGTH];
+    strncpy(buf, value, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *name = strtok(buf, ",");
+    char *path = strtok(NULL, ",");
+    char *encoding = strtok(NULL, ",");
+    if (!name || !path || strtok(NULL, ",")) return -1;
+    name = trim_whitespace(name);
+    path = trim_whitespace(path);
+    if (strlen(name) == 0 || strlen(name) >= FIELD_NAME_MAX || strlen(path) == 0) return -1;
+    for (size_t d = 0; d < config->dictionary_count; d++) {
+        if (strcmp(name, config->dictionaries[d].name) == 0) return -1;
+    }
+
+    DictionaryDef dict;
+    memset(&dict, 0, sizeof(dict));
+    strcpy(dict.name, name);
+    dict.encoding = DICTIONARY_UTF8;
+    if (encoding) {
+        encoding = trim_whitespace(encoding);
+        if (strcmp(encoding, "SJIS") == 0) dict.encoding = DICTIONARY_SJIS;
+        else if (strcmp(encoding, "UTF-8") != 0 && strcmp(encoding, "UTF8") != 0) return -1;
+    }
+
+    DictionaryDef *grown = realloc(config->dictionaries, (config->dictionary_count + 1) * sizeof(DictionaryDef));
+    if (!grown) return -1;
+    config->dictionaries = grown;
+    dict.path = strdup(path);
+    if (!dict.path) return -1;
+    config->dictionaries[config->dictionary_count++] = dict;
+    return 0;
+}
+
+// Parses "OFFSET,LENGTH,FORMAT[,ASCENDING|RANDOM]". FORMAT is a field type
+// that can hold a number: 9, P / COMP-3 or B / COMP.
+// Returns 0 on success, non-zero on error.
+static int parse_key(const char *value, Config *config) {
+    char buf[MAX_LINE_LENGTH];
+    strncpy(buf, value, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *offset = strtok(buf, ",");
+    char *length = strtok(NULL, ",");
+    char *format = strtok(NULL, ",");
+    char *order = strtok(NULL, ",");
+    if (!offset || !length || !format || strtok(NULL, ",")) return -1;
+    if (parse_size(trim_whitespace(offset), &config->key_offset) != 0) return -1;
+    if (parse_size(trim_whitespace(length), &config->key_length) != 0 || config->key_length == 0) return -1;
+
+    format = trim_whitespace(format);
+    if (strcmp(format, "9") == 0) config->key_format = FIELD_ZONED;
+    else if (strcmp(format, "P") == 0 || strcmp(format, "COMP-3") == 0) config->key_format = FIELD_PACKED;
+    else if (strcmp(format, "B") == 0 || strcmp(format, "COMP") == 0) config->key_format = FIELD_BINARY;
+    else return -1;
+    if (config->key_length > KEY_MAX_LENGTH) return -1;
+    if (config->key_format == FIELD_PACKED && config->key_length > 16) return -1;
+    if (config->key_format == FIELD_BINARY && config->key_length > 8) return -1;
+
+    config->key_random = 0;
+    if (order) {
+        order = trim_whitespace(order);
+        if (strcmp(order, "RANDOM") == 0) config->key_random = 1;
+        else if (strcmp(order, "ASCENDING") != 0) return -1;
+    }
+    return 0;
+}
+
+// Checks that the KEY fits every record of `layout` (the file, or one
+// DETAIL record type), leaves multibyte text intact and has a distinct value
+// for every record. Returns 0 if it is usable.
+static int check_key(const Config *config, const Config *layout) {
+    size_t end = config->key_offset + config->key_length;
+    size_t shortest = layout->record_length;
+    if (config->file_type == FILE_TYPE_VARIABLE && layout->field_count == 0 && config->record_type_count == 0) {
+        shortest = config->min_record_length ? config->min_record_length : 1;
+    }
+    if (end > shortest) {
+        fprintf(stderr, "KEY at offset %zu, length %zu does not fit in the shortest record (%zu bytes)\n",
+                config->key_offset, config->key_length, shortest);
+        return 1;
+    }
+
+    if (layout->field_count > 0) {
+        // The key replaces whole fields, so no character is cut in two.
+        size_t offset = 0;
+        int starts = 0, ends = 0;
+        for (size_t f = 0; f < layout->field_count; f++) {
+            if (offset == config->key_offset) starts = 1;
+            offset += layout->fields[f].length;
+            if (offset == end) ends = 1;
+        }
+        if (!starts || !ends) {
+            fprintf(stderr, "KEY must cover whole FIELDs of the layout\n");
+            return 1;
+        }
+    } else if (config->data_mode == DATA_MODE_TEXT && layout->fill_type == FILL_PATTERN_RANDOM &&
+               layout->text_type != TEXT_TYPE_ASCII) {
+        fprintf(stderr, "KEY cannot be placed in random multibyte text; use a FIELD layout\n");
+        return 1;
+    }
+
+    uint64_t space = key_space(config->key_format, config->key_length);
+    uint64_t needed = (uint64_t)config->record_count + (config->key_random ? 0 : 1);
+    if (space != 0 && needed > space) {
+        fprintf(stderr, "RECORD_COUNT %zu exceeds the %llu distinct values of the KEY\n", config->record_count,
+                (unsigned long long)(config->key_random ? space : space - 1));
         return 1;
     }
+    return 0;
+}
+
+// Bytes of the largest record in the file: RECORD_LENGTH plus the newline
+// of a FIXED text record or the RDW of a VARIABLE one.
+static size_t max_record_bytes(const Config *config) {
+    if (config->file_type == FILE_TYPE_VARIABLE) return config->record_length + 4;
+    if (config->data_mode != DATA_MODE_TEXT) return config->record_length;
+    switch (config->newline) {
+        case NEWLINE_CRLF: return config->record_length + 2;
+        case NEWLINE_NONE: return config->record_length;
+        default: return config->record_length + 1;
+    }
+}
+
+// Derives RECORD_COUNT from TARGET_SIZE. A FIXED file gets the whole
+// records that fit. A VARIABLE file gets the expected number, from the mean
+// data length of LENGTH_DISTRIBUTION or of the DETAIL record types (and the
+// share of block descriptors with BLOCK_SIZE), so its size comes out close
+// to the target. Header and trailer records take their place in the size.
+static int derive_record_count(Config *config) {
+    size_t edges = 0;
+    double weights = 0.0, weighted_length = 0.0;
+    for (size_t t = 0; t < config->record_type_count; t++) {
+        const RecordType *type = &config->record_types[t];
+        if (type->role != RECORD_ROLE_DETAIL) {
+            edges++;
+        } else {
+            weights += type->weight;
+            weighted_length += type->weight * (double)type->config.record_length;
+        }
+    }
+
+    if (config->file_type == FILE_TYPE_FIXED) {
+        if (max_record_bytes(config) == 0) {
+            fprintf(stderr, "TARGET_SIZE needs RECORD_LENGTH\n");
+            return 1;
+        }
+        config->record_count = config->target_size / max_record_bytes(config);
+    } else {
+        double mean = (double)config->record_length;
+        if (config->record_type_count > 0) {
+            mean = weighted_length / weights;
+        } else if (config->field_count == 0) {
+            LengthSampler lengths;
+            if (length_sampler_init(&lengths, config) != 0) {
+                length_sampler_free(&lengths);
+                return 1;
+            }
+            mean = length_sampler_mean(&lengths);
+            length_sampler_free(&lengths);
+        }
+        double bytes = mean + 4;
+        if (config->block_size > 0) {
+            bytes *= (double)config->block_size / (double)(config->block_size - 4);
+        }
+        double count = (double)config->target_size / bytes;
+        config->record_count = (count < (double)SIZE_MAX) ? (size_t)count : SIZE_MAX;
+    }
+    config->record_count = (config->record_count > edges) ? config->record_count - edges : 0;
+    if (config->record_count == 0) {
+        fprintf(stderr, "TARGET_SIZE %zu is smaller than one record\n", config->target_size);
+        return 1;
+    }
+    return 0;
+}
+
+// Checks the record settings of the file or of one RECORD_TYPE against the
+// output codepage and completes them: string patterns in the codepage and
+// RECORD_LENGTH from the FIELD layout. Returns 0 if they are usable.
+static int finish_record_settings(Config *config) {
+    const Codepage *cp = codepage_get(config->output_codepage);
+    if (cp->ebcdic) {
+        int needs_dbcs = (config->data_mode == DATA_MODE_TEXT && config->fill_type == FILL_PATTERN_RANDOM &&
+                          config->text_type != TEXT_TYPE_ASCII);
+        for (size_t f = 0; f < config->field_count; f++) {
+            if (config->fields[f].type == FIELD_DBCS || config->fields[f].type == FIELD_MIXED) needs_dbcs = 1;
+        }
+        if (config->text_type == TEXT_TYPE_SJIS && config->fill_type == FILL_PATTERN_RANDOM &&
+            config->data_mode == DATA_MODE_TEXT) {
+            fprintf(stderr, "TEXT_TYPE=SJIS cannot be written in %s; use ISO_2022 with CP930 or CP939\n", cp->name);
+            return 1;
+        }
+        if (needs_dbcs && !cp->dbcs) {
+            fprintf(stderr, "Double-byte text needs OUTPUT_CODEPAGE=CP930 or CP939 (got %s)\n", cp->name);
+            return 1;
+        }
+        if (config->data_mode == DATA_MODE_TEXT && config->string_pattern) {
+            codepage_translate(cp, (unsigned char *)config->string_pattern, strlen(config->string_pattern));
+        }
+    }
+
+    if (config->field_count > 0) {
+        // The layout defines the record; RECORD_LENGTH may only add trailing filler.
+        size_t layout = 0;
+        for (size_t f = 0; f < config->field_count; f++) {
+            const FieldDef *field = &config->fields[f];
+            if (field->type == FIELD_MIXED && field->length < config->start_code_len + config->end_code_len + 2) {
+                fprintf(stderr, "FIELD %s is too short for START_CODE + one DBCS character + END_CODE\n", field->name);
+                return 1;
+            }
+            layout += field->length;
+        }
+        if (config->record_length == 0) {
+            config->record_length = layout;
+        } else if (config->record_length < layout) {
+            fprintf(stderr, "RECORD_LENGTH %zu is shorter than the FIELD layout (%zu bytes)\n", config->record_length, layout);
+            return 1;
+        }
+    }
+
+    return 0;
+}
 
+static const RecordType *find_record_type(const Config *config, const char *name) {
+    for (size_t t = 0; t < config->record_type_count; t++) {
+        if (strcmp(name, config->record_types[t].name) == 0) return &config->record_types[t];
+    }
+    return NULL;
+}
+
+// Checks the COUNT and SUM fields of the trailer: a COUNT names a record
+// type, and every DETAIL type that has the field of a SUM has it numeric.
+static int check_totals(const Config *config) {
+    size_t totals = 0;
+    for (size_t t = 0; t < config->record_type_count; t++) {
+        const RecordType *type = &config->record_types[t];
+        for (size_t f = 0; f < type->config.field_count; f++) {
+            const FieldDef *field = &type->config.fields[f];
+            if (field->content != FIELD_CONTENT_COUNT && field->content != FIELD_CONTENT_SUM) continue;
+            if (type->role != RECORD_ROLE_TRAILER) {
+                fprintf(stderr, "FIELD %s: COUNT and SUM fields belong in the TRAILER record type\n", field->name);
+                return 1;
+            }
+            if (++totals > MIX_MAX_TOTALS) {
+                fprintf(stderr, "The TRAILER has more than %d COUNT and SUM fields\n", MIX_MAX_TOTALS);
+                return 1;
+            }
+            if (field->content == FIELD_CONTENT_COUNT) {
+                if (field->source[0] != '\0' && !find_record_type(config, field->source)) {
+                    fprintf(stderr, "FIELD %s counts RECORD_TYPE %s, which is not defined\n", field->name, field->source);
+                    return 1;
+                }
+                continue;
+            }
+
+            int found = 0;
+            for (size_t d = 0; d < config->record_type_count; d++) {
+                const RecordType *detail = &config->record_types[d];
+                if (detail->role != RECORD_ROLE_DETAIL) continue;
+                for (size_t g = 0; g < detail->config.field_count; g++) {
+                    const FieldDef *summed = &detail->config.fields[g];
+                    if (strcmp(summed->name, field->source) != 0) continue;
+                    if (!is_numeric_field(summed->type)) {
+                        fprintf(stderr, "FIELD %s sums %s, which is not numeric (9, S9, P or B) in RECORD_TYPE %s\n",
+                                field->name, field->source, detail->name);
+                        return 1;
+                    }
+                    found = 1;
+                }
+            }
+            if (!found) {
+                fprintf(stderr, "FIELD %s sums %s, which no DETAIL record type has\n", field->name, field->source);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Completes the RECORD_TYPE sections: each gets the settings of the file
+// around its own record settings. The types must make up a file: one or
+// more DETAIL types, at most one HEADER and one TRAILER, and records of one
+// length in a FIXED file. RECORD_LENGTH becomes the longest record.
+static int finish_record_types(Config *config) {
+    if (config->field_count > 0) {
+        fprintf(stderr, "FIELD lines must follow a RECORD_TYPE line in a file with record types\n");
+        return 1;
+    }
+
+    size_t roles[3] = { 0, 0, 0 };
+    size_t longest = 0;
+    for (size_t t = 0; t < config->record_type_count; t++) {
+        RecordType *type = &config->record_types[t];
+        Config merged = *config;
+        if (type->config.record_length > 0) merged.record_length = type->config.record_length;
+        merged.fill_type = type->config.fill_type;
+        merged.single_byte_fill = type->config.single_byte_fill;
+        merged.string_pattern = type->config.string_pattern;
+        merged.text_type = type->config.text_type;
+        merged.fields = type->config.fields;
+        merged.field_count = type->config.field_count;
+        merged.record_types = NULL;
+        merged.record_type_count = 0;
+        type->config = merged;
+
+        if (finish_record_settings(&type->config) != 0) {
+            fprintf(stderr, "  in RECORD_TYPE %s\n", type->name);
+            return 1;
+        }
+        size_t length = type->config.record_length;
+        if (length == 0) {
+            fprintf(stderr, "RECORD_TYPE %s needs RECORD_LENGTH or FIELD lines\n", type->name);
+            return 1;
+        }
+        if (config->file_type == FILE_TYPE_FIXED && t > 0 && length != config->record_types[0].config.record_length) {
+            fprintf(stderr, "FIXED records of every RECORD_TYPE must have the same length (%s: %zu, %s: %zu)\n",
+                    config->record_types[0].name, config->record_types[0].config.record_length, type->name, length);
+            return 1;
+        }
+        roles[type->role]++;
+        if (length > longest) longest = length;
+    }
+
+    if (roles[RECORD_ROLE_DETAIL] == 0) {
+        fprintf(stderr, "A file with RECORD_TYPE sections needs a DETAIL record type\n");
+        return 1;
+    }
+    if (roles[RECORD_ROLE_HEADER] > 1 || roles[RECORD_ROLE_TRAILER] > 1) {
+        fprintf(stderr, "A file has at most one HEADER and one TRAILER record type\n");
+        return 1;
+    }
+    config->record_length = longest;
+    return check_totals(config);
+}
+
+// Parses definition lines from `file` and closes it.
+static int parse_stream(FILE *file, Config *config) {
     char line[MAX_LINE_LENGTH];
     int line_num = 0;
+    int codes_set = 0;
+    // Record settings go to the file, or to the RECORD_TYPE section being read.
+    Config *layout = config;
 
     // Set defaults that might not be set by memset
     config->newline = NEWLINE_LF; 
     config->rdw_endian = RDW_ENDIAN_BIG;
     config->text_type = TEXT_TYPE_ASCII;
+    config->threads = 1;
+    config->output_block_size = OUTPUT_DEFAULT_BLOCK_SIZE;
     // Default fill pattern is context dependent (space for text, null for binary)
     // We will set a marker to know if it was set by user, or handle in generator.
     // For now, let's say default is handled in generator if fill_type is 0 and string_pattern is NULL.
@@ -101,8 +673,13 @@ int parse_definition(const char *filename, Config *config) {
             else if (strcmp(value, "VARIABLE") == 0) config->file_type = FILE_TYPE_VARIABLE;
             else { fprintf(stderr, "Invalid FILE_TYPE at line %d: %s\n", line_num, value); fclose(file); return 1; }
         } else if (strcmp(key, "RECORD_LENGTH") == 0) {
-            config->record_length = atoi(value);
-            if (config->record_length <= 0) { fprintf(stderr, "Invalid RECORD_LENGTH at line %d\n", line_num); fclose(file); return 1; }
+            if (parse_count(value, &layout->record_length) != 0) { fprintf(stderr, "Invalid RECORD_LENGTH at line %d: %s\n", line_num, value); fclose(file); return 1; }
+        } else if (strcmp(key, "MIN_RECORD_LENGTH") == 0) {
+            if (parse_count(value, &config->min_record_length) != 0) { fprintf(stderr, "Invalid MIN_RECORD_LENGTH at line %d: %s\n", line_num, value); fclose(file); return 1; }
+        } else if (strcmp(key, "LENGTH_DISTRIBUTION") == 0) {
+            if (parse_length_distribution(value, config) != 0) {
+                fprintf(stderr, "Invalid LENGTH_DISTRIBUTION at line %d: %s\n", line_num, value); fclose(file); return 1;
+            }
         } else if (strcmp(key, "DATA_MODE") == 0) {
             if (strcmp(value, "TEXT") == 0) config->data_mode = DATA_MODE_TEXT;
             else if (strcmp(value, "BINARY") == 0) config->data_mode = DATA_MODE_BINARY;
@@ -114,24 +691,102 @@ int parse_definition(const char *filename, Config *config) {
             else if (strcmp(value, "NONE") == 0) config->newline = NEWLINE_NONE;
             else { fprintf(stderr, "Invalid NEWLINE at line %d: %s\n", line_num, value); fclose(file); return 1; }
         } else if (strcmp(key, "RECORD_COUNT") == 0) {
-            config->record_count = atoi(value);
-            if (config->record_count <= 0) { fprintf(stderr, "Invalid RECORD_COUNT at line %d\n", line_num); fclose(file); return 1; }
+            if (parse_count(value, &config->record_count) != 0) { fprintf(stderr, "Invalid RECORD_COUNT at line %d: %s\n", line_num, value); fclose(file); return 1; }
+        } else if (strcmp(key, "TARGET_SIZE") == 0) {
+            if (parse_size(value, &config->target_size) != 0 || config->target_size == 0) {
+                fprintf(stderr, "Invalid TARGET_SIZE at line %d: %s\n", line_num, value); fclose(file); return 1;
+            }
+        } else if (strcmp(key, "THREADS") == 0) {
+            char *endp;
+            long n = strtol(value, &endp, 10);
+            if (*value == '\0' || *endp != '\0' || n < 0) { fprintf(stderr, "Invalid THREADS at line %d\n", line_num); fclose(file); return 1; }
+            config->threads = (size_t)n;
+        } else if (strcmp(key, "SEED") == 0) {
+            char *endp;
+            errno = 0;
+            unsigned long long seed = strtoull(value, &endp, 0);
+            if (*value == '\0' || *value == '-' || *endp != '\0' || errno == ERANGE) { fprintf(stderr, "Invalid SEED at line %d: %s\n", line_num, value); fclose(file); return 1; }
+            config->seed = (uint64_t)seed;
+            config->seed_set = 1;
+        } else if (strcmp(key, "OUTPUT_BLOCK_SIZE") == 0) {
+            size_t size;
+            if (parse_size(value, &size) != 0 || size < OUTPUT_MIN_BLOCK_SIZE || size > OUTPUT_MAX_BLOCK_SIZE || size % OUTPUT_ALIGNMENT != 0) {
+                fprintf(stderr, "Invalid OUTPUT_BLOCK_SIZE at line %d: %s (64K-1G, multiple of 4K)\n", line_num, value); fclose(file); return 1;
+            }
+            config->output_block_size = size;
+        } else if (strcmp(key, "DIRECT_IO") == 0) {
+            if (strcmp(value, "YES") == 0) config->direct_io = 1;
+            else if (strcmp(value, "NO") == 0) config->direct_io = 0;
+            else { fprintf(stderr, "Invalid DIRECT_IO at line %d: %s\n", line_num, value); fclose(file); return 1; }
+        } else if (strcmp(key, "COMPRESSION") == 0) {
+            if (strcmp(value, "NONE") == 0) config->compression = COMPRESS_NONE;
+            else if (strcmp(value, "GZIP") == 0) config->compression = COMPRESS_GZIP;
+            else if (strcmp(value, "ZSTD") == 0) config->compression = COMPRESS_ZSTD;
+            else { fprintf(stderr, "Invalid COMPRESSION at line %d: %s\n", line_num, value); fclose(file); return 1; }
+        } else if (strcmp(key, "COMPRESSION_LEVEL") == 0) {
+            char *endp;
+            long level = strtol(value, &endp, 10);
+            if (*value == '\0' || *endp != '\0' || level < 1 || level > 22) { fprintf(stderr, "Invalid COMPRESSION_LEVEL at line %d: %s\n", line_num, value); fclose(file); return 1; }
+            config->compression_level = (int)level;
         } else if (strcmp(key, "RDW_ENDIAN") == 0) {
             if (strcmp(value, "BIG") == 0) config->rdw_endian = RDW_ENDIAN_BIG;
             else if (strcmp(value, "LITTLE") == 0) config->rdw_endian = RDW_ENDIAN_LITTLE;
             else { fprintf(stderr, "Invalid RDW_ENDIAN at line %d: %s\n", line_num, value); fclose(file); return 1; }
         } else if (strcmp(key, "FILL_PATTERN") == 0) {
-            if (parse_fill_pattern(value, config) != 0) {
+            if (parse_fill_pattern(value, layout) != 0) {
                 fprintf(stderr, "Invalid FILL_PATTERN at line %d: %s\n", line_num, value);
                 fclose(file);
                 return 1;
             }
+        } else if (strcmp(key, "KEY") == 0) {
+            if (parse_key(value, config) != 0) {
+                fprintf(stderr, "Invalid KEY at line %d: %s\n", line_num, value);
+                fclose(file);
+                return 1;
+            }
+        } else if (strcmp(key, "DICTIONARY") == 0) {
+            if (parse_dictionary(value, config) != 0) {
+                fprintf(stderr, "Invalid DICTIONARY at line %d: %s\n", line_num, value);
+                fclose(file);
+                return 1;
+            }
+        } else if (strcmp(key, "FIELD") == 0) {
+            if (parse_field(value, layout, config) != 0) {
+                fprintf(stderr, "Invalid FIELD at line %d: %s\n", line_num, value);
+                fclose(file);
+                return 1;
+            }
+        } else if (strcmp(key, "RECORD_TYPE") == 0) {
+            if (parse_record_type(value, config) != 0) {
+                fprintf(stderr, "Invalid RECORD_TYPE at line %d: %s\n", line_num, value);
+                fclose(file);
+                return 1;
+            }
+            layout = &config->record_types[config->record_type_count - 1].config;
         } else if (strcmp(key, "TEXT_TYPE") == 0) {
-            if (strcmp(value, "ASCII") == 0) config->text_type = TEXT_TYPE_ASCII;
-            else if (strcmp(value, "SJIS") == 0) config->text_type = TEXT_TYPE_SJIS;
-            else if (strcmp(value, "ISO_2022") == 0) config->text_type = TEXT_TYPE_ISO_2022;
+            if (strcmp(value, "ASCII") == 0) layout->text_type = TEXT_TYPE_ASCII;
+            else if (strcmp(value, "SJIS") == 0) layout->text_type = TEXT_TYPE_SJIS;
+            else if (strcmp(value, "ISO_2022") == 0) layout->text_type = TEXT_TYPE_ISO_2022;
             else { fprintf(stderr, "Invalid TEXT_TYPE at line %d: %s\n", line_num, value); fclose(file); return 1; }
+        } else if (strcmp(key, "RANDOM_QUALITY") == 0) {
+            if (strcmp(value, "FULL") == 0) config->random_quality = RANDOM_QUALITY_FULL;
+            else if (strcmp(value, "FAST") == 0) config->random_quality = RANDOM_QUALITY_FAST;
+            else { fprintf(stderr, "Invalid RANDOM_QUALITY at line %d: %s\n", line_num, value); fclose(file); return 1; }
+        } else if (strcmp(key, "BLOCK_SIZE") == 0) {
+            if (parse_size(value, &config->block_size) != 0 || config->block_size < 9 ||
+                config->block_size > 0x7FFFFFFF) {
+                fprintf(stderr, "Invalid BLOCK_SIZE at line %d: %s\n", line_num, value); fclose(file); return 1;
+            }
+        } else if (strcmp(key, "SPANNED") == 0) {
+            if (strcmp(value, "YES") == 0) config->spanned = 1;
+            else if (strcmp(value, "NO") == 0) config->spanned = 0;
+            else { fprintf(stderr, "Invalid SPANNED at line %d: %s\n", line_num, value); fclose(file); return 1; }
+        } else if (strcmp(key, "OUTPUT_CODEPAGE") == 0) {
+            if (codepage_parse(value, &config->output_codepage) != 0) {
+                fprintf(stderr, "Invalid OUTPUT_CODEPAGE at line %d: %s\n", line_num, value); fclose(file); return 1;
+            }
         } else if (strcmp(key, "START_CODE") == 0) {
+            codes_set = 1;
             // Parse hex string e.g. 0x1B2442 or 0x0E
             // We support up to 8 bytes.
             const char *p = value;
@@ -152,6 +807,7 @@ int parse_definition(const char *filename, Config *config) {
                 }
             }
         } else if (strcmp(key, "END_CODE") == 0) {
+            codes_set = 1;
             const char *p = value;
             if (strncmp(p, "0x", 2) == 0) p += 2;
             
@@ -177,12 +833,156 @@ int parse_definition(const char *filename, Config *config) {
     }
 
     fclose(file);
+
+    codepage_init();
+    const Codepage *cp = codepage_get(config->output_codepage);
+    if (cp->dbcs && !codes_set) {
+        // Host DBCS runs are framed by SO / SI.
+        config->start_code[0] = 0x0E;
+        config->start_code_len = 1;
+        config->end_code[0] = 0x0F;
+        config->end_code_len = 1;
+    }
+    if (finish_record_settings(config) != 0 ||
+        (config->record_type_count > 0 && finish_record_types(config) != 0)) {
+        return 1;
+    }
+    for (size_t f = 0; f < config->field_count; f++) {
+        if (config->fields[f].content == FIELD_CONTENT_COUNT || config->fields[f].content == FIELD_CONTENT_SUM) {
+            fprintf(stderr, "FIELD %s: COUNT and SUM fields belong in the TRAILER record type\n", config->fields[f].name);
+            return 1;
+        }
+    }
+
+    if (config->random_quality == RANDOM_QUALITY_FAST && (config->field_count > 0 || config->record_type_count > 0)) {
+        fprintf(stderr, "RANDOM_QUALITY=FAST applies to records without a FIELD layout or RECORD_TYPE\n");
+        return 1;
+    }
+
+    if (config->min_record_length > 0 || config->length_distribution != LENGTH_UNIFORM) {
+        if (config->file_type != FILE_TYPE_VARIABLE) {
+            fprintf(stderr, "MIN_RECORD_LENGTH and LENGTH_DISTRIBUTION apply to FILE_TYPE=VARIABLE only\n");
+            return 1;
+        }
+        if (config->field_count > 0) {
+            fprintf(stderr, "MIN_RECORD_LENGTH and LENGTH_DISTRIBUTION cannot be used with FIELD (records hold the whole layout)\n");
+            return 1;
+        }
+        if (config->record_type_count > 0) {
+            fprintf(stderr, "MIN_RECORD_LENGTH and LENGTH_DISTRIBUTION cannot be used with RECORD_TYPE (each type has its own length)\n");
+            return 1;
+        }
+        if (config->min_record_length > config->record_length) {
+            fprintf(stderr, "MIN_RECORD_LENGTH %zu exceeds RECORD_LENGTH %zu\n", config->min_record_length, config->record_length);
+            return 1;
+        }
+    }
+
+    if (config->file_type == FILE_TYPE_VARIABLE) {
+        // The RDW holds the record length plus 4 in 16 bits; only spanned
+        // records can be longer.
+        if (!config->spanned && config->record_length > RDW_MAX_LENGTH - 4) {
+            fprintf(stderr, "RECORD_LENGTH %zu exceeds the RDW limit of %d; use BLOCK_SIZE with SPANNED=YES\n",
+                    config->record_length, RDW_MAX_LENGTH - 4);
+            return 1;
+        }
+        if (config->spanned && config->block_size == 0) {
+            fprintf(stderr, "SPANNED=YES requires BLOCK_SIZE\n");
+            return 1;
+        }
+        if (config->spanned && config->block_size > BDW_MAX_STANDARD) {
+            fprintf(stderr, "BLOCK_SIZE %zu is too large for SPANNED=YES (max %d)\n", config->block_size, BDW_MAX_STANDARD);
+            return 1;
+        }
+        if (config->block_size > 0 && !config->spanned && config->block_size < config->record_length + 8) {
+            fprintf(stderr, "BLOCK_SIZE %zu cannot hold a record of RECORD_LENGTH %zu (needs %zu with BDW and RDW)\n",
+                    config->block_size, config->record_length, config->record_length + 8);
+            return 1;
+        }
+    } else if (config->block_size > 0 || config->spanned) {
+        fprintf(stderr, "BLOCK_SIZE and SPANNED apply to FILE_TYPE=VARIABLE only\n");
+        return 1;
+    }
+
+    if (config->target_size > 0) {
+        if (config->record_count > 0) {
+            fprintf(stderr, "RECORD_COUNT and TARGET_SIZE cannot both be given\n");
+            return 1;
+        }
+        if (derive_record_count(config) != 0) {
+            return 1;
+        }
+    }
+    // File offsets are signed 64-bit.
+    size_t record_bytes = max_record_bytes(config);
+    if (record_bytes > 0 && config->record_count > (uint64_t)INT64_MAX / record_bytes) {
+        fprintf(stderr, "RECORD_COUNT %zu of up to %zu bytes exceeds the largest possible file\n",
+                config->record_count, record_bytes);
+        return 1;
+    }
+
+    if (config->key_length > 0) {
+        // Only detail records carry the key.
+        if (config->record_type_count == 0 && check_key(config, config) != 0) {
+            return 1;
+        }
+        for (size_t t = 0; t < config->record_type_count; t++) {
+            const RecordType *type = &config->record_types[t];
+            if (type->role == RECORD_ROLE_DETAIL && check_key(config, &type->config) != 0) {
+                fprintf(stderr, "  in RECORD_TYPE %s\n", type->name);
+                return 1;
+            }
+        }
+    }
+
+    if (config->compression == COMPRESS_GZIP && config->compression_level > 9) {
+        fprintf(stderr, "Invalid COMPRESSION_LEVEL for GZIP: %d (1-9)\n", config->compression_level);
+        return 1;
+    }
     return 0;
 }
 
+int parse_definition(const char *filename, Config *config) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        perror("Error opening definition file");
+        return 1;
+    }
+    return parse_stream(file, config);
+}
+
+int parse_definition_string(const char *text, Config *config) {
+    // fmemopen() rejects an empty buffer; an empty definition is one empty line.
+    size_t len = strlen(text);
+    FILE *file = fmemopen((void *)(len ? text : "\n"), len ? len : 1, "r");
+    if (!file) {
+        perror("Error reading definition");
+        return 1;
+    }
+    return parse_stream(file, config);
+}
+
 void free_config(Config *config) {
     if (config->string_pattern) {
         free(config->string_pattern);
         config->string_pattern = NULL;
     }
+    free(config->fields);
+    config->fields = NULL;
+    config->field_count = 0;
+    for (size_t d = 0; d < config->dictionary_count; d++) {
+        free(config->dictionaries[d].path);
+    }
+    free(config->dictionaries);
+    config->dictionaries = NULL;
+    config->dictionary_count = 0;
+    free(config->length_sample);
+    config->length_sample = NULL;
+    for (size_t t = 0; t < config->record_type_count; t++) {
+        free(config->record_types[t].config.string_pattern);
+        free(config->record_types[t].config.fields);
+    }
+    free(config->record_types);
+    config->record_types = NULL;
+    config->record_type_count = 0;
 }
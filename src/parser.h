@@ -7,6 +7,9 @@
 // Returns 0 on success, non-zero on error.
 int parse_definition(const char *filename, Config *config);
 
+// Same as parse_definition(), for the text of a definition file in memory.
+int parse_definition_string(const char *text, Config *config);
+
 // Frees any allocated memory in the Config struct (e.g., string pattern).
 void free_config(Config *config);
 
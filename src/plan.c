@@ -0,0 +1,249 @@
+#include "plan.h"
+#include "randfill.h"
+#include "mbtext.h"
+#include "codepage.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PACKED_DIGITS 31
+
+// Maps 16 random bits per byte onto [first, first + count).
+static inline void map_range(const unsigned char *bits, unsigned char *dst, size_t n, unsigned first, unsigned count) {
+    for (size_t i = 0; i < n; i++) {
+        unsigned v = (unsigned)bits[2 * i] | ((unsigned)bits[2 * i + 1] << 8);
+        dst[i] = (unsigned char)(first + ((v * count) >> 16));
+    }
+}
+
+static void fill_text(const PlanOp *op, unsigned char *dst, const unsigned char *bits, Prng *rng) {
+    (void)rng;
+    map_range(bits, dst, op->length, 0x20, 0x7E - 0x20 + 1);
+}
+
+// Text in an EBCDIC codepage: alphabet indices, then one table lookup.
+static void fill_text_codepage(const PlanOp *op, unsigned char *dst, const unsigned char *bits, Prng *rng) {
+    (void)rng;
+    map_range(bits, dst, op->length, 0, op->codepage->text_count);
+    codepage_text_from_index(op->codepage, dst, op->length);
+}
+
+static void fill_zoned(const PlanOp *op, unsigned char *dst, const unsigned char *bits, Prng *rng) {
+    (void)rng;
+    map_range(bits, dst, op->length, op->codepage->digit_zero, 10);
+}
+
+static void fill_zoned_signed(const PlanOp *op, unsigned char *dst, const unsigned char *bits, Prng *rng) {
+    // The sign is overpunched on the last digit ({A-I / }J-R, which are the
+    // C and D zones in EBCDIC).
+    (void)rng;
+    map_range(bits, dst, op->length, op->codepage->digit_zero, 10);
+    unsigned char *last = &dst[op->length - 1];
+    int digit = *last - op->codepage->digit_zero;
+    *last = (bits[2 * op->length] & 1) ? op->codepage->overpunch_negative[digit] : op->codepage->overpunch_positive[digit];
+}
+
+static void fill_packed(const PlanOp *op, unsigned char *dst, const unsigned char *bits, Prng *rng) {
+    // 2 * length - 1 digits followed by the sign nibble (C = +, D = -).
+    unsigned char digits[MAX_PACKED_DIGITS + 1];
+    size_t n = op->length * 2 - 1;
+    (void)rng;
+    map_range(bits, digits, n, 0, 10);
+    digits[n] = (bits[2 * n] & 1) ? 0x0D : 0x0C;
+    for (size_t i = 0; i < op->length; i++) {
+        dst[i] = (unsigned char)((digits[2 * i] << 4) | digits[2 * i + 1]);
+    }
+}
+
+static void fill_binary(const PlanOp *op, unsigned char *dst, const unsigned char *bits, Prng *rng) {
+    // Every bit pattern is a valid two's complement value.
+    (void)rng;
+    memcpy(dst, bits, op->length);
+}
+
+static void fill_dbcs(const PlanOp *op, unsigned char *dst, const unsigned char *bits, Prng *rng) {
+    (void)rng;
+    mbtext_fill_dbcs_bits(bits, dst, op->length, op->config);
+}
+
+static void fill_mixed(const PlanOp *op, unsigned char *dst, const unsigned char *bits, Prng *rng) {
+    // Run lengths depend on the drawn values, so this one uses the generator directly.
+    (void)bits;
+    mbtext_fill_iso2022(rng, dst, op->length, op->config);
+}
+
+static void fill_dictionary(const PlanOp *op, unsigned char *dst, const unsigned char *bits, Prng *rng) {
+    uint64_t v;
+    (void)rng;
+    memcpy(&v, bits, sizeof(v));
+    dictionary_write(op->dictionary, v, dst, op->length);
+}
+
+static void fill_random_filler(const PlanOp *op, unsigned char *dst, const unsigned char *bits, Prng *rng) {
+    if (op->config->data_mode == DATA_MODE_TEXT) {
+        if (op->codepage->ebcdic) {
+            fill_text_codepage(op, dst, bits, rng);
+        } else {
+            fill_text(op, dst, bits, rng);
+        }
+    } else {
+        fill_binary(op, dst, bits, rng);
+    }
+}
+
+static void fill_constant(const PlanOp *op, unsigned char *dst, const unsigned char *bits, Prng *rng) {
+    (void)bits;
+    (void)rng;
+    memcpy(dst, op->constant, op->length);
+}
+
+// Random bytes an op consumes per record.
+static size_t bits_needed(FieldType type, size_t length, const Config *config) {
+    switch (type) {
+        case FIELD_TEXT:
+        case FIELD_ZONED: return 2 * length;
+        case FIELD_ZONED_SIGNED: return 2 * length + 1;
+        case FIELD_PACKED: return 2 * (2 * length - 1) + 1;
+        case FIELD_BINARY: return length;
+        case FIELD_DBCS: return (length / 2) * 8;
+        case FIELD_MIXED: return 0;
+        case FIELD_DICTIONARY: return 8;
+        case FIELD_FILLER: break;
+    }
+    if (config->fill_type != FILL_PATTERN_RANDOM) return 0;
+    return (config->data_mode == DATA_MODE_TEXT) ? 2 * length : length;
+}
+
+// Bytes of a non-random FILL_PATTERN, restarting the pattern at the field start.
+static void build_constant(const Config *config, unsigned char *dst, size_t length) {
+    if (config->fill_type == FILL_PATTERN_HEX) {
+        memset(dst, config->single_byte_fill, length);
+    } else if (config->fill_type == FILL_PATTERN_STRING && config->string_pattern &&
+               strlen(config->string_pattern) > 0) {
+        size_t pat_len = strlen(config->string_pattern);
+        for (size_t i = 0; i < length; i++) {
+            dst[i] = config->string_pattern[i % pat_len];
+        }
+    } else {
+        memset(dst, (config->data_mode == DATA_MODE_TEXT) ? codepage_get(config->output_codepage)->space : 0x00, length);
+    }
+}
+
+// Bytes of a VALUE: field: the text in the output codepage, padded with spaces.
+static void build_value(const Config *config, const FieldDef *field, unsigned char *dst) {
+    const Codepage *cp = codepage_get(config->output_codepage);
+    size_t n = strlen(field->source);
+    memcpy(dst, field->source, n);
+    codepage_translate(cp, dst, n);
+    memset(dst + n, cp->space, field->length - n);
+}
+
+static PlanFillFn select_fill(FieldType type, const Codepage *cp) {
+    switch (type) {
+        case FIELD_TEXT: return cp->ebcdic ? fill_text_codepage : fill_text;
+        case FIELD_ZONED: return fill_zoned;
+        case FIELD_ZONED_SIGNED: return fill_zoned_signed;
+        case FIELD_PACKED: return fill_packed;
+        case FIELD_BINARY: return fill_binary;
+        case FIELD_DBCS: return fill_dbcs;
+        case FIELD_MIXED: return fill_mixed;
+        case FIELD_DICTIONARY: return fill_dictionary;
+        case FIELD_FILLER: break;
+    }
+    return NULL;
+}
+
+int plan_compile(GenPlan *plan, const Config *config) {
+    memset(plan, 0, sizeof(*plan));
+
+    size_t layout = 0;
+    for (size_t f = 0; f < config->field_count; f++) {
+        layout += config->fields[f].length;
+    }
+    if (config->record_length < layout) return 1;
+    size_t pad = config->record_length - layout;
+
+    plan->ops = calloc(config->field_count + 1, sizeof(PlanOp));
+    plan->constants = malloc(config->record_length > 0 ? config->record_length : 1);
+    if (!plan->ops || !plan->constants) {
+        plan_free(plan);
+        return 1;
+    }
+
+    // Dictionaries are opened once per plan, and only if a field uses them.
+    if (config->dictionary_count > 0) {
+        plan->dictionary_count = config->dictionary_count;
+        plan->dictionaries = calloc(config->dictionary_count, sizeof(Dictionary *));
+        plan->writers = calloc(config->dictionary_count, sizeof(DictionaryWriter));
+        if (!plan->dictionaries || !plan->writers) {
+            plan_free(plan);
+            return 1;
+        }
+        for (size_t f = 0; f < config->field_count; f++) {
+            const FieldDef *field = &config->fields[f];
+            size_t d = field->dictionary;
+            if (field->type != FIELD_DICTIONARY || plan->dictionaries[d]) continue;
+            plan->dictionaries[d] = dictionary_open(&config->dictionaries[d]);
+            if (!plan->dictionaries[d] ||
+                dictionary_writer_init(&plan->writers[d], plan->dictionaries[d], config) != 0) {
+                plan_free(plan);
+                return 1;
+            }
+        }
+    }
+
+    int random_filler = (config->fill_type == FILL_PATTERN_RANDOM);
+    size_t offset = 0;
+    for (size_t f = 0; f <= config->field_count; f++) {
+        FieldType type = (f < config->field_count) ? config->fields[f].type : FIELD_FILLER;
+        size_t length = (f < config->field_count) ? config->fields[f].length : pad;
+        if (length == 0) continue;
+
+        PlanOp *op = &plan->ops[plan->op_count++];
+        op->offset = offset;
+        op->length = length;
+        op->config = config;
+        op->codepage = codepage_get(config->output_codepage);
+        if (f < config->field_count && config->fields[f].content == FIELD_CONTENT_VALUE) {
+            build_value(config, &config->fields[f], plan->constants + offset);
+            op->constant = plan->constants + offset;
+            op->fill = fill_constant;
+            offset += length;
+            continue;
+        }
+        op->bits_offset = plan->bits_length;
+        plan->bits_length += bits_needed(type, length, config);
+        op->fill = select_fill(type, op->codepage);
+        if (type == FIELD_DICTIONARY) {
+            op->dictionary = &plan->writers[config->fields[f].dictionary];
+        }
+        if (!op->fill) {
+            if (random_filler) {
+                op->fill = fill_random_filler;
+            } else {
+                build_constant(config, plan->constants + offset, length);
+                op->constant = plan->constants + offset;
+                op->fill = fill_constant;
+            }
+        }
+        offset += length;
+    }
+
+    plan->record_length = offset;
+    return 0;
+}
+
+void plan_free(GenPlan *plan) {
+    for (size_t d = 0; d < plan->dictionary_count; d++) {
+        dictionary_close(plan->dictionaries ? plan->dictionaries[d] : NULL);
+    }
+    free(plan->dictionaries);
+    free(plan->writers);
+    plan->dictionaries = NULL;
+    plan->writers = NULL;
+    plan->dictionary_count = 0;
+    free(plan->ops);
+    free(plan->constants);
+    plan->ops = NULL;
+    plan->constants = NULL;
+    plan->op_count = 0;
+}
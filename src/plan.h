@@ -0,0 +1,62 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <stddef.h>
+#include "config.h"
+#include "prng.h"
+#include "randfill.h"
+#include "codepage.h"
+#include "dictionary.h"
+
+// A record layout compiled into a flat generation plan: one op per field with
+// a fixed offset and a fill routine chosen at compile time, so generating a
+// record is a straight walk over the ops without per-byte decisions.
+//
+// The random bits of all fields are produced up front with one bulk
+// randfill_bytes() call into a scratch buffer; each op reads its share at a
+// precomputed offset instead of stepping the generator per field.
+
+typedef struct PlanOp PlanOp;
+
+typedef void (*PlanFillFn)(const PlanOp *op, unsigned char *dst, const unsigned char *bits, Prng *rng);
+
+struct PlanOp {
+    size_t offset;
+    size_t length;
+    size_t bits_offset;             // Position of the op's random bits in the scratch buffer
+    PlanFillFn fill;
+    const Config *config;
+    const Codepage *codepage;       // Output encoding of text and zoned fields
+    const unsigned char *constant;  // Precomputed bytes for constant fillers
+    const DictionaryWriter *dictionary;  // DICT: fields
+};
+
+typedef struct {
+    PlanOp *ops;
+    size_t op_count;
+    size_t record_length;
+    size_t bits_length;             // Random bytes needed per record (scratch size)
+    unsigned char *constants;       // Storage behind the ops' constant pointers
+    Dictionary **dictionaries;      // Opened DICTIONARY= sources (NULL if unused)
+    DictionaryWriter *writers;      // One per dictionary, behind the ops' pointers
+    size_t dictionary_count;
+} GenPlan;
+
+// Compiles the FIELD layout of the config (plus trailing filler up to
+// RECORD_LENGTH). The config must outlive the plan.
+// Returns 0 on success, non-zero on error.
+int plan_compile(GenPlan *plan, const Config *config);
+
+void plan_free(GenPlan *plan);
+
+// Generates one record of plan->record_length bytes. `scratch` must hold
+// plan->bits_length bytes.
+static inline void plan_run(const GenPlan *plan, unsigned char *record, Prng *rng, unsigned char *scratch) {
+    randfill_bytes(rng, scratch, plan->bits_length);
+    for (size_t i = 0; i < plan->op_count; i++) {
+        const PlanOp *op = &plan->ops[i];
+        op->fill(op, record + op->offset, scratch + op->bits_offset, rng);
+    }
+}
+
+#endif // PLAN_H
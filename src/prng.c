@@ -0,0 +1,18 @@
+#include "prng.h"
+
+void prng_seed(Prng *prng, uint64_t seed) {
+    uint64_t x = seed;
+    for (int i = 0; i < 4; i++) {
+        prng->s[i] = prng_splitmix64(&x);
+    }
+}
+
+uint64_t prng_bounded64(Prng *prng, uint64_t range) {
+    // Rejection sampling on the largest multiple of range that fits in 64 bits.
+    uint64_t limit = UINT64_MAX - (UINT64_MAX % range);
+    uint64_t x;
+    do {
+        x = prng_next(prng);
+    } while (x >= limit);
+    return x % range;
+}
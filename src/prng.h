@@ -0,0 +1,63 @@
+#ifndef PRNG_H
+#define PRNG_H
+
+#include <stdint.h>
+
+// xoshiro256** generator (Blackman & Vigna). Every generator owns its state,
+// so independent streams can be used from different threads without locking.
+typedef struct {
+    uint64_t s[4];
+} Prng;
+
+// Initializes the state from a 64-bit seed (expanded with splitmix64).
+void prng_seed(Prng *prng, uint64_t seed);
+
+// Next output of the splitmix64 sequence at *x (used to expand seeds).
+static inline uint64_t prng_splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Key of the per-record generators of a seed (see prng_seed_record()).
+static inline uint64_t prng_record_key(uint64_t seed) {
+    // Scrambling the seed keeps nearby seeds from producing shifted copies of a file.
+    return prng_splitmix64(&seed);
+}
+
+// Initializes the generator of record `index` of a file. The state is a pure
+// function of (key, index), so any record can be generated without the ones
+// before it: record i takes outputs 4i .. 4i+3 of the splitmix64 sequence
+// at `key`, so no two records of a file share a state word.
+static inline void prng_seed_record(Prng *prng, uint64_t key, uint64_t index) {
+    uint64_t x = key + index * 4 * 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < 4; i++) {
+        prng->s[i] = prng_splitmix64(&x);
+    }
+}
+
+static inline uint64_t prng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// Returns the next 64 random bits.
+static inline uint64_t prng_next(Prng *prng) {
+    uint64_t *s = prng->s;
+    uint64_t result = prng_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = prng_rotl(s[3], 45);
+
+    return result;
+}
+
+// Returns a uniformly distributed 64-bit integer in [0, range). `range` must be non-zero.
+uint64_t prng_bounded64(Prng *prng, uint64_t range);
+
+#endif // PRNG_H
@@ -0,0 +1,325 @@
+#include "randfill.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define RANDFILL_X86 1
+#include <immintrin.h>
+#endif
+
+#define LANES 4
+#define BLOCK_BYTES (LANES * 8)   // Bytes produced by one wide step
+#define BLOCK_CHARS (LANES * 4)   // Range-mapped bytes produced by one wide step
+#define WIDE_MIN 128              // Shorter fills use the scalar generator directly
+
+#define ASCII_FIRST 0x20
+#define ASCII_RANGE (0x7E - 0x20 + 1)
+
+// Four independent xoshiro256** lanes, stored word-major so that one SIMD
+// register holds the same state word of several lanes.
+typedef struct {
+    uint64_t s[4][LANES];
+} WideState;
+
+typedef struct {
+    const char *name;
+    void (*bytes)(WideState *w, unsigned char *dst, size_t blocks);
+    void (*range)(WideState *w, unsigned char *dst, size_t blocks, unsigned first, unsigned count);
+} Backend;
+
+static void wide_seed(WideState *w, Prng *rng) {
+    for (int lane = 0; lane < LANES; lane++) {
+        Prng p;
+        prng_seed(&p, prng_next(rng));
+        for (int word = 0; word < 4; word++) {
+            w->s[word][lane] = p.s[word];
+        }
+    }
+}
+
+static inline void store64le(unsigned char *dst, uint64_t v) {
+    for (int b = 0; b < 8; b++) {
+        dst[b] = (unsigned char)(v >> (8 * b));
+    }
+}
+
+static inline unsigned char range_from16(uint64_t bits, unsigned first, unsigned count) {
+    return (unsigned char)(first + (((bits & 0xFFFF) * count) >> 16));
+}
+
+// --- Portable backend ---
+
+static inline void wide_step(WideState *w, uint64_t out[LANES]) {
+    for (int l = 0; l < LANES; l++) {
+        uint64_t s0 = w->s[0][l], s1 = w->s[1][l], s2 = w->s[2][l], s3 = w->s[3][l];
+        uint64_t t = s1 << 17;
+
+        out[l] = prng_rotl(s1 * 5, 7) * 9;
+        s2 ^= s0;
+        s3 ^= s1;
+        s1 ^= s2;
+        s0 ^= s3;
+        s2 ^= t;
+        s3 = prng_rotl(s3, 45);
+
+        w->s[0][l] = s0; w->s[1][l] = s1; w->s[2][l] = s2; w->s[3][l] = s3;
+    }
+}
+
+static void portable_bytes(WideState *w, unsigned char *dst, size_t blocks) {
+    uint64_t r[LANES];
+    for (size_t b = 0; b < blocks; b++) {
+        wide_step(w, r);
+        for (int l = 0; l < LANES; l++) {
+            store64le(dst + l * 8, r[l]);
+        }
+        dst += BLOCK_BYTES;
+    }
+}
+
+static void portable_range(WideState *w, unsigned char *dst, size_t blocks, unsigned first, unsigned count) {
+    uint64_t r[LANES];
+    for (size_t b = 0; b < blocks; b++) {
+        wide_step(w, r);
+        for (int l = 0; l < LANES; l++) {
+            for (int k = 0; k < 4; k++) {
+                dst[l * 4 + k] = range_from16(r[l] >> (16 * k), first, count);
+            }
+        }
+        dst += BLOCK_CHARS;
+    }
+}
+
+static const Backend backend_portable = { "portable", portable_bytes, portable_range };
+
+#ifdef RANDFILL_X86
+
+// --- SSE2 backend: two registers of two lanes each ---
+// SSE2 has no 64-bit multiply, so *5 and *9 are done as shift-and-add.
+
+#define SSE_ROTL(x, k) _mm_or_si128(_mm_slli_epi64((x), (k)), _mm_srli_epi64((x), 64 - (k)))
+
+__attribute__((target("sse2")))
+static inline __m128i sse2_step(__m128i s[4]) {
+    __m128i s1x5 = _mm_add_epi64(s[1], _mm_slli_epi64(s[1], 2));
+    __m128i rot = SSE_ROTL(s1x5, 7);
+    __m128i result = _mm_add_epi64(rot, _mm_slli_epi64(rot, 3));
+    __m128i t = _mm_slli_epi64(s[1], 17);
+
+    s[2] = _mm_xor_si128(s[2], s[0]);
+    s[3] = _mm_xor_si128(s[3], s[1]);
+    s[1] = _mm_xor_si128(s[1], s[2]);
+    s[0] = _mm_xor_si128(s[0], s[3]);
+    s[2] = _mm_xor_si128(s[2], t);
+    s[3] = SSE_ROTL(s[3], 45);
+    return result;
+}
+
+__attribute__((target("sse2")))
+static void sse2_load(const WideState *w, __m128i lo[4], __m128i hi[4]) {
+    for (int word = 0; word < 4; word++) {
+        lo[word] = _mm_loadu_si128((const __m128i *)&w->s[word][0]);
+        hi[word] = _mm_loadu_si128((const __m128i *)&w->s[word][2]);
+    }
+}
+
+__attribute__((target("sse2")))
+static void sse2_save(WideState *w, const __m128i lo[4], const __m128i hi[4]) {
+    for (int word = 0; word < 4; word++) {
+        _mm_storeu_si128((__m128i *)&w->s[word][0], lo[word]);
+        _mm_storeu_si128((__m128i *)&w->s[word][2], hi[word]);
+    }
+}
+
+__attribute__((target("sse2")))
+static void sse2_bytes(WideState *w, unsigned char *dst, size_t blocks) {
+    __m128i lo[4], hi[4];
+    sse2_load(w, lo, hi);
+    for (size_t b = 0; b < blocks; b++) {
+        _mm_storeu_si128((__m128i *)dst, sse2_step(lo));
+        _mm_storeu_si128((__m128i *)(dst + 16), sse2_step(hi));
+        dst += BLOCK_BYTES;
+    }
+    sse2_save(w, lo, hi);
+}
+
+__attribute__((target("sse2")))
+static void sse2_range(WideState *w, unsigned char *dst, size_t blocks, unsigned first, unsigned count) {
+    const __m128i vcount = _mm_set1_epi16((short)count);
+    const __m128i vfirst = _mm_set1_epi8((char)first);
+    __m128i lo[4], hi[4];
+    sse2_load(w, lo, hi);
+    for (size_t b = 0; b < blocks; b++) {
+        __m128i a = _mm_mulhi_epu16(sse2_step(lo), vcount);
+        __m128i c = _mm_mulhi_epu16(sse2_step(hi), vcount);
+        _mm_storeu_si128((__m128i *)dst, _mm_add_epi8(_mm_packus_epi16(a, c), vfirst));
+        dst += BLOCK_CHARS;
+    }
+    sse2_save(w, lo, hi);
+}
+
+static const Backend backend_sse2 = { "sse2", sse2_bytes, sse2_range };
+
+// --- AVX2 backend: one register holds all four lanes ---
+
+#define AVX_ROTL(x, k) _mm256_or_si256(_mm256_slli_epi64((x), (k)), _mm256_srli_epi64((x), 64 - (k)))
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_step(__m256i s[4]) {
+    __m256i s1x5 = _mm256_add_epi64(s[1], _mm256_slli_epi64(s[1], 2));
+    __m256i rot = AVX_ROTL(s1x5, 7);
+    __m256i result = _mm256_add_epi64(rot, _mm256_slli_epi64(rot, 3));
+    __m256i t = _mm256_slli_epi64(s[1], 17);
+
+    s[2] = _mm256_xor_si256(s[2], s[0]);
+    s[3] = _mm256_xor_si256(s[3], s[1]);
+    s[1] = _mm256_xor_si256(s[1], s[2]);
+    s[0] = _mm256_xor_si256(s[0], s[3]);
+    s[2] = _mm256_xor_si256(s[2], t);
+    s[3] = AVX_ROTL(s[3], 45);
+    return result;
+}
+
+__attribute__((target("avx2")))
+static void avx2_bytes(WideState *w, unsigned char *dst, size_t blocks) {
+    __m256i s[4];
+    for (int word = 0; word < 4; word++) {
+        s[word] = _mm256_loadu_si256((const __m256i *)w->s[word]);
+    }
+    for (size_t b = 0; b < blocks; b++) {
+        _mm256_storeu_si256((__m256i *)dst, avx2_step(s));
+        dst += BLOCK_BYTES;
+    }
+    for (int word = 0; word < 4; word++) {
+        _mm256_storeu_si256((__m256i *)w->s[word], s[word]);
+    }
+}
+
+__attribute__((target("avx2")))
+static void avx2_range(WideState *w, unsigned char *dst, size_t blocks, unsigned first, unsigned count) {
+    const __m256i vcount = _mm256_set1_epi16((short)count);
+    const __m256i vfirst = _mm256_set1_epi8((char)first);
+    __m256i s[4];
+    for (int word = 0; word < 4; word++) {
+        s[word] = _mm256_loadu_si256((const __m256i *)w->s[word]);
+    }
+    size_t b = 0;
+    for (; b + 2 <= blocks; b += 2) {
+        __m256i a = _mm256_mulhi_epu16(avx2_step(s), vcount);
+        __m256i c = _mm256_mulhi_epu16(avx2_step(s), vcount);
+        // packus works per 128-bit half; restore the lane order of the two steps.
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, c), 0xD8);
+        _mm256_storeu_si256((__m256i *)dst, _mm256_add_epi8(packed, vfirst));
+        dst += 2 * BLOCK_CHARS;
+    }
+    if (b < blocks) {
+        uint64_t r[LANES];
+        _mm256_storeu_si256((__m256i *)r, avx2_step(s));
+        for (int l = 0; l < LANES; l++) {
+            for (int k = 0; k < 4; k++) {
+                dst[l * 4 + k] = range_from16(r[l] >> (16 * k), first, count);
+            }
+        }
+    }
+    for (int word = 0; word < 4; word++) {
+        _mm256_storeu_si256((__m256i *)w->s[word], s[word]);
+    }
+}
+
+static const Backend backend_avx2 = { "avx2", avx2_bytes, avx2_range };
+
+#endif // RANDFILL_X86
+
+static const Backend *backend = &backend_portable;
+static pthread_once_t backend_once = PTHREAD_ONCE_INIT;
+
+static void choose_backend(void) {
+    const char *force = getenv("MNFGENDAT_SIMD");
+#ifdef RANDFILL_X86
+    __builtin_cpu_init();
+    int has_sse2 = __builtin_cpu_supports("sse2");
+    int has_avx2 = __builtin_cpu_supports("avx2");
+#else
+    int has_sse2 = 0;
+    int has_avx2 = 0;
+#endif
+
+    if (force && strcmp(force, "portable") == 0) return;
+#ifdef RANDFILL_X86
+    if (has_avx2 && !(force && strcmp(force, "sse2") == 0)) {
+        backend = &backend_avx2;
+    } else if (has_sse2) {
+        backend = &backend_sse2;
+    }
+#else
+    (void)has_sse2;
+    (void)has_avx2;
+#endif
+}
+
+void randfill_init(void) {
+    pthread_once(&backend_once, choose_backend);
+}
+
+const char *randfill_backend(void) {
+    return backend->name;
+}
+
+void randfill_bytes(Prng *rng, unsigned char *dst, size_t len) {
+    if (len < WIDE_MIN) {
+        while (len > 0) {
+            uint64_t v = prng_next(rng);
+            size_t n = len < 8 ? len : 8;
+            for (size_t b = 0; b < n; b++) {
+                dst[b] = (unsigned char)(v >> (8 * b));
+            }
+            dst += n;
+            len -= n;
+        }
+        return;
+    }
+
+    WideState w;
+    wide_seed(&w, rng);
+    size_t blocks = len / BLOCK_BYTES;
+    backend->bytes(&w, dst, blocks);
+
+    size_t tail = len % BLOCK_BYTES;
+    if (tail) {
+        unsigned char tmp[BLOCK_BYTES];
+        backend->bytes(&w, tmp, 1);
+        memcpy(dst + blocks * BLOCK_BYTES, tmp, tail);
+    }
+}
+
+void randfill_range(Prng *rng, unsigned char *dst, size_t len, unsigned first, unsigned count) {
+    if (len < WIDE_MIN) {
+        while (len > 0) {
+            uint64_t v = prng_next(rng);
+            size_t n = len < 4 ? len : 4;
+            for (size_t k = 0; k < n; k++) {
+                dst[k] = range_from16(v >> (16 * k), first, count);
+            }
+            dst += n;
+            len -= n;
+        }
+        return;
+    }
+
+    WideState w;
+    wide_seed(&w, rng);
+    size_t blocks = len / BLOCK_CHARS;
+    backend->range(&w, dst, blocks, first, count);
+
+    size_t tail = len % BLOCK_CHARS;
+    if (tail) {
+        unsigned char tmp[BLOCK_CHARS];
+        backend->range(&w, tmp, 1, first, count);
+        memcpy(dst + blocks * BLOCK_CHARS, tmp, tail);
+    }
+}
+
+void randfill_ascii(Prng *rng, unsigned char *dst, size_t len) {
+    randfill_range(rng, dst, len, ASCII_FIRST, ASCII_RANGE);
+}
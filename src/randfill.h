@@ -0,0 +1,31 @@
+#ifndef RANDFILL_H
+#define RANDFILL_H
+
+#include <stddef.h>
+#include "prng.h"
+
+// Bulk random fill kernels. Large fills run four xoshiro256** lanes side by
+// side (32 bytes per step) using AVX2, SSE2 or portable code, picked at
+// runtime. All backends produce identical bytes for the same generator state,
+// so the output never depends on the CPU it was generated on.
+
+// Selects the fastest backend supported by the CPU. The environment variable
+// MNFGENDAT_SIMD=portable|sse2|avx2 forces a specific one (for benchmarking).
+// Must be called before the first fill; later calls are no-ops. Thread-safe.
+void randfill_init(void);
+
+// Name of the selected backend ("portable", "sse2" or "avx2").
+const char *randfill_backend(void);
+
+// Fills dst with uniformly random bytes.
+void randfill_bytes(Prng *rng, unsigned char *dst, size_t len);
+
+// Fills dst with bytes uniformly drawn from [first, first + count), where
+// 1 <= count <= 256 and first + count <= 256. Each byte is taken from 16
+// random bits, so the mapping bias is below 0.4%.
+void randfill_range(Prng *rng, unsigned char *dst, size_t len, unsigned first, unsigned count);
+
+// Fills dst with random printable ASCII (0x20 - 0x7E).
+void randfill_ascii(Prng *rng, unsigned char *dst, size_t len);
+
+#endif // RANDFILL_H
@@ -0,0 +1,229 @@
+#include "recmix.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PACKED_DIGITS 31
+
+static int add_field(MixType *type, size_t offset, size_t length, FieldType format, size_t total) {
+    MixField *grown = realloc(type->fields, (type->field_count + 1) * sizeof(MixField));
+    if (!grown) {
+        perror("Error allocating memory for record types");
+        return 1;
+    }
+    type->fields = grown;
+    MixField *field = &type->fields[type->field_count++];
+    field->offset = offset;
+    field->length = length;
+    field->format = format;
+    field->total = total;
+    return 0;
+}
+
+// Gives every COUNT and SUM field of the trailer a total, and the detail
+// types the fields that add to it.
+static int compile_totals(RecordMix *mix, MixType *trailer, const Config *config) {
+    const Config *layout = trailer->config;
+    size_t offset = 0;
+    for (size_t f = 0; f < layout->field_count; offset += layout->fields[f++].length) {
+        const FieldDef *field = &layout->fields[f];
+        if (field->content != FIELD_CONTENT_COUNT && field->content != FIELD_CONTENT_SUM) continue;
+        size_t total = mix->total_count++;
+        if (add_field(trailer, offset, field->length, field->type, total) != 0) return 1;
+
+        for (size_t t = 0; t < config->record_type_count; t++) {
+            const RecordType *rt = &config->record_types[t];
+            if (field->content == FIELD_CONTENT_COUNT) {
+                if (field->source[0] == '\0' ? rt->role != RECORD_ROLE_DETAIL : strcmp(field->source, rt->name) != 0) {
+                    continue;
+                }
+                if (rt->role != RECORD_ROLE_DETAIL) {
+                    mix->totals->value[total]++;  // The header or the trailer itself
+                } else if (add_field(&mix->types[t], 0, 0, FIELD_ZONED, total) != 0) {
+                    return 1;
+                }
+            } else if (rt->role == RECORD_ROLE_DETAIL) {
+                size_t at = 0;
+                for (size_t g = 0; g < rt->config.field_count; at += rt->config.fields[g++].length) {
+                    const FieldDef *summed = &rt->config.fields[g];
+                    if (strcmp(summed->name, field->source) != 0) continue;
+                    if (add_field(&mix->types[t], at, summed->length, summed->type, total) != 0) return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int mix_compile(RecordMix *mix, const Config *config) {
+    memset(mix, 0, sizeof(*mix));
+    size_t n = config->record_type_count;
+    mix->types = calloc(n, sizeof(MixType));
+    mix->details = calloc(n, sizeof(MixType *));
+    mix->totals = calloc(1, sizeof(MixTotals));
+    if (mix->totals) pthread_mutex_init(&mix->totals->lock, NULL);
+    double *weights = calloc(n, sizeof(double));
+    if (!mix->types || !mix->details || !mix->totals || !weights) {
+        perror("Error allocating memory for record types");
+        free(weights);
+        mix_free(mix);
+        return 1;
+    }
+    mix->type_count = n;
+    mix->codepage = codepage_get(config->output_codepage);
+
+    int rc = 0;
+    MixType *trailer = NULL;
+    for (size_t t = 0; t < n && rc == 0; t++) {
+        const RecordType *rt = &config->record_types[t];
+        MixType *type = &mix->types[t];
+        type->config = &rt->config;
+        type->record_length = rt->config.record_length;
+        if (rt->config.field_count > 0) {
+            if (plan_compile(&type->plan, &rt->config) != 0) {
+                fprintf(stderr, "Error compiling the FIELD layout of RECORD_TYPE %s.\n", rt->name);
+                rc = 1;
+                break;
+            }
+            type->has_plan = 1;
+            if (type->plan.bits_length > mix->bits_length) mix->bits_length = type->plan.bits_length;
+        }
+        switch (rt->role) {
+            case RECORD_ROLE_HEADER: mix->header = type; break;
+            case RECORD_ROLE_TRAILER: mix->trailer = trailer = type; break;
+            case RECORD_ROLE_DETAIL:
+                weights[mix->detail_count] = rt->weight;
+                mix->details[mix->detail_count++] = type;
+                break;
+        }
+    }
+    if (rc == 0 && mix->detail_count > 1 && alias_build(&mix->table, weights, mix->detail_count) != 0) {
+        fprintf(stderr, "Error building the RECORD_TYPE table.\n");
+        rc = 1;
+    }
+    free(weights);
+    if (rc == 0 && trailer) {
+        rc = compile_totals(mix, trailer, config);
+    }
+    if (rc != 0) {
+        mix_free(mix);
+    }
+    return rc;
+}
+
+void mix_free(RecordMix *mix) {
+    for (size_t t = 0; t < mix->type_count; t++) {
+        if (mix->types[t].has_plan) plan_free(&mix->types[t].plan);
+        free(mix->types[t].fields);
+    }
+    free(mix->types);
+    free(mix->details);
+    alias_free(&mix->table);
+    if (mix->totals) {
+        pthread_mutex_destroy(&mix->totals->lock);
+        free(mix->totals);
+    }
+    memset(mix, 0, sizeof(*mix));
+}
+
+// Adds a decimal digit to a value below 10^18. The sum fits 64 bits, so it
+// only needs reducing when it reaches the modulus.
+static inline uint64_t push_digit(uint64_t v, unsigned digit) {
+    v = v * 10 + (digit < 10 ? digit : 0);
+    return (v >= MIX_TOTAL_MODULUS) ? v % MIX_TOTAL_MODULUS : v;
+}
+
+// Value of a numeric field, modulo 10^18.
+static int64_t field_value(const Codepage *cp, const MixField *field, const unsigned char *p) {
+    uint64_t v = 0;
+    int negative = 0;
+    size_t n = field->length;
+    switch (field->format) {
+        case FIELD_ZONED:
+        case FIELD_ZONED_SIGNED: {
+            for (size_t i = 0; i + 1 < n; i++) {
+                v = push_digit(v, (unsigned)(p[i] - cp->digit_zero));
+            }
+            unsigned digit = (unsigned)(p[n - 1] - cp->digit_zero);
+            if (field->format == FIELD_ZONED_SIGNED) {
+                digit = 0;
+                for (unsigned d = 0; d < 10; d++) {
+                    if (p[n - 1] == cp->overpunch_positive[d]) { digit = d; break; }
+                    if (p[n - 1] == cp->overpunch_negative[d]) { digit = d; negative = 1; break; }
+                }
+            }
+            v = push_digit(v, digit);
+            break;
+        }
+        case FIELD_PACKED:
+            for (size_t i = 0; i < n; i++) {
+                v = push_digit(v, p[i] >> 4);
+                if (i + 1 < n) v = push_digit(v, p[i] & 0x0F);
+            }
+            negative = ((p[n - 1] & 0x0F) == 0x0D || (p[n - 1] & 0x0F) == 0x0B);
+            break;
+        case FIELD_BINARY: {
+            // Big-endian two's complement.
+            uint64_t u = (p[0] & 0x80) ? UINT64_MAX : 0;
+            for (size_t i = 0; i < n; i++) u = (u << 8) | p[i];
+            return (int64_t)u % MIX_TOTAL_MODULUS;
+        }
+        default:
+            break;
+    }
+    return negative ? -(int64_t)v : (int64_t)v;
+}
+
+void mix_tally(const RecordMix *mix, const MixType *type, const unsigned char *record, int64_t *totals) {
+    for (size_t i = 0; i < type->field_count; i++) {
+        const MixField *field = &type->fields[i];
+        int64_t v = field->length ? field_value(mix->codepage, field, record + field->offset) : 1;
+        // Both terms are within +-10^18, so one correction brings the sum back.
+        int64_t sum = totals[field->total] + v;
+        if (sum >= MIX_TOTAL_MODULUS) sum -= MIX_TOTAL_MODULUS;
+        else if (sum <= -MIX_TOTAL_MODULUS) sum += MIX_TOTAL_MODULUS;
+        totals[field->total] = sum;
+    }
+}
+
+void mix_add(const RecordMix *mix, const int64_t *totals) {
+    MixTotals *file = mix->totals;
+    pthread_mutex_lock(&file->lock);
+    for (size_t i = 0; i < mix->total_count; i++) {
+        file->value[i] = (file->value[i] + totals[i]) % MIX_TOTAL_MODULUS;
+    }
+    pthread_mutex_unlock(&file->lock);
+}
+
+void mix_write_totals(const RecordMix *mix, unsigned char *record) {
+    const Codepage *cp = mix->codepage;
+    pthread_mutex_lock(&mix->totals->lock);
+    for (size_t i = 0; i < mix->trailer->field_count; i++) {
+        const MixField *field = &mix->trailer->fields[i];
+        unsigned char *dst = record + field->offset;
+        int64_t v = mix->totals->value[field->total];
+        uint64_t m = (v < 0) ? (uint64_t)-v : (uint64_t)v;
+        size_t n = field->length;
+
+        if (field->format == FIELD_BINARY) {
+            uint64_t u = (uint64_t)v;
+            for (size_t k = n; k-- > 0; u >>= 8) dst[k] = (unsigned char)u;
+        } else if (field->format == FIELD_PACKED) {
+            unsigned char nibbles[MAX_PACKED_DIGITS + 1];
+            size_t digits = 2 * n - 1;
+            nibbles[digits] = (v < 0) ? 0x0D : 0x0C;
+            for (size_t k = digits; k-- > 0; m /= 10) nibbles[k] = (unsigned char)(m % 10);
+            for (size_t k = 0; k < n; k++) {
+                dst[k] = (unsigned char)((nibbles[2 * k] << 4) | nibbles[2 * k + 1]);
+            }
+        } else {
+            // Zoned: unsigned fields show the magnitude.
+            for (size_t k = n; k-- > 0; m /= 10) dst[k] = (unsigned char)(cp->digit_zero + m % 10);
+            if (field->format == FIELD_ZONED_SIGNED) {
+                int digit = dst[n - 1] - cp->digit_zero;
+                dst[n - 1] = (v < 0) ? cp->overpunch_negative[digit] : cp->overpunch_positive[digit];
+            }
+        }
+    }
+    pthread_mutex_unlock(&mix->totals->lock);
+}
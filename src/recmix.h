@@ -0,0 +1,89 @@
+#ifndef RECMIX_H
+#define RECMIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "config.h"
+#include "prng.h"
+#include "plan.h"
+#include "alias.h"
+#include "codepage.h"
+
+// Files of several record types (RECORD_TYPE= sections).
+//
+// Every type is compiled once into a generation plan of its own. The type
+// of a detail record is drawn from an alias table over the DETAIL weights
+// with the first value of the record's generator, so picking it costs the
+// same with two types or two hundred. Header and trailer records are
+// written around the details by the generator.
+//
+// The trailer's COUNT and SUM fields are totals over the detail records.
+// While a batch is filled, each record adds the fields its type
+// contributes to the batch's totals; the batch then adds them to the
+// file's under a lock, so the trailer is ready when the last detail is,
+// without reading the output again. Totals are kept modulo 10^18, the
+// most digits a trailer field can show, and a field shows their last
+// digits, as a hash total does.
+
+#define MIX_MAX_TOTALS 16
+#define MIX_TOTAL_MODULUS 1000000000000000000LL
+
+// A field of a record that adds to (DETAIL) or receives (TRAILER) a total.
+typedef struct {
+    size_t offset;
+    size_t length;              // DETAIL: 0 = add one for the record
+    FieldType format;
+    size_t total;
+} MixField;
+
+typedef struct {
+    const Config *config;       // RecordType.config
+    size_t record_length;
+    int has_plan;               // Follows a FIELD layout (else one fill over the record)
+    GenPlan plan;
+    MixField *fields;
+    size_t field_count;
+} MixType;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int64_t value[MIX_MAX_TOTALS];
+} MixTotals;
+
+typedef struct {
+    MixType *types;             // In the order of config->record_types
+    size_t type_count;
+    const MixType **details;    // DETAIL types by alias table column
+    size_t detail_count;
+    AliasTable table;
+    const MixType *header;      // NULL = none
+    const MixType *trailer;
+    size_t total_count;
+    size_t bits_length;         // Largest scratch buffer a plan needs
+    const Codepage *codepage;
+    MixTotals *totals;          // Shared by every copy of the mix
+} RecordMix;
+
+// Compiles the record types of the config, which must outlive the mix.
+// Returns 0 on success, non-zero on error.
+int mix_compile(RecordMix *mix, const Config *config);
+
+void mix_free(RecordMix *mix);
+
+// Type of the next detail record.
+static inline const MixType *mix_pick(const RecordMix *mix, Prng *rng) {
+    if (mix->detail_count == 1) return mix->details[0];
+    return mix->details[alias_sample(&mix->table, rng)];
+}
+
+// Adds what a filled detail record of `type` contributes to `totals`.
+void mix_tally(const RecordMix *mix, const MixType *type, const unsigned char *record, int64_t *totals);
+
+// Adds the totals of a batch to those of the file.
+void mix_add(const RecordMix *mix, const int64_t *totals);
+
+// Writes the file's totals into the COUNT and SUM fields of a trailer record.
+void mix_write_totals(const RecordMix *mix, unsigned char *record);
+
+#endif // RECMIX_H
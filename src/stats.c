@@ -0,0 +1,265 @@
+#include "stats.h"
+#include "randfill.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+
+struct Stats {
+    const Config *config;
+    size_t threads;
+    uint64_t started_ns;
+    StatsCounters total;
+    OutputStats output;
+    pthread_mutex_t lock;
+    sigset_t signals;           // SIGUSR1
+    sigset_t old_mask;          // Caller's mask, to unblock SIGUSR1 again
+    pthread_t reporter;
+    int has_reporter;
+    int stopping;
+};
+
+static double seconds(uint64_t ns) {
+    return ns / 1e9;
+}
+
+// Scales the sampled phase time up to all records.
+static double estimate(uint64_t sampled_ns, const StatsCounters *c) {
+    return c->sampled ? seconds(sampled_ns) * (double)c->records / (double)c->sampled : 0.0;
+}
+
+static void snapshot(Stats *s, StatsCounters *out, double *elapsed) {
+    pthread_mutex_lock(&s->lock);
+    *out = s->total;
+    pthread_mutex_unlock(&s->lock);
+    *elapsed = seconds(stats_now_ns() - s->started_ns);
+}
+
+static void print_progress(Stats *s) {
+    StatsCounters c;
+    double elapsed;
+    snapshot(s, &c, &elapsed);
+
+    if (s->config->timed) {
+        // --duration runs have no record total; the time limit gives the ETA.
+        double rec_rate = elapsed > 0 ? c.records / elapsed : 0.0;
+        double mb_rate = elapsed > 0 ? c.bytes / elapsed / 1e6 : 0.0;
+        char eta[32] = "--:--:--";
+        if (s->config->duration > 0) {
+            double left_s = (s->config->duration > elapsed) ? s->config->duration - elapsed : 0.0;
+            unsigned long left = (unsigned long)(left_s + 0.5);
+            snprintf(eta, sizeof(eta), "%lu:%02lu:%02lu", left / 3600, left / 60 % 60, left % 60);
+        }
+        fprintf(stderr, "Progress: %llu records  %.1f MiB  %.1f MB/s  %.0f rec/s  ETA %s\n",
+                (unsigned long long)c.records, c.bytes / 1048576.0, mb_rate, rec_rate, eta);
+        return;
+    }
+
+    size_t total = s->config->record_count;
+    double percent = total ? 100.0 * (double)c.records / (double)total : 100.0;
+    double rec_rate = elapsed > 0 ? c.records / elapsed : 0.0;
+    double mb_rate = elapsed > 0 ? c.bytes / elapsed / 1e6 : 0.0;
+
+    char eta[32] = "--:--:--";
+    if (rec_rate > 0 && c.records <= total) {
+        unsigned long left = (unsigned long)((double)(total - c.records) / rec_rate + 0.5);
+        snprintf(eta, sizeof(eta), "%lu:%02lu:%02lu", left / 3600, left / 60 % 60, left % 60);
+    }
+    fprintf(stderr, "Progress: %5.1f%%  %llu/%llu records  %.1f MiB  %.1f MB/s  %.0f rec/s  ETA %s\n",
+            percent, (unsigned long long)c.records, (unsigned long long)total,
+            c.bytes / 1048576.0, mb_rate, rec_rate, eta);
+}
+
+// Prints a progress line every interval and on SIGUSR1 until stopped.
+static void *reporter_main(void *arg) {
+    Stats *s = arg;
+    unsigned interval = s->config->progress_interval;
+
+    for (;;) {
+        int sig;
+        if (interval > 0) {
+            struct timespec timeout = { (time_t)interval, 0 };
+            sig = sigtimedwait(&s->signals, NULL, &timeout);
+            if (sig < 0 && errno != EAGAIN) continue;  // EINTR
+        } else {
+            sig = sigwaitinfo(&s->signals, NULL);
+            if (sig < 0) continue;
+        }
+
+        pthread_mutex_lock(&s->lock);
+        int stopping = s->stopping;
+        pthread_mutex_unlock(&s->lock);
+        if (stopping) break;
+
+        print_progress(s);
+    }
+    return NULL;
+}
+
+Stats *stats_create(const Config *config, size_t threads) {
+    Stats *s = calloc(1, sizeof(Stats));
+    if (!s) {
+        perror("Error allocating statistics");
+        return NULL;
+    }
+    s->config = config;
+    s->threads = threads;
+    pthread_mutex_init(&s->lock, NULL);
+
+    // SIGUSR1 is only ever taken by sigwait in the reporter. Blocking it here,
+    // before the workers exist, makes every later thread inherit the mask.
+    sigemptyset(&s->signals);
+    sigaddset(&s->signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &s->signals, &s->old_mask);
+
+    s->started_ns = stats_now_ns();
+    if (pthread_create(&s->reporter, NULL, reporter_main, s) == 0) {
+        s->has_reporter = 1;
+    } else {
+        fprintf(stderr, "Warning: could not start the progress reporter.\n");
+    }
+    return s;
+}
+
+void stats_add(Stats *s, const StatsCounters *d) {
+    pthread_mutex_lock(&s->lock);
+    StatsCounters *t = &s->total;
+    t->records += d->records;
+    t->bytes += d->bytes;
+    t->batch_ns += d->batch_ns;
+    t->sampled += d->sampled;
+    t->fill_ns += d->fill_ns;
+    t->frame_ns += d->frame_ns;
+    t->write_ns += d->write_ns;
+    t->written += d->written;
+    for (int i = 0; i < STATS_HIST_BUCKETS; i++) {
+        t->length_hist[i] += d->length_hist[i];
+    }
+    t->length_sum += d->length_sum;
+    if (d->length_min && (t->length_min == 0 || d->length_min < t->length_min)) t->length_min = d->length_min;
+    if (d->length_max > t->length_max) t->length_max = d->length_max;
+    pthread_mutex_unlock(&s->lock);
+}
+
+OutputStats *stats_output(Stats *s) {
+    return &s->output;
+}
+
+static int has_histogram(const Stats *s, const StatsCounters *c) {
+    if (s->config->file_type != FILE_TYPE_VARIABLE) return 0;
+    for (int i = 0; i < STATS_HIST_BUCKETS; i++) {
+        if (c->length_hist[i]) return 1;
+    }
+    return 0;
+}
+
+static void print_summary(Stats *s, const StatsCounters *c, double elapsed) {
+    double fill = estimate(c->fill_ns, c);
+    double frame = estimate(c->frame_ns, c);
+    double batch = seconds(c->batch_ns);
+    double other = batch - fill - frame;
+    if (other < 0) other = 0;
+
+    fprintf(stderr, "Statistics:\n");
+    fprintf(stderr, "  Records:      %llu (%.0f rec/s)\n", (unsigned long long)c->records,
+            elapsed > 0 ? c->records / elapsed : 0.0);
+    fprintf(stderr, "  Generated:    %.1f MiB (%.1f MB/s)\n", c->bytes / 1048576.0,
+            elapsed > 0 ? c->bytes / elapsed / 1e6 : 0.0);
+    fprintf(stderr, "  Written:      %.1f MiB\n", (s->output.written_bytes + c->written) / 1048576.0);
+    fprintf(stderr, "  Elapsed:      %.3f s, %zu thread(s)\n", elapsed, s->threads);
+    fprintf(stderr, "  SIMD:         %s\n", randfill_backend());
+    fprintf(stderr, "  Time (summed over threads):\n");
+    fprintf(stderr, "    fill        %.3f s (estimated from %llu sampled records)\n", fill,
+            (unsigned long long)c->sampled);
+    fprintf(stderr, "    RDW/newline %.3f s (estimated)\n", frame);
+    fprintf(stderr, "    batch other %.3f s\n", other);
+    fprintf(stderr, "    write       %.3f s\n", seconds(s->output.write_ns + c->write_ns));
+    fprintf(stderr, "    write wait  %.3f s (generator blocked on the writer)\n", seconds(s->output.wait_ns));
+
+    if (has_histogram(s, c)) {
+        fprintf(stderr, "  Record lengths: min %llu, mean %.1f, max %llu\n",
+                (unsigned long long)c->length_min, (double)c->length_sum / (double)c->records,
+                (unsigned long long)c->length_max);
+        for (int i = 0; i < STATS_HIST_BUCKETS; i++) {
+            if (!c->length_hist[i]) continue;
+            unsigned long long lo = 1ull << i, hi = (2ull << i) - 1;
+            fprintf(stderr, "    %10llu - %-10llu %llu\n", lo, hi, (unsigned long long)c->length_hist[i]);
+        }
+    }
+}
+
+static void write_json(Stats *s, const StatsCounters *c, double elapsed, FILE *f) {
+    fprintf(f, "{\"records\":%llu,\"bytes\":%llu,\"written_bytes\":%llu,\"threads\":%zu,\"simd\":\"%s\","
+               "\"elapsed_s\":%.6f,\"records_per_s\":%.1f,\"mb_per_s\":%.3f,",
+            (unsigned long long)c->records, (unsigned long long)c->bytes,
+            s->output.written_bytes + c->written, s->threads, randfill_backend(), elapsed,
+            elapsed > 0 ? c->records / elapsed : 0.0,
+            elapsed > 0 ? c->bytes / elapsed / 1e6 : 0.0);
+    fprintf(f, "\"time_s\":{\"fill\":%.6f,\"frame\":%.6f,\"batch\":%.6f,\"write\":%.6f,\"write_wait\":%.6f},"
+               "\"sampled_records\":%llu",
+            estimate(c->fill_ns, c), estimate(c->frame_ns, c), seconds(c->batch_ns),
+            seconds(s->output.write_ns + c->write_ns), seconds(s->output.wait_ns),
+            (unsigned long long)c->sampled);
+    if (has_histogram(s, c)) {
+        fprintf(f, ",\"length_min\":%llu,\"length_mean\":%.3f,\"length_max\":%llu",
+                (unsigned long long)c->length_min, (double)c->length_sum / (double)c->records,
+                (unsigned long long)c->length_max);
+        fprintf(f, ",\"length_histogram\":[");
+        int first = 1;
+        for (int i = 0; i < STATS_HIST_BUCKETS; i++) {
+            if (!c->length_hist[i]) continue;
+            fprintf(f, "%s{\"min\":%llu,\"max\":%llu,\"count\":%llu}", first ? "" : ",",
+                    1ull << i, (2ull << i) - 1, (unsigned long long)c->length_hist[i]);
+            first = 0;
+        }
+        fprintf(f, "]");
+    }
+    fprintf(f, "}\n");
+}
+
+int stats_finish(Stats *s) {
+    if (s->has_reporter) {
+        pthread_mutex_lock(&s->lock);
+        s->stopping = 1;
+        pthread_mutex_unlock(&s->lock);
+        pthread_kill(s->reporter, SIGUSR1);
+        pthread_join(s->reporter, NULL);
+    }
+    // Unblock SIGUSR1 if the caller had it unblocked; only that, as other
+    // modules may have changed the rest of the mask since. A progress request
+    // that came after the reporter stopped was meant for this run: take it
+    // first, or it would end the caller.
+    if (!sigismember(&s->old_mask, SIGUSR1)) {
+        struct timespec now = {0, 0};
+        while (sigtimedwait(&s->signals, NULL, &now) == SIGUSR1) {
+        }
+        pthread_sigmask(SIG_UNBLOCK, &s->signals, NULL);
+    }
+
+    int rc = 0;
+    if (s->config->stats) {
+        StatsCounters c;
+        double elapsed;
+        snapshot(s, &c, &elapsed);
+        print_summary(s, &c, elapsed);
+
+        if (s->config->stats_json) {
+            FILE *f = fopen(s->config->stats_json, "w");
+            if (f) {
+                write_json(s, &c, elapsed, f);
+            }
+            if (!f || fclose(f) != 0) {
+                perror("Error writing statistics file");
+                rc = 1;
+            }
+        } else {
+            write_json(s, &c, elapsed, stderr);
+        }
+    }
+
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+    return rc;
+}
@@ -0,0 +1,82 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "config.h"
+#include "output.h"
+
+// Runtime instrumentation (--stats, --progress).
+//
+// Workers count into a local StatsCounters while filling a batch and merge it
+// with one locked add per batch, so the hot loop only pays for a few
+// increments. Timing of the individual record phases is sampled on every
+// STATS_SAMPLE_EVERY-th record and scaled up in the report.
+//
+// A reporter thread prints a progress line every --progress seconds and
+// whenever the process receives SIGUSR1.
+
+#define STATS_HIST_BUCKETS 32
+#define STATS_SAMPLE_EVERY 64
+
+typedef struct {
+    uint64_t records;
+    uint64_t bytes;              // Bytes generated (RDW/newline included)
+    uint64_t batch_ns;           // Time spent filling batches, summed over threads
+    uint64_t sampled;            // Records whose phases were timed
+    uint64_t fill_ns;            // Content generation of the sampled records
+    uint64_t frame_ns;           // RDW / newline emission of the sampled records
+    uint64_t write_ns;           // Writes done by the generating threads
+    uint64_t written;            // Bytes those writes put in the file
+    uint64_t length_hist[STATS_HIST_BUCKETS];  // VARIABLE: records by floor(log2(length))
+    uint64_t length_sum;         // VARIABLE: total data length of the records
+    uint64_t length_min;         // VARIABLE: shortest record (0 = none yet)
+    uint64_t length_max;
+} StatsCounters;
+
+typedef struct Stats Stats;
+
+// Starts collecting for the config (stats, stats_json, progress_interval)
+// and starts the progress reporter.
+// SIGUSR1 is blocked in the calling thread, so this must run before any
+// other thread is created. Returns NULL on error.
+Stats *stats_create(const Config *config, size_t threads);
+
+// Adds a batch worth of counters. Thread-safe.
+void stats_add(Stats *stats, const StatsCounters *delta);
+
+// Counters the output writer adds its totals to when it is closed.
+OutputStats *stats_output(Stats *stats);
+
+// Stops the reporter and, with --stats, prints the summary (human-readable
+// to stderr, JSON to stats_json or stderr). Frees the stats.
+// Returns 0 on success, non-zero if the JSON file could not be written.
+int stats_finish(Stats *stats);
+
+// Monotonic clock in nanoseconds.
+static inline uint64_t stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Histogram bucket of a record length (>= 1).
+static inline unsigned stats_bucket(size_t length) {
+    unsigned b = 0;
+    while (length > 1 && b < STATS_HIST_BUCKETS - 1) {
+        length >>= 1;
+        b++;
+    }
+    return b;
+}
+
+// Counts a VARIABLE record of `length` (>= 1) data bytes.
+static inline void stats_count_length(StatsCounters *c, size_t length) {
+    c->length_hist[stats_bucket(length)]++;
+    c->length_sum += length;
+    if (c->length_min == 0 || length < c->length_min) c->length_min = length;
+    if (length > c->length_max) c->length_max = length;
+}
+
+#endif // STATS_H
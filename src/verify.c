@@ -0,0 +1,1064 @@
+#include "verify.h"
+#include "codepage.h"
+#include "blocking.h"
+#include "plan.h"
+#include "key.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define VERIFY_X86 1
+#include <immintrin.h>
+#endif
+
+// Chunks are cut at the first record (or block) boundary past this size.
+#define CHUNK_BYTES (8 * 1024 * 1024)
+
+#define DESCRIPTOR_LEN 4
+#define UNKNOWN_INDEX UINT64_MAX
+#define MESSAGE_MAX 192
+
+// --- Byte classes ---
+//
+// A set of byte values stored as two 16-entry rows indexed by the low
+// nibble, with one bit per high nibble (0-7 in low_rows, 8-15 in
+// high_rows). A vector of bytes is classified with three byte shuffles:
+// the row of each low nibble, selected by the top bit, ANDed with the bit
+// of the high nibble.
+
+typedef struct {
+    unsigned char low_rows[16];
+    unsigned char high_rows[16];
+} ByteClass;
+
+static void class_add_range(ByteClass *cls, unsigned first, unsigned last) {
+    for (unsigned c = first; c <= last; c++) {
+        unsigned char *rows = (c & 0x80) ? cls->high_rows : cls->low_rows;
+        rows[c & 0x0F] |= (unsigned char)(1u << ((c >> 4) & 7));
+    }
+}
+
+static inline int class_has(const ByteClass *cls, unsigned char c) {
+    const unsigned char *rows = (c & 0x80) ? cls->high_rows : cls->low_rows;
+    return (rows[c & 0x0F] >> ((c >> 4) & 7)) & 1;
+}
+
+// Length of the prefix of p whose bytes all belong to the class.
+typedef size_t (*SpanFn)(const ByteClass *cls, const unsigned char *p, size_t len);
+
+static size_t span_scalar(const ByteClass *cls, const unsigned char *p, size_t len) {
+    size_t i = 0;
+    while (i < len && class_has(cls, p[i])) i++;
+    return i;
+}
+
+#ifdef VERIFY_X86
+
+__attribute__((target("ssse3")))
+static size_t span_ssse3(const ByteClass *cls, const unsigned char *p, size_t len) {
+    const __m128i low_rows = _mm_loadu_si128((const __m128i *)cls->low_rows);
+    const __m128i high_rows = _mm_loadu_si128((const __m128i *)cls->high_rows);
+    const __m128i bit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i lo = _mm_and_si128(v, nibble);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+        __m128i top = _mm_cmpgt_epi8(zero, v);
+        __m128i rows = _mm_or_si128(_mm_and_si128(top, _mm_shuffle_epi8(high_rows, lo)),
+                                    _mm_andnot_si128(top, _mm_shuffle_epi8(low_rows, lo)));
+        __m128i hit = _mm_and_si128(rows, _mm_shuffle_epi8(bit, hi));
+        unsigned miss = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(hit, zero));
+        if (miss) return i + (size_t)__builtin_ctz(miss);
+    }
+    return i + span_scalar(cls, p + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t span_avx2(const ByteClass *cls, const unsigned char *p, size_t len) {
+    const __m256i low_rows = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)cls->low_rows));
+    const __m256i high_rows = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)cls->high_rows));
+    const __m256i bit = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                         1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i lo = _mm256_and_si256(v, nibble);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+        __m256i top = _mm256_cmpgt_epi8(zero, v);
+        __m256i rows = _mm256_or_si256(_mm256_and_si256(top, _mm256_shuffle_epi8(high_rows, lo)),
+                                       _mm256_andnot_si256(top, _mm256_shuffle_epi8(low_rows, lo)));
+        __m256i hit = _mm256_and_si256(rows, _mm256_shuffle_epi8(bit, hi));
+        unsigned miss = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hit, zero));
+        if (miss) return i + (size_t)__builtin_ctz(miss);
+    }
+    return i + span_scalar(cls, p + i, len - i);
+}
+
+#endif // VERIFY_X86
+
+static SpanFn span = span_scalar;
+
+// Picks the span kernel, honouring MNFGENDAT_SIMD like the fill kernels.
+static void select_span(void) {
+#ifdef VERIFY_X86
+    const char *force = getenv("MNFGENDAT_SIMD");
+    __builtin_cpu_init();
+    if (force && strcmp(force, "portable") == 0) return;
+    if (__builtin_cpu_supports("avx2") && !(force && strcmp(force, "sse2") == 0)) {
+        span = span_avx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        span = span_ssse3;
+    }
+#endif
+}
+
+// --- Record content ---
+
+typedef struct Verifier Verifier;
+typedef struct FieldCheck FieldCheck;
+
+// Checks `len` bytes of a record. Returns NULL if they are what the
+// generator writes, otherwise what is wrong, with the position of the
+// offending byte in *at (len if the data ends too early).
+typedef const char *(*CheckFn)(const FieldCheck *check, const unsigned char *data, size_t len, size_t *at);
+
+struct FieldCheck {
+    const char *name;               // FIELD name (NULL = no FIELD layout, or trailing filler)
+    size_t offset;
+    size_t length;                  // 0 = the rest of the record
+    CheckFn check;
+    const ByteClass *cls;           // check_class: the allowed bytes
+    const char *what;               // check_class: what a byte outside the class is
+    const unsigned char *expected;  // check_constant: the FILL_PATTERN bytes
+    const Verifier *verifier;
+};
+
+// A run of whole records (or blocks) checked by one thread.
+typedef struct {
+    size_t start;               // File offset of the first record or block
+    size_t end;                 // Offset after the last one
+    uint64_t first;             // Index in the file of its first record (UNKNOWN_INDEX in blocked files)
+    uint64_t records;           // Records that start in the chunk
+    uint64_t bad;               // Records that failed a check
+    int failed;                 // The first failure in the chunk:
+    uint64_t fail_record;       //   record, counted from the start of the chunk
+    size_t fail_offset;         //   file offset of its RDW/SDW (FIXED: first byte)
+    char message[MESSAGE_MAX];
+} Chunk;
+
+struct Verifier {
+    const Config *config;
+    const Codepage *codepage;
+    const unsigned char *map;
+    size_t size;
+
+    // Structure
+    size_t record_bytes;        // FIXED: record plus NEWLINE
+    unsigned char newline[2];   // Record delimiter in the output codepage
+    size_t newline_len;
+    size_t min_length;          // VARIABLE data length
+    size_t max_length;
+    int extended_bdw;           // BLOCK_SIZE over 32760: large block interface BDWs
+    size_t page_size;
+
+    // Content
+    GenPlan plan;               // Holds the bytes of constant fill
+    FieldCheck *checks;
+    size_t check_count;
+    ByteClass text;             // Printable characters of the codepage
+    ByteClass digits;
+    ByteClass overpunch;        // Last byte of a signed zoned decimal
+    ByteClass dbcs;             // Bytes of a 7-bit JIS or host DBCS character
+    KeyGen keys;                // KEY=: the value every record must carry
+    int keys_exact;             // ... known (ASCENDING, or RANDOM with a given seed)
+
+    // Chunks, published in file order by the walking thread
+    Chunk *chunks;
+    size_t chunk_capacity;
+    size_t published;
+    size_t next;
+    int walk_done;
+    int alloc_failed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // Set by the walking thread when the structure breaks off
+    int broken;
+    char broken_message[MESSAGE_MAX];
+};
+
+static const char *check_class(const FieldCheck *fc, const unsigned char *data, size_t len, size_t *at) {
+    *at = span(fc->cls, data, len);
+    return (*at < len) ? fc->what : NULL;
+}
+
+static const char *check_constant(const FieldCheck *fc, const unsigned char *data, size_t len, size_t *at) {
+    if (memcmp(data, fc->expected, len) == 0) return NULL;
+    size_t i = 0;
+    while (data[i] == fc->expected[i]) i++;
+    *at = i;
+    return "byte differs from FILL_PATTERN";
+}
+
+static inline int sjis_lead(unsigned char c) {
+    return (c >= 0x81 && c <= 0x9F) || (c >= 0xE0 && c <= 0xEF);
+}
+
+static inline int sjis_trail(unsigned char c) {
+    return c >= 0x40 && c <= 0xFC && c != 0x7F;
+}
+
+// Shift-JIS text: printable ASCII runs and lead/trail byte pairs.
+static const char *check_sjis(const FieldCheck *fc, const unsigned char *data, size_t len, size_t *at) {
+    const ByteClass *ascii = &fc->verifier->text;
+    size_t i = 0;
+    while ((i += span(ascii, data + i, len - i)) < len) {
+        if (!sjis_lead(data[i])) {
+            *at = i;
+            return "invalid Shift-JIS lead byte";
+        }
+        do {
+            if (i + 1 >= len) {
+                *at = i;
+                return "Shift-JIS character split at the end";
+            }
+            if (!sjis_trail(data[i + 1])) {
+                *at = i + 1;
+                return "invalid Shift-JIS trail byte";
+            }
+            i += 2;
+        } while (i < len && sjis_lead(data[i]));
+    }
+    return NULL;
+}
+
+// Shift-JIS text of dictionary entries: any CP932 character, including
+// half-width katakana and the extension rows.
+static const char *check_sjis_dictionary(const FieldCheck *fc, const unsigned char *data, size_t len, size_t *at) {
+    const ByteClass *ascii = &fc->verifier->text;
+    size_t i = 0;
+    while ((i += span(ascii, data + i, len - i)) < len) {
+        unsigned char c = data[i];
+        if (c >= 0xA1 && c <= 0xDF) {
+            i++;
+            continue;
+        }
+        if (!((c >= 0x81 && c <= 0x9F) || (c >= 0xE0 && c <= 0xFC))) {
+            *at = i;
+            return "invalid Shift-JIS lead byte";
+        }
+        if (i + 1 >= len) {
+            *at = i;
+            return "Shift-JIS character split at the end";
+        }
+        if (!sjis_trail(data[i + 1])) {
+            *at = i + 1;
+            return "invalid Shift-JIS trail byte";
+        }
+        i += 2;
+    }
+    return NULL;
+}
+
+// An odd byte after the characters of a DBCS field is a space.
+static const char *check_dbcs_pad(const FieldCheck *fc, const unsigned char *data, size_t len, size_t *at) {
+    if (len % 2 && data[len - 1] != fc->verifier->codepage->space) {
+        *at = len - 1;
+        return "odd byte of a DBCS field is not a space";
+    }
+    return NULL;
+}
+
+static const char *check_sjis_dbcs(const FieldCheck *fc, const unsigned char *data, size_t len, size_t *at) {
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        if (!sjis_lead(data[i])) {
+            *at = i;
+            return "invalid Shift-JIS lead byte";
+        }
+        if (!sjis_trail(data[i + 1])) {
+            *at = i + 1;
+            return "invalid Shift-JIS trail byte";
+        }
+    }
+    return check_dbcs_pad(fc, data, len, at);
+}
+
+static const char *check_host_dbcs(const FieldCheck *fc, const unsigned char *data, size_t len, size_t *at) {
+    size_t even = len - len % 2;
+    *at = span(&fc->verifier->dbcs, data, even);
+    if (*at < even) return "invalid DBCS byte";
+    return check_dbcs_pad(fc, data, len, at);
+}
+
+// ISO-2022 text: printable characters, and DBCS runs of at least one
+// character between START_CODE and END_CODE, every run closed before the
+// end of the data.
+static const char *check_iso2022(const FieldCheck *fc, const unsigned char *data, size_t len, size_t *at) {
+    const Verifier *v = fc->verifier;
+    const Config *config = v->config;
+    size_t i = 0;
+    while ((i += span(&v->text, data + i, len - i)) < len) {
+        if (len - i < config->start_code_len || memcmp(data + i, config->start_code, config->start_code_len) != 0) {
+            *at = i;
+            return "byte is neither printable text nor START_CODE";
+        }
+        i += config->start_code_len;
+        size_t run = span(&v->dbcs, data + i, len - i);
+        if (run == 0) {
+            *at = i;
+            return "empty DBCS run";
+        }
+        if (run % 2) {
+            *at = i + run - 1;
+            return "incomplete DBCS character";
+        }
+        i += run;
+        if (len - i < config->end_code_len || memcmp(data + i, config->end_code, config->end_code_len) != 0) {
+            *at = (i < len) ? i : len;
+            return (i < len) ? "byte is neither a DBCS character nor END_CODE" : "DBCS run not closed by END_CODE";
+        }
+        i += config->end_code_len;
+    }
+    return NULL;
+}
+
+static const char *check_zoned_signed(const FieldCheck *fc, const unsigned char *data, size_t len, size_t *at) {
+    const Verifier *v = fc->verifier;
+    *at = span(&v->digits, data, len - 1);
+    if (*at < len - 1) return "not a digit";
+    if (!class_has(&v->overpunch, data[len - 1])) {
+        *at = len - 1;
+        return "not an overpunched sign digit";
+    }
+    return NULL;
+}
+
+// COMP-3: decimal digit nibbles, the last nibble the C or D sign.
+static const char *check_packed(const FieldCheck *fc, const unsigned char *data, size_t len, size_t *at) {
+    (void)fc;
+    for (size_t i = 0; i < len; i++) {
+        unsigned hi = data[i] >> 4, lo = data[i] & 0x0F;
+        int last = (i + 1 == len);
+        if (hi > 9 || (!last && lo > 9)) {
+            *at = i;
+            return "invalid packed decimal digit";
+        }
+        if (last && lo != 0x0C && lo != 0x0D) {
+            *at = i;
+            return "invalid packed decimal sign";
+        }
+    }
+    return NULL;
+}
+
+// Packed key: digits and the C sign nibble only.
+static const char *check_packed_key(const FieldCheck *fc, const unsigned char *data, size_t len, size_t *at) {
+    const char *problem = check_packed(fc, data, len, at);
+    if (!problem && (data[len - 1] & 0x0F) != 0x0C) {
+        *at = len - 1;
+        problem = "packed key is not positive";
+    }
+    return problem;
+}
+
+static FieldCheck *add_check(Verifier *v, const char *name, size_t offset, size_t length, CheckFn check) {
+    FieldCheck *fc = &v->checks[v->check_count++];
+    memset(fc, 0, sizeof(*fc));
+    fc->name = name;
+    fc->offset = offset;
+    fc->length = length;
+    fc->check = check;
+    fc->verifier = v;
+    return fc;
+}
+
+static void add_class_check(Verifier *v, const char *name, size_t offset, size_t length,
+                            const ByteClass *cls, const char *what) {
+    FieldCheck *fc = add_check(v, name, offset, length, check_class);
+    fc->cls = cls;
+    fc->what = what;
+}
+
+// Checks of a filler, or of a whole record without a FIELD layout.
+static void add_fill_check(Verifier *v, const char *name, size_t offset, size_t length) {
+    const Config *config = v->config;
+    if (config->fill_type != FILL_PATTERN_RANDOM) {
+        add_check(v, name, offset, length, check_constant)->expected = v->plan.constants + offset;
+    } else if (config->data_mode == DATA_MODE_TEXT) {
+        add_class_check(v, name, offset, length, &v->text, "not printable text");
+    }
+    // Random binary data: every byte value is valid.
+}
+
+// Format of the KEY bytes; their value is compared in check_record().
+static void add_key_check(Verifier *v) {
+    const Config *config = v->config;
+    if (config->key_format == FIELD_ZONED) {
+        add_class_check(v, "KEY", config->key_offset, config->key_length, &v->digits, "not a digit");
+    } else if (config->key_format == FIELD_PACKED) {
+        add_check(v, "KEY", config->key_offset, config->key_length, check_packed_key);
+    }
+}
+
+// Derives the content checks from the definition, mirroring fill_buffer()
+// and the FIELD plan. Returns 0 on success, non-zero on error.
+static int compile_checks(Verifier *v) {
+    const Config *config = v->config;
+    const Codepage *cp = v->codepage;
+
+    for (unsigned k = 0; k < cp->text_count; k++) {
+        class_add_range(&v->text, cp->text[k], cp->text[k]);
+    }
+    class_add_range(&v->digits, cp->digit_zero, cp->digit_zero + 9u);
+    for (int d = 0; d < 10; d++) {
+        class_add_range(&v->overpunch, cp->overpunch_positive[d], cp->overpunch_positive[d]);
+        class_add_range(&v->overpunch, cp->overpunch_negative[d], cp->overpunch_negative[d]);
+    }
+    if (cp->dbcs) {
+        class_add_range(&v->dbcs, 0x41, 0xFE);  // IBM host DBCS
+        class_add_range(&v->dbcs, 0x40, 0x40);  // Half of the DBCS space 0x4040
+    } else {
+        class_add_range(&v->dbcs, 0x21, 0x7E);  // 7-bit JIS X 0208
+    }
+
+    if (config->key_length > 0) {
+        key_init(&v->keys, config);
+        // Without the seed RANDOM keys can only be checked for their format.
+        v->keys_exact = !config->key_random || config->seed_set;
+    }
+
+    // The plan is compiled for its constant fill: the same bytes, at the
+    // same offsets, as the generator writes.
+    if (plan_compile(&v->plan, config) != 0) {
+        fprintf(stderr, "Error compiling the FIELD layout.\n");
+        return 1;
+    }
+    v->checks = calloc(config->field_count + 3, sizeof(FieldCheck));
+    if (!v->checks) {
+        perror("Error allocating memory for the checks");
+        return 1;
+    }
+
+    int iso = 0;
+    if (config->field_count == 0) {
+        if (config->fill_type == FILL_PATTERN_RANDOM && config->data_mode == DATA_MODE_TEXT &&
+            config->text_type == TEXT_TYPE_SJIS) {
+            add_check(v, NULL, 0, 0, check_sjis);
+        } else if (config->fill_type == FILL_PATTERN_RANDOM && config->data_mode == DATA_MODE_TEXT &&
+                   config->text_type == TEXT_TYPE_ISO_2022) {
+            add_check(v, NULL, 0, 0, check_iso2022);
+            iso = 1;
+        } else if (config->key_length > 0) {
+            // The key sits in the middle of the fill (the parser rules out
+            // multibyte text around it).
+            if (config->key_offset > 0) add_fill_check(v, NULL, 0, config->key_offset);
+            add_key_check(v);
+            add_fill_check(v, NULL, config->key_offset + config->key_length, 0);
+        } else {
+            add_fill_check(v, NULL, 0, 0);
+        }
+    } else {
+        size_t offset = 0;
+        for (size_t f = 0; f <= config->field_count; f++) {
+            const FieldDef *field = (f < config->field_count) ? &config->fields[f] : NULL;
+            const char *name = field ? field->name : NULL;
+            size_t length = field ? field->length : config->record_length - offset;
+            if (length == 0) continue;
+            if (field && config->key_length > 0 && offset >= config->key_offset &&
+                offset + length <= config->key_offset + config->key_length) {
+                // Replaced by the key.
+                if (offset == config->key_offset) add_key_check(v);
+                offset += length;
+                continue;
+            }
+
+            switch (field ? field->type : FIELD_FILLER) {
+                case FIELD_TEXT: add_class_check(v, name, offset, length, &v->text, "not printable text"); break;
+                case FIELD_ZONED: add_class_check(v, name, offset, length, &v->digits, "not a digit"); break;
+                case FIELD_ZONED_SIGNED: add_check(v, name, offset, length, check_zoned_signed); break;
+                case FIELD_PACKED: add_check(v, name, offset, length, check_packed); break;
+                case FIELD_BINARY: break;
+                case FIELD_DBCS: add_check(v, name, offset, length, cp->dbcs ? check_host_dbcs : check_sjis_dbcs); break;
+                case FIELD_MIXED: add_check(v, name, offset, length, check_iso2022); iso = 1; break;
+                case FIELD_FILLER: add_fill_check(v, name, offset, length); break;
+                case FIELD_DICTIONARY:
+                    // Entries are written the way the codepage and TEXT_TYPE
+                    // allow: Shift-JIS, framed DBCS runs, or single bytes only.
+                    if (cp->dbcs || (!cp->ebcdic && config->text_type == TEXT_TYPE_ISO_2022)) {
+                        add_check(v, name, offset, length, check_iso2022);
+                        iso = 1;
+                    } else if (cp->ebcdic) {
+                        add_class_check(v, name, offset, length, &v->text, "not printable text");
+                    } else {
+                        add_check(v, name, offset, length, check_sjis_dictionary);
+                    }
+                    break;
+            }
+            offset += length;
+        }
+    }
+
+    // A shift code is found by the first byte that is not text (or not
+    // DBCS); one starting with such a byte would be ambiguous.
+    if (iso && (class_has(&v->text, config->start_code[0]) || class_has(&v->dbcs, config->end_code[0]))) {
+        fprintf(stderr, "Error: Cannot verify ISO-2022 text whose START_CODE starts with a printable character "
+                        "or whose END_CODE starts with a DBCS byte.\n");
+        return 1;
+    }
+    return 0;
+}
+
+// --- Record structure ---
+
+static void chunk_fail(Chunk *c, uint64_t record, size_t offset, const char *fmt, ...) {
+    c->bad++;
+    if (c->failed) return;
+    c->failed = 1;
+    c->fail_record = record;
+    c->fail_offset = offset;
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(c->message, sizeof(c->message), fmt, ap);
+    va_end(ap);
+}
+
+static void walk_fail(Verifier *v, const char *fmt, ...) {
+    if (v->broken) return;
+    v->broken = 1;
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(v->broken_message, sizeof(v->broken_message), fmt, ap);
+    va_end(ap);
+}
+
+static void check_record(const Verifier *v, Chunk *c, uint64_t record, size_t offset,
+                         const unsigned char *data, size_t len) {
+    for (size_t k = 0; k < v->check_count; k++) {
+        const FieldCheck *fc = &v->checks[k];
+        size_t n = fc->length ? fc->length : len - fc->offset;
+        size_t at;
+        const char *problem = fc->check(fc, data + fc->offset, n, &at);
+        if (!problem) continue;
+
+        char where[FIELD_NAME_MAX + 16] = "";
+        if (fc->name) snprintf(where, sizeof(where), "field %s: ", fc->name);
+        if (at < n) {
+            chunk_fail(c, record, offset, "%s%s at data byte %zu (0x%02X)", where, problem,
+                       fc->offset + at, data[fc->offset + at]);
+        } else {
+            chunk_fail(c, record, offset, "%s%s", where, problem);
+        }
+        return;
+    }
+
+    if (v->keys_exact && c->first != UNKNOWN_INDEX) {
+        const Config *config = v->config;
+        unsigned char expected[KEY_MAX_LENGTH];
+        uint64_t index = c->first + record;
+        key_write(&v->keys, index, expected);
+        if (memcmp(data + config->key_offset, expected, config->key_length) != 0) {
+            chunk_fail(c, record, offset, "KEY is not %llu, the key of this record",
+                       (unsigned long long)key_value(&v->keys, index));
+        }
+    }
+}
+
+// Returns non-zero (and records the failure) if a VARIABLE data length is
+// outside what the definition allows.
+static int bad_length(const Verifier *v, Chunk *c, uint64_t record, size_t offset, size_t len) {
+    if (len >= v->min_length && len <= v->max_length) return 0;
+    if (v->min_length == v->max_length) {
+        chunk_fail(c, record, offset, "data length %zu, expected %zu", len, v->max_length);
+    } else {
+        chunk_fail(c, record, offset, "data length %zu outside %zu-%zu", len, v->min_length, v->max_length);
+    }
+    return 1;
+}
+
+static size_t get16(const unsigned char *p, RdwEndian endian) {
+    return (endian == RDW_ENDIAN_BIG) ? ((size_t)p[0] << 8 | p[1]) : ((size_t)p[1] << 8 | p[0]);
+}
+
+// Block length in a BDW, 0 if the BDW is not of the form the generator writes.
+static size_t get_bdw(const Verifier *v, const unsigned char *p) {
+    RdwEndian endian = v->config->rdw_endian;
+    if (v->extended_bdw) {
+        uint32_t x = 0;
+        for (int i = 0; i < 4; i++) {
+            int shift = (endian == RDW_ENDIAN_BIG) ? 24 - 8 * i : 8 * i;
+            x |= (uint32_t)p[i] << shift;
+        }
+        return (x & 0x80000000u) ? (size_t)(x & 0x7FFFFFFFu) : 0;
+    }
+    return (p[2] == 0 && p[3] == 0) ? get16(p, endian) : 0;
+}
+
+static void check_fixed(const Verifier *v, Chunk *c) {
+    size_t length = v->config->record_length;
+    for (size_t pos = c->start; pos < c->end; pos += v->record_bytes) {
+        const unsigned char *record = v->map + pos;
+        uint64_t r = c->records++;
+        if (v->newline_len && memcmp(record + length, v->newline, v->newline_len) != 0) {
+            chunk_fail(c, r, pos, "record does not end with NEWLINE");
+            continue;
+        }
+        check_record(v, c, r, pos, record, length);
+    }
+}
+
+static void check_variable(const Verifier *v, Chunk *c) {
+    // The walking thread has followed the RDW chain up to c->end.
+    for (size_t pos = c->start; pos < c->end; ) {
+        const unsigned char *rdw = v->map + pos;
+        size_t total = get16(rdw, v->config->rdw_endian);
+        uint64_t r = c->records++;
+        if (rdw[2] != 0 || rdw[3] != 0) {
+            chunk_fail(c, r, pos, "RDW reserved bytes are not zero");
+        } else if (!bad_length(v, c, r, pos, total - DESCRIPTOR_LEN)) {
+            check_record(v, c, r, pos, rdw + DESCRIPTOR_LEN, total - DESCRIPTOR_LEN);
+        }
+        pos += total;
+    }
+}
+
+// VB and VBS blocks. A spanned record belongs to the chunk that holds its
+// first segment: segments continuing a record of the previous chunk are
+// skipped, and a record still open at the end of the chunk is followed into
+// the next blocks. Its segments are joined in `joined` before the checks.
+static void check_blocks(const Verifier *v, Chunk *c, unsigned char *joined) {
+    const Config *config = v->config;
+    RdwEndian endian = config->rdw_endian;
+    int skipping = (c->start > 0);
+    int open = 0;               // Inside a spanned record
+    int open_bad = 0;           // ... which already failed
+    size_t open_len = 0, open_offset = 0;
+    uint64_t open_record = 0;
+    size_t pos = c->start;
+
+    while (pos < c->end || open) {
+        // Past the chunk the walking thread may not have checked the BDW yet.
+        size_t block_len = (v->size - pos >= DESCRIPTOR_LEN) ? get_bdw(v, v->map + pos) : 0;
+        if (block_len < 2 * DESCRIPTOR_LEN + 1 || block_len > config->block_size || block_len > v->size - pos) {
+            if (!open_bad) chunk_fail(c, open_record, open_offset, "spanned record has no last segment");
+            return;
+        }
+        size_t block_end = pos + block_len;
+
+        for (size_t seg = pos + DESCRIPTOR_LEN; seg < block_end; ) {
+            if (pos >= c->end && !open) return;  // The rest belongs to the next chunk
+
+            const unsigned char *sdw = v->map + seg;
+            size_t seg_len = (block_end - seg >= DESCRIPTOR_LEN) ? get16(sdw, endian) : 0;
+            if (seg_len <= DESCRIPTOR_LEN || seg_len > block_end - seg) {
+                if (open) {
+                    if (!open_bad) chunk_fail(c, open_record, open_offset, "descriptor at offset %zu does not fit its block", seg);
+                    open = 0;
+                } else {
+                    chunk_fail(c, c->records++, seg, "descriptor does not fit the block at offset %zu", pos);
+                }
+                skipping = 0;
+                break;
+            }
+            const unsigned char *data = sdw + DESCRIPTOR_LEN;
+            size_t len = seg_len - DESCRIPTOR_LEN;
+            seg += seg_len;
+
+            if (!config->spanned) {
+                uint64_t r = c->records++;
+                if (sdw[2] != 0 || sdw[3] != 0) {
+                    chunk_fail(c, r, seg - seg_len, "RDW reserved bytes are not zero");
+                } else if (!bad_length(v, c, r, seg - seg_len, len)) {
+                    check_record(v, c, r, seg - seg_len, data, len);
+                }
+                continue;
+            }
+
+            unsigned control = sdw[2];
+            int valid = (sdw[3] == 0 && control <= SEGMENT_MIDDLE);
+            int starts = valid && (control == SEGMENT_COMPLETE || control == SEGMENT_FIRST);
+            if (skipping && valid && !starts) continue;  // Tail of the previous chunk's record
+            skipping = 0;
+
+            if ((!valid || starts) && open) {
+                if (!open_bad) chunk_fail(c, open_record, open_offset, "spanned record has no last segment");
+                open = 0;
+                if (pos >= c->end) return;  // This segment belongs to the next chunk
+            }
+            if (!valid) {
+                chunk_fail(c, c->records++, seg - seg_len, "invalid SDW control bytes %02X %02X", sdw[2], sdw[3]);
+                continue;
+            }
+            if (control == SEGMENT_COMPLETE) {
+                uint64_t r = c->records++;
+                if (!bad_length(v, c, r, seg - seg_len, len)) {
+                    check_record(v, c, r, seg - seg_len, data, len);
+                }
+                continue;
+            }
+            if (control == SEGMENT_FIRST) {
+                open = 1;
+                open_bad = 0;
+                open_len = 0;
+                open_offset = seg - seg_len;
+                open_record = c->records++;
+            } else if (!open) {
+                chunk_fail(c, c->records++, seg - seg_len, "%s segment without a first segment",
+                           control == SEGMENT_LAST ? "last" : "middle");
+                continue;
+            }
+
+            if (!open_bad) {
+                if (len > config->record_length - open_len) {
+                    chunk_fail(c, open_record, open_offset, "spanned record longer than RECORD_LENGTH %zu",
+                               config->record_length);
+                    open_bad = 1;
+                } else {
+                    memcpy(joined + open_len, data, len);
+                    open_len += len;
+                }
+            }
+            if (control == SEGMENT_LAST) {
+                if (!open_bad && !bad_length(v, c, open_record, open_offset, open_len)) {
+                    check_record(v, c, open_record, open_offset, joined, open_len);
+                }
+                open = 0;
+            }
+        }
+        pos = block_end;
+    }
+}
+
+// --- Chunks and threads ---
+
+static void publish(Verifier *v, size_t start, size_t end, uint64_t first) {
+    pthread_mutex_lock(&v->lock);
+    Chunk *c = &v->chunks[v->published];
+    memset(c, 0, sizeof(*c));
+    c->start = start;
+    c->end = end;
+    c->first = first;
+    v->published++;
+    pthread_cond_broadcast(&v->cond);
+    pthread_mutex_unlock(&v->lock);
+}
+
+// Follows the RDW chain of an unblocked VARIABLE file.
+static void walk_records(Verifier *v) {
+    size_t total = v->config->record_count;
+    size_t pos = 0, start = 0, records = 0, start_records = 0;
+
+    while (records < total) {
+        if (v->size - pos < DESCRIPTOR_LEN) {
+            walk_fail(v, "File ends after %zu of %zu records", records, total);
+            break;
+        }
+        size_t len = get16(v->map + pos, v->config->rdw_endian);
+        if (len <= DESCRIPTOR_LEN) {
+            walk_fail(v, "Invalid RDW length %zu at offset %zu (record %zu)", len, pos,
+                      v->config->first_record + records);
+            break;
+        }
+        if (len > v->size - pos) {
+            walk_fail(v, "Record %zu at offset %zu runs past the end of the file",
+                      v->config->first_record + records, pos);
+            break;
+        }
+        pos += len;
+        records++;
+        if (pos - start >= CHUNK_BYTES) {
+            publish(v, start, pos, v->config->first_record + start_records);
+            start = pos;
+            start_records = records;
+        }
+    }
+    if (pos > start) publish(v, start, pos, v->config->first_record + start_records);
+    if (records == total && pos < v->size) {
+        walk_fail(v, "%zu bytes of data after the last of the %zu records", v->size - pos, total);
+    }
+}
+
+// Follows the BDW chain of a VB/VBS file.
+static void walk_blocks(Verifier *v) {
+    size_t pos = 0, start = 0;
+
+    while (pos < v->size) {
+        if (v->size - pos < DESCRIPTOR_LEN) {
+            walk_fail(v, "File ends inside the BDW at offset %zu", pos);
+            break;
+        }
+        size_t len = get_bdw(v, v->map + pos);
+        if (len == 0) {
+            walk_fail(v, "Invalid BDW at offset %zu (expected a %s BDW)", pos,
+                      v->extended_bdw ? "large block interface" : "standard");
+            break;
+        }
+        if (len < 2 * DESCRIPTOR_LEN + 1 || len > v->config->block_size) {
+            walk_fail(v, "Block at offset %zu has length %zu (BLOCK_SIZE %zu)", pos, len, v->config->block_size);
+            break;
+        }
+        if (len > v->size - pos) {
+            walk_fail(v, "Block at offset %zu runs past the end of the file", pos);
+            break;
+        }
+        pos += len;
+        if (pos - start >= CHUNK_BYTES) {
+            publish(v, start, pos, UNKNOWN_INDEX);
+            start = pos;
+        }
+    }
+    if (pos > start) publish(v, start, pos, UNKNOWN_INDEX);
+}
+
+// Asks the kernel to read a chunk ahead of the checks.
+static void prefetch(const Verifier *v, const Chunk *c) {
+    size_t first = c->start - c->start % v->page_size;
+    posix_madvise((void *)(v->map + first), c->end - first, POSIX_MADV_WILLNEED);
+}
+
+static void *verify_worker(void *arg) {
+    Verifier *v = arg;
+    const Config *config = v->config;
+    unsigned char *joined = NULL;
+
+    if (config->spanned && !(joined = malloc(config->record_length))) {
+        perror("Error allocating memory for a spanned record");
+        pthread_mutex_lock(&v->lock);
+        v->alloc_failed = 1;
+        pthread_mutex_unlock(&v->lock);
+        return NULL;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&v->lock);
+        while (v->next >= v->published && !v->walk_done) {
+            pthread_cond_wait(&v->cond, &v->lock);
+        }
+        if (v->next >= v->published) {
+            pthread_mutex_unlock(&v->lock);
+            break;
+        }
+        Chunk *c = &v->chunks[v->next++];
+        pthread_mutex_unlock(&v->lock);
+
+        prefetch(v, c);
+        if (config->file_type == FILE_TYPE_FIXED) {
+            check_fixed(v, c);
+        } else if (config->block_size > 0) {
+            check_blocks(v, c, joined);
+        } else {
+            check_variable(v, c);
+        }
+    }
+    free(joined);
+    return NULL;
+}
+
+static size_t verify_threads(const Config *config) {
+    if (config->threads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        return (n > 0) ? (size_t)n : 1;
+    }
+    return config->threads;
+}
+
+// Sets up the record structure and the chunk list. FIXED chunks are all
+// published here; VARIABLE ones are published while the chain is walked.
+static int prepare(Verifier *v) {
+    const Config *config = v->config;
+
+    if (config->data_mode == DATA_MODE_TEXT) {
+        switch (config->newline) {
+            case NEWLINE_LF: memcpy(v->newline, "\n", 1); v->newline_len = 1; break;
+            case NEWLINE_CRLF: memcpy(v->newline, "\r\n", 2); v->newline_len = 2; break;
+            case NEWLINE_CR: memcpy(v->newline, "\r", 1); v->newline_len = 1; break;
+            case NEWLINE_NONE: v->newline_len = 0; break;
+        }
+        codepage_translate(v->codepage, v->newline, v->newline_len);
+    }
+    v->min_length = (config->field_count > 0) ? config->record_length
+                  : (config->min_record_length ? config->min_record_length : 1);
+    v->max_length = config->record_length;
+    v->extended_bdw = (config->block_size > BDW_MAX_STANDARD);
+    long page = sysconf(_SC_PAGESIZE);
+    v->page_size = (page > 0) ? (size_t)page : 4096;
+
+    if (compile_checks(v) != 0) {
+        return 1;
+    }
+
+    if (config->file_type == FILE_TYPE_VARIABLE) {
+        v->chunk_capacity = v->size / CHUNK_BYTES + 2;
+    } else {
+        v->record_bytes = config->record_length + v->newline_len;
+        if (v->record_bytes == 0) {
+            fprintf(stderr, "Error: The definition has no RECORD_LENGTH.\n");
+            return 1;
+        }
+        size_t expected = config->record_count * v->record_bytes;
+        size_t present = v->size / v->record_bytes;
+        if (present > config->record_count) present = config->record_count;
+        if (v->size != expected) {
+            walk_fail(v, "File is %zu bytes, expected %zu (%zu records of %zu bytes)",
+                      v->size, expected, config->record_count, v->record_bytes);
+        }
+        size_t per_chunk = CHUNK_BYTES / v->record_bytes;
+        if (per_chunk == 0) per_chunk = 1;
+        v->chunk_capacity = (present + per_chunk - 1) / per_chunk + 1;
+        v->chunks = calloc(v->chunk_capacity, sizeof(Chunk));
+        if (!v->chunks) {
+            perror("Error allocating memory for the chunks");
+            return 1;
+        }
+        for (size_t r = 0; r < present; r += per_chunk) {
+            size_t n = (present - r < per_chunk) ? present - r : per_chunk;
+            publish(v, r * v->record_bytes, (r + n) * v->record_bytes, config->first_record + r);
+        }
+        v->walk_done = 1;
+        return 0;
+    }
+
+    v->chunks = calloc(v->chunk_capacity, sizeof(Chunk));
+    if (!v->chunks) {
+        perror("Error allocating memory for the chunks");
+        return 1;
+    }
+    return 0;
+}
+
+// Prints the first failure in file order and the summary.
+static int report(const Verifier *v) {
+    const Config *config = v->config;
+    uint64_t records = 0, bad = 0;
+    const Chunk *first = NULL;
+    uint64_t first_record = 0;
+
+    for (size_t k = 0; k < v->published; k++) {
+        const Chunk *c = &v->chunks[k];
+        if (c->failed && !first) {
+            first = c;
+            first_record = records + c->fail_record;
+        }
+        records += c->records;
+        bad += c->bad;
+    }
+
+    if (first) {
+        fprintf(stderr, "Record %llu at offset %zu: %s\n",
+                (unsigned long long)(config->first_record + first_record), first->fail_offset, first->message);
+    }
+    if (v->broken) {
+        fprintf(stderr, "%s\n", v->broken_message);
+    } else if (records != config->record_count) {
+        fprintf(stderr, "File holds %llu records, expected %zu\n", (unsigned long long)records, config->record_count);
+    }
+    if (first || v->broken || v->alloc_failed || records != config->record_count) {
+        fprintf(stderr, "Verification failed: %llu of %llu records checked are invalid%s.\n",
+                (unsigned long long)bad, (unsigned long long)records,
+                v->broken ? ", and the file structure is broken" : "");
+        return 1;
+    }
+    printf("Verification passed: %llu records, %zu bytes.\n", (unsigned long long)records, v->size);
+    return 0;
+}
+
+int verify_file(const Config *config, const char *path) {
+    codepage_init();
+    select_span();
+    if (config->record_type_count > 0) {
+        // The checks follow one record layout.
+        fprintf(stderr, "Error: files with RECORD_TYPE sections cannot be verified.\n");
+        return 1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening file to verify");
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("Error reading file to verify");
+        close(fd);
+        return 1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        fprintf(stderr, "Error: %s is not a regular file.\n", path);
+        close(fd);
+        return 1;
+    }
+
+    Verifier v;
+    memset(&v, 0, sizeof(v));
+    v.config = config;
+    v.codepage = codepage_get(config->output_codepage);
+    v.size = (size_t)st.st_size;
+    if (v.size > 0) {
+        void *map = mmap(NULL, v.size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("Error mapping file to verify");
+            close(fd);
+            return 1;
+        }
+        v.map = map;
+        posix_madvise(map, v.size, POSIX_MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    pthread_mutex_init(&v.lock, NULL);
+    pthread_cond_init(&v.cond, NULL);
+
+    int rc = prepare(&v);
+    if (rc == 0) {
+        size_t threads = verify_threads(config);
+        pthread_t *tids = malloc(threads * sizeof(pthread_t));
+        size_t started = 0;
+        if (tids) {
+            for (; started < threads; started++) {
+                if (pthread_create(&tids[started], NULL, verify_worker, &v) != 0) break;
+            }
+        }
+
+        if (config->file_type == FILE_TYPE_VARIABLE) {
+            if (config->block_size > 0) {
+                walk_blocks(&v);
+            } else {
+                walk_records(&v);
+            }
+            pthread_mutex_lock(&v.lock);
+            v.walk_done = 1;
+            pthread_cond_broadcast(&v.cond);
+            pthread_mutex_unlock(&v.lock);
+        }
+
+        // The calling thread helps with the chunks left (all of them if no
+        // thread could be started).
+        verify_worker(&v);
+        for (size_t t = 0; t < started; t++) {
+            pthread_join(tids[t], NULL);
+        }
+        free(tids);
+
+        // A chunk only goes unchecked if every thread failed to allocate.
+        rc = (v.next < v.published) ? 1 : report(&v);
+    }
+
+    free(v.chunks);
+    free(v.checks);
+    plan_free(&v.plan);
+    pthread_cond_destroy(&v.cond);
+    pthread_mutex_destroy(&v.lock);
+    if (v.map) munmap((void *)v.map, v.size);
+    return rc;
+}
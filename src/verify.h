@@ -0,0 +1,27 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "config.h"
+
+// Verification of a generated file against its definition (--verify).
+//
+// The file is mapped read-only and checked for what generate_data() writes
+// for the same Config: the record structure (FIXED record size and
+// NEWLINE, the RDW chain of VARIABLE files, the BDWs and segment sequence
+// of VB/VBS blocks), the record count, record lengths within
+// MIN_RECORD_LENGTH-RECORD_LENGTH, and the content of every record or
+// FIELD: printable text of the codepage, valid Shift-JIS lead/trail
+// pairs, ISO-2022 shift codes balanced within the record, zoned and packed
+// decimals, and the bytes of a constant FILL_PATTERN.
+//
+// The file is cut into chunks of whole records (whole blocks when
+// blocked); chunks are checked in parallel while the calling thread walks
+// the RDW/BDW chain to find the next chunk boundary. Character classes are
+// tested 16 or 32 bytes at a time (SSSE3/AVX2).
+
+// Checks the file at `path`, using config->threads threads (0 = one per
+// CPU). Prints the first mismatch and a summary.
+// Returns 0 if the file matches the definition, non-zero otherwise.
+int verify_file(const Config *config, const char *path);
+
+#endif // VERIFY_H